@@ -0,0 +1,431 @@
+// test2 键值文件解析基准测试
+// 直接包含 test2/main.c，生成合成的 key:value 文件，对比原来逐行 fgets + ctype 的 load_file 流程
+// 与分块向量化扫描（逐字节查表、SSE2、AVX2 三种扫描函数）的解析吞吐量（GB/s），
+// 以及包含建立哈希索引和有序索引在内的完整 load_file 耗时、精确查找和前缀查询的耗时，
+// 最后启动服务器模式，用多个客户端线程以流水线方式查询，按工作线程数报告吞吐量。
+// 各解析器解析出的键值对数量和校验和必须一致，否则报错退出。
+// 生成的行长度都小于 1023 字节，不会触发原来 fgets 缓冲区的截断。
+//
+// 用法：
+//   kv_bench [--size 64] [--repeat 5] [--clients 8] [--batches 2000] [--seed 1]
+// --size 为生成文件的大小（MB），--repeat 为每个解析器的重复次数（取最快一次），
+// --clients 为查询服务器的客户端线程数，--batches 为每个客户端发送的批数（每批 64 个请求）
+
+#define KV_NO_MAIN
+#include "../test2/main.c"
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// 解析结果摘要：键值对数量和校验和
+// 校验和只取键和值的长度、首尾字节，足以发现边界错误，又不会让逐字节计算校验和的开销掩盖解析本身的耗时
+typedef struct {
+	size_t pairs;
+	uint64_t checksum;
+} Digest;
+
+static int digest_pair(void *ctx, const char *key, size_t key_len, const char *value, size_t value_len) {
+	Digest *d = (Digest*)ctx;
+	uint64_t h = (uint64_t)key_len << 56 | (uint64_t)value_len << 40 |
+	             (uint64_t)(unsigned char)key[0] << 32 | (uint64_t)(unsigned char)key[key_len - 1] << 24 |
+	             (uint64_t)(unsigned char)value[0] << 16 | (uint64_t)(unsigned char)value[value_len - 1] << 8;
+	d->pairs++;
+	d->checksum = (d->checksum ^ h) * 0x9E3779B97F4A7C15ull + d->pairs;
+	return 1;
+}
+
+// ===================== 原来的逐行解析 =====================
+// 与改为分块扫描之前的 load_file 相同：fgets 读一行，再用 ctype 函数和 strchr 逐字节处理
+
+static void legacy_strip_utf8_bom(char *s) {
+	unsigned char *u = (unsigned char*)s;
+	if (u[0] == 0xEF && u[1] == 0xBB && u[2] == 0xBF) {
+		memmove(s, s + 3, strlen(s + 3) + 1);
+	}
+}
+
+static int legacy_is_valid_key(const char *key) {
+	size_t len = strlen(key);
+	if (len == 0 || len > 10) return 0;
+	for (size_t i = 0; i < len; ++i) {
+		unsigned char c = (unsigned char)key[i];
+		if (!(isalnum(c) || c == '_')) return 0;
+	}
+	return 1;
+}
+
+static int legacy_load_file(const char *path, Digest *out) {
+	FILE *fp = fopen(path, "r");
+	if (!fp) return 0;
+	char line[1024];
+	while (fgets(line, sizeof(line), fp)) {
+		strip_newline(line);
+		legacy_strip_utf8_bom(line);
+		char *cursor = line;
+		while (*cursor && isspace((unsigned char)*cursor)) cursor++;
+		if (*cursor == '\0') continue;
+		char *colon = strchr(line, ':');
+		if (!colon) continue;
+		*colon = '\0';
+		char *key = line;
+		char *value = colon + 1;
+		trim(key);
+		trim(value);
+		if (*key == '\0' || *value == '\0') continue;
+		if (!legacy_is_valid_key(key)) continue;
+		digest_pair(out, key, strlen(key), value, strlen(value));
+	}
+	fclose(fp);
+	return 1;
+}
+
+// ===================== 数据生成 =====================
+
+static uint64_t rng_state = 1;
+
+static uint32_t next_random(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (uint32_t)rng_state;
+}
+
+static void append_random(FILE *fp, const char *alphabet, int len) {
+	size_t n = strlen(alphabet);
+	for (int i = 0; i < len; ++i) {
+		fputc(alphabet[next_random() % n], fp);
+	}
+}
+
+// 生成约 size 字节的数据文件：大部分是合法行，混有首尾空白、CRLF、UTF-8 值、
+// 过长或含非法字符的键、无冒号的行、空行和空值
+static void write_data_file(const char *path, size_t size) {
+	const char *key_chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+	const char *value_chars = "abcdefghijklmnopqrstuvwxyz ABCDEFG0123456789:-_/.,";
+	FILE *fp = fopen(path, "wb");
+	if (!fp) return;
+	fputs("\xEF\xBB\xBF", fp);
+	while ((size_t)ftell(fp) < size) {
+		uint32_t kind = next_random() % 100;
+		if (kind < 70) {
+			append_random(fp, key_chars, 1 + (int)(next_random() % 10));
+			fputc(':', fp);
+			append_random(fp, value_chars, 1 + (int)(next_random() % 60));
+		} else if (kind < 78) {
+			fputs(" \t", fp);
+			append_random(fp, key_chars, 1 + (int)(next_random() % 10));
+			fputs(" : ", fp);
+			append_random(fp, value_chars, 1 + (int)(next_random() % 40));
+			fputs("  \r", fp);
+		} else if (kind < 82) {
+			append_random(fp, key_chars, 1 + (int)(next_random() % 8));
+			fputs(":\xE4\xBD\xA0\xE5\xA5\xBD ", fp);
+			append_random(fp, value_chars, (int)(next_random() % 20));
+		} else if (kind < 86) {
+			append_random(fp, key_chars, 11 + (int)(next_random() % 10));
+			fputc(':', fp);
+			append_random(fp, value_chars, 10);
+		} else if (kind < 90) {
+			append_random(fp, key_chars, 3);
+			fputc(next_random() % 2 ? ' ' : '-', fp);
+			append_random(fp, key_chars, 3);
+			fputc(':', fp);
+			append_random(fp, value_chars, 10);
+		} else if (kind < 94) {
+			append_random(fp, value_chars + 27, 30);
+		} else if (kind < 97) {
+			fputs(next_random() % 2 ? "" : "   \t", fp);
+		} else {
+			append_random(fp, key_chars, 5);
+			fputs(":   ", fp);
+		}
+		fputc('\n', fp);
+	}
+	fclose(fp);
+}
+
+// ===================== 计时 =====================
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 输出一行结果，并检查与参考结果是否一致
+// 返回: 一致时返回1
+static int report(const char *name, double seconds, size_t bytes, const Digest *d, const Digest *expected) {
+	printf("%-16s %10.4f %10.3f %12zu\n", name, seconds, bytes / seconds / 1e9, d->pairs);
+	if (d->pairs != expected->pairs || d->checksum != expected->checksum) {
+		fprintf(stderr, "%s: result differs from the legacy parser.\n", name);
+		return 0;
+	}
+	return 1;
+}
+
+// ===================== 服务器客户端 =====================
+
+#define CLIENT_BATCH 64        // 每批连续发送的请求数（流水线深度）
+
+// 一个客户端线程：连接服务器，按批发送精确查找请求，每批读完所有回答后再发下一批
+typedef struct {
+	const char *path;
+	const PairArray *dict;
+	size_t first;              // 从第 first 个键开始轮流查询
+	long batches;
+	long answers;              // 收到的回答行数
+	pthread_t thread;
+} Client;
+
+static void *client_main(void *arg) {
+	Client *c = (Client*)arg;
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", c->path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		if (fd >= 0) close(fd);
+		return NULL;
+	}
+	char request[CLIENT_BATCH * 12], reply[65536];
+	size_t next = c->first;
+	for (long b = 0; b < c->batches; ++b) {
+		size_t len = 0;
+		for (int i = 0; i < CLIENT_BATCH; ++i) {
+			const char *key = c->dict->items[next].key;
+			next = (next + 7919) % c->dict->size;
+			size_t key_len = strlen(key);
+			memcpy(request + len, key, key_len);
+			request[len + key_len] = '\n';
+			len += key_len + 1;
+		}
+		if (send(fd, request, len, MSG_NOSIGNAL) != (ssize_t)len) break;
+		long pending = CLIENT_BATCH;
+		while (pending > 0) {
+			ssize_t n = recv(fd, reply, sizeof(reply), 0);
+			if (n <= 0) break;
+			for (ssize_t i = 0; i < n; ++i) pending -= reply[i] == '\n';
+		}
+		if (pending > 0) break;
+		c->answers += CLIENT_BATCH;
+	}
+	close(fd);
+	return NULL;
+}
+
+// 启动有 threads 个工作线程的服务器，用 clients 个客户端线程查询并输出吞吐量
+// 返回: 所有请求都收到回答时返回1
+static int bench_server(const PairArray *dict, int threads, int clients, long batches) {
+	KvServer *server = server_start(dict, "kv.sock", threads);
+	if (!server) return 0;
+	Client *list = (Client*)calloc((size_t)clients, sizeof(Client));
+	double start = now_seconds();
+	for (int i = 0; list && i < clients; ++i) {
+		list[i].path = "kv.sock";
+		list[i].dict = dict;
+		list[i].first = (size_t)i * 104729 % dict->size;
+		list[i].batches = batches;
+		pthread_create(&list[i].thread, NULL, client_main, &list[i]);
+	}
+	long answers = 0;
+	for (int i = 0; list && i < clients; ++i) {
+		pthread_join(list[i].thread, NULL);
+		answers += list[i].answers;
+	}
+	double t = now_seconds() - start;
+	server_stop(server);
+	free(list);
+	char name[32];
+	snprintf(name, sizeof(name), "server %dt", threads);
+	printf("%-16s %10.4f %10.0f %12ld\n", name, t, answers / t, answers);
+	long expected = (long)clients * batches * CLIENT_BATCH;
+	if (answers != expected) {
+		fprintf(stderr, "%s: %ld of %ld requests answered.\n", name, answers, expected);
+		return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	size_t size_mb = 64;
+	int repeat = 5;
+	int clients = 8;
+	long batches = 2000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+			size_mb = (size_t)atol(argv[++i]);
+		} else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+			repeat = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+			clients = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--batches") == 0 && i + 1 < argc) {
+			batches = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			rng_state = (uint64_t)strtoull(argv[++i], NULL, 10) | 1;
+		} else {
+			fprintf(stderr, "Usage: %s [--size MB] [--repeat n] [--clients n] [--batches n] [--seed n]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (size_mb == 0 || repeat <= 0 || clients <= 0 || batches <= 0) {
+		fprintf(stderr, "Invalid --size, --repeat, --clients or --batches.\n");
+		return 1;
+	}
+
+	// 在临时目录中生成数据文件
+	char work_dir[] = "/tmp/kv_bench.XXXXXX";
+	if (!mkdtemp(work_dir) || chdir(work_dir) != 0) {
+		fprintf(stderr, "Cannot create working directory.\n");
+		return 1;
+	}
+	init_scanner();
+	write_data_file("data.txt", size_mb << 20);
+
+	// 原来的流程：逐行 fgets（文件已在页缓存中）
+	Digest expected = {0, 0};
+	double best = 1e30;
+	for (int r = 0; r < repeat; ++r) {
+		Digest d = {0, 0};
+		double start = now_seconds();
+		legacy_load_file("data.txt", &d);
+		double t = now_seconds() - start;
+		if (t < best) best = t;
+		expected = d;
+	}
+	size_t len = 0;
+	char *data = read_file("data.txt", &len);
+	if (!data) {
+		fprintf(stderr, "Cannot read data file.\n");
+		return 1;
+	}
+	printf("File: %.1f MB, best of %d runs, detected scanner: %s\n", len / 1048576.0, repeat, scan_name);
+	printf("%-16s %10s %10s %12s\n", "parser", "seconds", "GB/s", "pairs");
+	int ok = report("legacy fgets", best, len, &expected, &expected);
+
+	// 分块扫描：读文件 + 解析（使用启动时选择的扫描函数）
+	best = 1e30;
+	Digest d = {0, 0};
+	for (int r = 0; r < repeat; ++r) {
+		d.pairs = 0;
+		d.checksum = 0;
+		double start = now_seconds();
+		size_t n = 0;
+		char *buffer = read_file("data.txt", &n);
+		parse_buffer(buffer, n, digest_pair, &d);
+		free(buffer);
+		double t = now_seconds() - start;
+		if (t < best) best = t;
+	}
+	ok &= report("read+parse", best, len, &d, &expected);
+
+	// 完整的 load_file：读文件、解析、去重建立哈希索引、排序建立有序索引
+	// 重复键只保留一次，键值对数量少于上面的结果，因此只输出不比较
+	best = 1e30;
+	PairArray dict;
+	dict.items = NULL;
+	for (int r = 0; r < repeat; ++r) {
+		if (dict.items) pair_array_free(&dict);
+		if (!pair_array_init(&dict, 16)) {
+			fprintf(stderr, "Memory allocation failed.\n");
+			return 1;
+		}
+		double start = now_seconds();
+		load_file("data.txt", &dict);
+		double t = now_seconds() - start;
+		if (t < best) best = t;
+	}
+	printf("%-16s %10.4f %10.3f %12zu\n", "load_file", best, len / best / 1e9, dict.size);
+
+	// 逐个扫描函数：只计解析（数据已在内存中），以及只计扫描（生成位图，不含逐行处理）
+	struct {
+		const char *name;
+		ScanFunc func;
+		int supported;
+	} scanners[] = {
+		{"scalar", scan_masks_scalar, 1},
+#ifdef KV_HAVE_X86_SIMD
+		{"sse2", scan_masks_sse2, __builtin_cpu_supports("sse2")},
+		{"avx2", scan_masks_avx2, __builtin_cpu_supports("avx2")},
+#endif
+	};
+	size_t scanner_count = sizeof(scanners) / sizeof(scanners[0]);
+	char name[32];
+	for (size_t s = 0; s < scanner_count; ++s) {
+		if (!scanners[s].supported) continue;
+		scan_masks = scanners[s].func;
+		best = 1e30;
+		for (int r = 0; r < repeat; ++r) {
+			d.pairs = 0;
+			d.checksum = 0;
+			double start = now_seconds();
+			parse_buffer(data, len, digest_pair, &d);
+			double t = now_seconds() - start;
+			if (t < best) best = t;
+		}
+		snprintf(name, sizeof(name), "parse %s", scanners[s].name);
+		ok &= report(name, best, len, &d, &expected);
+	}
+	static ScanMasks masks;
+	for (size_t s = 0; s < scanner_count; ++s) {
+		if (!scanners[s].supported) continue;
+		best = 1e30;
+		for (int r = 0; r < repeat; ++r) {
+			double start = now_seconds();
+			for (size_t pos = 0; pos < len; pos += KV_BLOCK) {
+				scanners[s].func((const unsigned char *)data + pos, len - pos < KV_BLOCK ? len - pos : KV_BLOCK, &masks);
+			}
+			double t = now_seconds() - start;
+			if (t < best) best = t;
+		}
+		snprintf(name, sizeof(name), "scan %s", scanners[s].name);
+		printf("%-16s %10.4f %10.3f %12s\n", name, best, len / best / 1e9, "-");
+	}
+
+	// 查询：按插入顺序逐个精确查找所有键，以及以前一万个键的前三个字符做前缀查询（输出写入 /dev/null）
+	printf("%-16s %10s %10s %12s\n", "query", "seconds", "ns/query", "results");
+	FILE *sink = fopen("/dev/null", "w");
+	size_t found = 0, queries = dict.size < 10000 ? dict.size : 10000;
+	double start = now_seconds();
+	for (size_t i = 0; i < dict.size; ++i) {
+		if (pair_array_find(&dict, dict.items[i].key) == dict.items[i].value) found++;
+	}
+	double t = now_seconds() - start;
+	printf("%-16s %10.4f %10.1f %12zu\n", "exact", t, t / dict.size * 1e9, found);
+	if (found != dict.size) {
+		fprintf(stderr, "exact: %zu of %zu keys found.\n", found, dict.size);
+		ok = 0;
+	}
+	found = 0;
+	start = now_seconds();
+	for (size_t i = 0; sink && i < queries; ++i) {
+		char prefix[4];
+		snprintf(prefix, sizeof(prefix), "%s", dict.items[i].key);
+		found += pair_array_print_prefix(&dict, prefix, write_stream, sink);
+	}
+	t = now_seconds() - start;
+	printf("%-16s %10.4f %10.1f %12zu\n", "prefix", t, t / queries * 1e9, found);
+	if (sink) fclose(sink);
+
+	// 服务器模式：工作线程数从1加倍到 CPU 核数，客户端线程数固定
+	if (dict.size > 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		printf("%-16s %10s %10s %12s\n", "server", "seconds", "req/s", "answers");
+		for (int threads = 1; ; threads *= 2) {
+			if (threads > cpus) threads = (int)(cpus > 0 ? cpus : 1);
+			ok &= bench_server(&dict, threads, clients, batches);
+			if (threads >= cpus) break;
+		}
+	}
+	pair_array_free(&dict);
+	(void)run_server;
+
+	free(data);
+	remove("data.txt");
+	if (chdir("/") == 0) {
+		rmdir(work_dir);
+	}
+	return ok ? 0 : 1;
+}
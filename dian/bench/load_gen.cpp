@@ -0,0 +1,261 @@
+// 端到端负载生成器
+// 直接包含 level2/main.cpp，用合成的预约流量驱动命令解释器 executeCommand：
+// 用户 A-Z 随机发出 Reserve、"Monday Floor n"、Reservation 请求，
+// 管理员周期性地突发 ClearDay / SetUnavailable（随后 SetAvailable 恢复）。
+// 可按目标速率开环发送请求，延迟从计划发送时刻算起（避免协调遗漏），
+// 最后按命令类型报告吞吐量与 p50/p99/p999 延迟。
+//
+// 用法：
+//   load_gen [--ops 20000] [--rate 0] [--layout 5x4x4] [--mix reserve=50,show=35,reservation=15]
+//            [--admin-every 500] [--burst 4] [--seed 1] [--format text|json] [--metrics]
+// 指定 --metrics 时同时开启 level2 的内置统计，并在报告后附上各阶段耗时拆分。
+
+#define LIBRARY_NO_MAIN
+#include "../level2/main.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+// 命令类型
+enum CommandType { CMD_RESERVE, CMD_SHOW, CMD_RESERVATION, CMD_CLEAR_DAY, CMD_SET_UNAVAILABLE, CMD_SET_AVAILABLE, CMD_TYPES };
+const char *COMMAND_NAMES[CMD_TYPES] = {"Reserve", "Show", "Reservation", "ClearDay", "SetUnavailable", "SetAvailable"};
+
+// 一条待发送的请求
+struct Request {
+    CommandType type;
+    UserId user;          // 发出请求的用户（管理员请求为 NO_USER）
+    string command;       // 完整命令字符串
+};
+
+// 运行参数
+long totalOps = 20000;          // 用户请求总数（不含管理员突发）
+double targetRate = 0;          // 目标速率（请求/秒），0 表示闭环全速
+int layoutFloors = 5, layoutRows = 4, layoutCols = 4;
+int weights[3] = {50, 35, 15};  // Reserve / Show / Reservation 的权重
+long adminEvery = 500;          // 每隔多少个用户请求插入一次管理员突发，0 表示关闭
+int burstSize = 4;              // 每次突发的管理员命令数
+unsigned seed = 1;              // 随机种子
+string outputFormat = "text";   // 输出格式：text 或 json
+
+// 从样本中取百分位数（样本已排序）
+double percentile(const vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[min(index, sorted.size() - 1)];
+}
+
+// 解析 "reserve=50,show=35,reservation=15"
+bool parseMix(const string &text) {
+    istringstream iss(text);
+    string item;
+    while (getline(iss, item, ',')) {
+        size_t eq = item.find('=');
+        if (eq == string::npos) return false;
+        string name = item.substr(0, eq);
+        int weight = atoi(item.c_str() + eq + 1);
+        if (weight < 0) return false;
+        if (name == "reserve") weights[0] = weight;
+        else if (name == "show") weights[1] = weight;
+        else if (name == "reservation") weights[2] = weight;
+        else return false;
+    }
+    return weights[0] + weights[1] + weights[2] > 0;
+}
+
+// 生成完整的请求序列
+// 日期按近期优先的几何分布选择（越靠前的日期越热门），楼层、座位均匀分布
+vector<Request> generateWorkload() {
+    mt19937 rng(seed);
+    vector<UserId> users;
+    for (char letter = 'A'; letter <= 'Z'; letter++) {
+        users.push_back(internUser(string(1, letter)));
+    }
+    discrete_distribution<int> kindDist({(double)weights[0], (double)weights[1], (double)weights[2]});
+    discrete_distribution<int> dayDist({32, 20, 14, 10, 8, 8, 8});
+    uniform_int_distribution<int> userDist(0, 25);
+    uniform_int_distribution<int> floorDist(1, layoutFloors);
+    uniform_int_distribution<int> rowDist(1, layoutRows);
+    uniform_int_distribution<int> colDist(1, layoutCols);
+    uniform_int_distribution<int> coin(0, 1);
+
+    vector<Request> requests;
+    requests.reserve(totalOps + (adminEvery > 0 ? totalOps / adminEvery * burstSize : 0));
+    for (long i = 0; i < totalOps; i++) {
+        // 管理员突发：ClearDay，或者 SetUnavailable 后紧跟 SetAvailable
+        if (adminEvery > 0 && i > 0 && i % adminEvery == 0) {
+            for (int b = 0; b < burstSize; b++) {
+                const string &day = DAYS[dayDist(rng)];
+                if (coin(rng)) {
+                    requests.push_back({CMD_CLEAR_DAY, NO_USER, "ClearDay " + day});
+                } else {
+                    string floor = to_string(floorDist(rng));
+                    requests.push_back({CMD_SET_UNAVAILABLE, NO_USER, "SetUnavailable " + day + " " + floor});
+                    requests.push_back({CMD_SET_AVAILABLE, NO_USER, "SetAvailable " + day + " " + floor});
+                }
+            }
+        }
+
+        UserId user = users[userDist(rng)];
+        const string &day = DAYS[dayDist(rng)];
+        switch (kindDist(rng)) {
+        case 0:
+            requests.push_back({CMD_RESERVE, user, "Reserve " + day + " Floor " + to_string(floorDist(rng)) +
+                                " Seat " + to_string(rowDist(rng)) + " " + to_string(colDist(rng))});
+            break;
+        case 1:
+            requests.push_back({CMD_SHOW, user, day + " Floor " + to_string(floorDist(rng))});
+            break;
+        default:
+            requests.push_back({CMD_RESERVATION, user, "Reservation"});
+            break;
+        }
+    }
+    return requests;
+}
+
+// 输出文本报告
+void reportText(const vector<vector<double>> &latencies, long total, double seconds) {
+    printf("Layout %dx%dx%d, %ld requests in %.3f s, throughput %.1f req/s\n",
+           layoutFloors, layoutRows, layoutCols, total, seconds, total / seconds);
+    printf("%-16s %10s %12s %12s %12s %12s %12s\n", "command", "count", "req/s", "p50_us", "p99_us", "p999_us", "max_us");
+    for (int t = 0; t < CMD_TYPES; t++) {
+        const vector<double> &s = latencies[t];
+        if (s.empty()) continue;
+        printf("%-16s %10zu %12.1f %12.1f %12.1f %12.1f %12.1f\n", COMMAND_NAMES[t], s.size(), s.size() / seconds,
+               percentile(s, 0.5) / 1e3, percentile(s, 0.99) / 1e3, percentile(s, 0.999) / 1e3, s.back() / 1e3);
+    }
+}
+
+// 输出 JSON 报告
+void reportJson(const vector<vector<double>> &latencies, long total, double seconds) {
+    printf("{\n  \"layout\": \"%dx%dx%d\", \"target_rate\": %g, \"requests\": %ld, \"seconds\": %.6f, \"throughput\": %.1f,\n",
+           layoutFloors, layoutRows, layoutCols, targetRate, total, seconds, total / seconds);
+    printf("  \"commands\": [\n");
+    bool first = true;
+    for (int t = 0; t < CMD_TYPES; t++) {
+        const vector<double> &s = latencies[t];
+        if (s.empty()) continue;
+        printf("%s    {\"command\": \"%s\", \"count\": %zu, \"throughput\": %.1f, \"p50_ns\": %.0f, "
+               "\"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f}",
+               first ? "" : ",\n", COMMAND_NAMES[t], s.size(), s.size() / seconds,
+               percentile(s, 0.5), percentile(s, 0.99), percentile(s, 0.999), s.back());
+        first = false;
+    }
+    printf("\n  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    // 解析命令行参数
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        bool ok = true;
+        if (arg == "--ops" && hasValue) {
+            totalOps = atol(argv[++i]);
+        } else if (arg == "--rate" && hasValue) {
+            targetRate = atof(argv[++i]);
+        } else if (arg == "--layout" && hasValue) {
+            ok = sscanf(argv[++i], "%dx%dx%d", &layoutFloors, &layoutRows, &layoutCols) == 3 &&
+                 layoutFloors > 0 && layoutRows > 0 && layoutCols > 0;
+        } else if (arg == "--mix" && hasValue) {
+            ok = parseMix(argv[++i]);
+        } else if (arg == "--admin-every" && hasValue) {
+            adminEvery = atol(argv[++i]);
+        } else if (arg == "--burst" && hasValue) {
+            burstSize = atoi(argv[++i]);
+        } else if (arg == "--seed" && hasValue) {
+            seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--metrics") {
+            metricsEnabled = true;
+        } else if (arg == "--format" && hasValue) {
+            outputFormat = argv[++i];
+            ok = outputFormat == "text" || outputFormat == "json";
+        } else {
+            ok = false;
+        }
+        if (!ok || totalOps <= 0) {
+            fprintf(stderr, "Usage: %s [--ops n] [--rate req/s] [--layout FxRxC] [--mix reserve=w,show=w,reservation=w]\n"
+                            "          [--admin-every n] [--burst n] [--seed n] [--format text|json] [--metrics]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // 在临时目录中运行，避免覆盖真实的数据文件
+    char workDir[] = "/tmp/load_gen.XXXXXX";
+    if (!mkdtemp(workDir) || chdir(workDir) != 0) {
+        fprintf(stderr, "Cannot create working directory.\n");
+        return 1;
+    }
+
+    // 按指定布局初始化空的图书馆
+    FLOORS = layoutFloors;
+    ROWS = layoutRows;
+    COLS = layoutCols;
+    initializeLibrary();
+    saveData();
+    resetMetrics();
+
+    vector<Request> requests = generateWorkload();
+    vector<vector<double>> latencies(CMD_TYPES);
+
+    // 命令输出写入 /dev/null
+    filebuf devNull;
+    devNull.open("/dev/null", ios::out);
+    streambuf *consoleBuf = cout.rdbuf(&devNull);
+
+    using Clock = chrono::steady_clock;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < requests.size(); i++) {
+        const Request &req = requests[i];
+
+        // 开环模式下按计划时刻发送，延迟从计划时刻算起
+        Clock::time_point scheduled = Clock::now();
+        if (targetRate > 0) {
+            scheduled = start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(i / targetRate));
+            this_thread::sleep_until(scheduled);
+        }
+
+        // 模拟该请求所属会话的登录状态
+        if (req.user == NO_USER) {
+            currentUser = NO_USER;
+            isAdmin = true;
+        } else {
+            currentUser = req.user;
+            isAdmin = false;
+        }
+        executeCommand(req.command);
+        latencies[req.type].push_back(chrono::duration<double, nano>(Clock::now() - scheduled).count());
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    cout.rdbuf(consoleBuf);
+    remove(DATA_FILE.c_str());
+    remove(USERS_FILE.c_str());
+    remove(CHANGES_FILE.c_str());
+    remove(ARCHIVE_FILE.c_str());
+    if (chdir("/") == 0) {
+        rmdir(workDir);
+    }
+
+    for (vector<double> &s : latencies) {
+        sort(s.begin(), s.end());
+    }
+    if (outputFormat == "json") {
+        reportJson(latencies, (long)requests.size(), seconds);
+    } else {
+        reportText(latencies, (long)requests.size(), seconds);
+    }
+    if (metricsEnabled) {
+        if (outputFormat == "json") {
+            writeMetricsJson(cout);
+        } else {
+            cout << endl;
+            writeMetricsText(cout);
+        }
+    }
+    return 0;
+}
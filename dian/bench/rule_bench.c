@@ -0,0 +1,209 @@
+// test1 规则表应答基准测试
+// 直接包含 test1/main.c，对不同条数的规则表生成规则文件和输入（一半命中某条规则，一半不命中），
+// 计时规则表的加载建表，以及按块读取 + 完美哈希查找的应答吞吐量（行/秒），
+// 并与原来逐行 fgets 后依次 strcmp 每条规则的做法对比（规则较多时跳过，耗时与规则条数成正比）。
+// 应答输出写入文件，与生成输入时记录的期望输出逐字节比较，不一致时报错退出。
+//
+// 用法：
+//   rule_bench [--rules 1,1000,100000,1000000] [--lines 1000000] [--seed 1]
+
+#define RULES_NO_MAIN
+#include "../test1/main.c"
+
+#include <fcntl.h>
+#include <time.h>
+
+// 原来的做法最多比较这么多条规则，再多就太慢了
+#define LEGACY_MAX_RULES 1000
+
+static uint64_t rng_state = 1;
+
+static uint32_t next_random(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (uint32_t)rng_state;
+}
+
+static double now_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 生成 rules 条规则的规则文件、lines 行输入和期望输出
+// 规则 i 的输入为 "cmd<i>/<随机串>"（长度不等），回答为 "resp<i>"
+static int write_fixture(size_t rules, size_t lines) {
+	FILE *rule_file = fopen("rules.txt", "wb");
+	FILE *input = fopen("input.txt", "wb");
+	FILE *expected = fopen("expected.txt", "wb");
+	char (*inputs)[40] = (char(*)[40])malloc(rules * sizeof(*inputs));
+	if (!rule_file || !input || !expected || !inputs) {
+		if (rule_file) fclose(rule_file);
+		if (input) fclose(input);
+		if (expected) fclose(expected);
+		free(inputs);
+		return 0;
+	}
+	for (size_t i = 0; i < rules; ++i) {
+		int len = snprintf(inputs[i], sizeof(inputs[i]), "cmd%zu/", i);
+		int extra = (int)(next_random() % 20);
+		for (int k = 0; k < extra; ++k) inputs[i][len++] = (char)('a' + next_random() % 26);
+		inputs[i][len] = '\0';
+		fprintf(rule_file, "%s\tresp%zu\n", inputs[i], i);
+	}
+	for (size_t l = 0; l < lines; ++l) {
+		if (next_random() % 2) {
+			size_t i = next_random() % rules;
+			fprintf(input, "%s\n", inputs[i]);
+			fprintf(expected, "resp%zu\n", i);
+		} else {
+			fprintf(input, "cmd%u/miss\n", next_random());
+			fputs("Error\n", expected);
+		}
+	}
+	fclose(rule_file);
+	fclose(input);
+	fclose(expected);
+	free(inputs);
+	return 1;
+}
+
+// 比较两个文件的内容
+static int same_file(const char *a, const char *b) {
+	FILE *x = fopen(a, "rb"), *y = fopen(b, "rb");
+	int same = x && y;
+	char bx[65536], by[65536];
+	while (same) {
+		size_t nx = fread(bx, 1, sizeof(bx), x), ny = fread(by, 1, sizeof(by), y);
+		if (nx != ny || memcmp(bx, by, nx) != 0) same = 0;
+		if (nx == 0) break;
+	}
+	if (x) fclose(x);
+	if (y) fclose(y);
+	return same;
+}
+
+// 原来的做法：fgets 读一行，依次与每条规则 strcmp
+static void legacy_respond(const RuleTable *table, FILE *in, FILE *out) {
+	char input_buffer[256];
+	while (fgets(input_buffer, (int)sizeof(input_buffer), in) != NULL) {
+		input_buffer[strip_newline(input_buffer, strlen(input_buffer))] = '\0';
+		if (strcmp(input_buffer, "Quit") == 0) break;
+		size_t i;
+		for (i = 0; i < table->count; ++i) {
+			if (strcmp(input_buffer, table->rules[i].input) == 0) break;
+		}
+		if (i < table->count) {
+			fprintf(out, "%s\n", table->rules[i].response);
+		} else {
+			fputs("Error\n", out);
+		}
+	}
+}
+
+// 对一种规则条数运行基准测试
+// 返回: 输出与期望一致时返回1
+static int bench_rules(size_t rules, size_t lines) {
+	if (!write_fixture(rules, lines)) {
+		fprintf(stderr, "Cannot write fixture files.\n");
+		return 0;
+	}
+	RuleTable table;
+	memset(&table, 0, sizeof(table));
+	double start = now_seconds();
+	int ok = rule_table_load(&table, "rules.txt");
+	double build = now_seconds() - start;
+
+	// 按块读取 + 完美哈希
+	int fd = open("input.txt", O_RDONLY);
+	FILE *out = fopen("output.txt", "wb");
+	double respond = 0;
+	if (ok && fd >= 0 && out) {
+		start = now_seconds();
+		ok = respond_stream(&table, fd, out);
+		respond = now_seconds() - start;
+	} else {
+		ok = 0;
+	}
+	if (fd >= 0) close(fd);
+	if (out) fclose(out);
+	ok = ok && same_file("output.txt", "expected.txt");
+
+	// 原来的做法
+	char legacy_rate[32] = "-";
+	if (ok && rules <= LEGACY_MAX_RULES) {
+		FILE *in = fopen("input.txt", "rb");
+		out = fopen("output.txt", "wb");
+		if (in && out) {
+			start = now_seconds();
+			legacy_respond(&table, in, out);
+			snprintf(legacy_rate, sizeof(legacy_rate), "%.0f", lines / (now_seconds() - start));
+		}
+		if (in) fclose(in);
+		if (out) fclose(out);
+		ok = same_file("output.txt", "expected.txt");
+	}
+
+	printf("%10zu %10.4f %14.0f %14s\n", table.count, build, lines / respond, legacy_rate);
+	if (!ok) fprintf(stderr, "%zu rules: output differs from the expected answers.\n", rules);
+	rule_table_free(&table);
+	remove("rules.txt");
+	remove("input.txt");
+	remove("expected.txt");
+	remove("output.txt");
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	const char *rule_list = "1,1000,100000,1000000";
+	size_t lines = 1000000;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+			rule_list = argv[++i];
+		} else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+			lines = (size_t)atol(argv[++i]);
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			rng_state = (uint64_t)strtoull(argv[++i], NULL, 10) | 1;
+		} else {
+			fprintf(stderr, "Usage: %s [--rules 1,1000,...] [--lines n] [--seed n]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (lines == 0) {
+		fprintf(stderr, "Invalid --lines.\n");
+		return 1;
+	}
+
+	// 在临时目录中生成数据文件
+	char work_dir[] = "/tmp/rule_bench.XXXXXX";
+	if (!mkdtemp(work_dir) || chdir(work_dir) != 0) {
+		fprintf(stderr, "Cannot create working directory.\n");
+		return 1;
+	}
+
+	printf("%zu input lines per run, half of them match a rule\n", lines);
+	printf("%10s %10s %14s %14s\n", "rules", "build_s", "lines/s", "legacy_lines/s");
+	int ok = 1;
+	const char *p = rule_list;
+	while (*p) {
+		size_t rules = (size_t)strtoull(p, (char**)&p, 10);
+		if (rules == 0) {
+			fprintf(stderr, "Invalid --rules: %s\n", rule_list);
+			ok = 0;
+			break;
+		}
+		ok &= bench_rules(rules, lines);
+		if (*p == ',') p++;
+		else if (*p) {
+			fprintf(stderr, "Invalid --rules: %s\n", rule_list);
+			ok = 0;
+			break;
+		}
+	}
+
+	if (chdir("/") == 0) {
+		rmdir(work_dir);
+	}
+	return ok ? 0 : 1;
+}
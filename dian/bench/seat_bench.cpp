@@ -0,0 +1,301 @@
+// 座位存储热点路径微基准测试
+// 直接包含 level2/main.cpp，在临时目录中对 loadData、saveData、reserveSeat、reserveBest、
+// showSeats、showReservations、clearUserData、manageSeats 逐个计时，
+// 覆盖从 5×4×4 到 100×100×100 的多种布局，结果以 JSON 或 CSV 输出，便于跟踪性能回归。
+//
+// 用法：
+//   seat_bench [--layouts 5x4x4,100x100x100] [--min-time 0.5] [--filter name]
+//              [--format json|csv] [--out results.json]
+
+#define LIBRARY_NO_MAIN
+#include "../level2/main.cpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <unistd.h>
+
+// 座位布局（楼层数×行数×列数）
+struct Layout {
+    int floors;
+    int rows;
+    int cols;
+};
+
+// 单个基准测试的统计结果
+struct BenchResult {
+    string function;      // 被测函数名
+    Layout layout;        // 布局
+    long iterations;      // 迭代次数
+    double meanNs;        // 平均耗时（纳秒）
+    double medianNs;      // 中位数耗时
+    double minNs;         // 最小耗时
+    double maxNs;         // 最大耗时
+};
+
+// 运行参数
+double minTimeSeconds = 0.5;   // 每个基准测试的最短计时总时长
+string filterName;             // 只运行函数名包含该子串的基准测试
+string outputFormat = "json";  // 输出格式：json 或 csv
+string outputPath;             // 输出文件，为空时写到标准输出
+
+// 布局的文字表示（如 5x4x4）
+string layoutName(const Layout &layout) {
+    return to_string(layout.floors) + "x" + to_string(layout.rows) + "x" + to_string(layout.cols);
+}
+
+// 解析 "5x4x4,10x10x10" 形式的布局列表
+bool parseLayouts(const string &text, vector<Layout> &layouts) {
+    layouts.clear();
+    istringstream iss(text);
+    string item;
+    while (getline(iss, item, ',')) {
+        Layout layout;
+        if (sscanf(item.c_str(), "%dx%dx%d", &layout.floors, &layout.rows, &layout.cols) != 3 ||
+            layout.floors <= 0 || layout.rows <= 0 || layout.cols <= 0) {
+            return false;
+        }
+        layouts.push_back(layout);
+    }
+    return !layouts.empty();
+}
+
+// 生成基准数据文件
+// 从今天起的 NUM_DAYS 天中每四个座位预约一个，第 k 个被预约的座位属于用户 u<k>
+// （每个用户每天一个座位），其余空闲；用户 Z 留给 reserveSeat 基准使用
+void writeFixture(const Layout &layout) {
+    FLOORS = layout.floors;
+    ROWS = layout.rows;
+    COLS = layout.cols;
+    initializeLibrary();
+    vector<UserId> users;
+    long seatsPerDay = (long)layout.floors * layout.rows * layout.cols;
+    for (long k = 0; k * 4 < seatsPerDay; k++) {
+        users.push_back(internUser("u" + to_string(k)));
+    }
+    for (int d = 0; d < NUM_DAYS; d++) {
+        for (long index = 0; index < seatsPerDay; index += 4) {
+            int c = (int)(index % layout.cols);
+            int r = (int)(index / layout.cols % layout.rows);
+            int f = (int)(index / layout.cols / layout.rows);
+            setSeat(today + d, f, r, c, RESERVED, users[index / 4]);
+        }
+    }
+    saveData();
+}
+
+// 生成座位属性文件：每层第一列和最后一列靠窗，第一行有电源，最高一层是安静区
+void writeAttributes(const Layout &layout) {
+    ofstream file(SEAT_ATTRIBUTES_FILE);
+    file << "* * 1 window\n* * " << layout.cols << " window\n* 1 * power\n" << layout.floors << " * * quiet\n";
+    file.close();
+    loadSeatAttributes();
+}
+
+// 反复执行 body 直到累计耗时达到 minTimeSeconds（至少一次），setup 不计入耗时
+BenchResult runBench(const string &name, const Layout &layout,
+                     const function<void()> &setup, const function<void()> &body) {
+    vector<double> samples;
+    double total = 0;
+    while (samples.empty() || total < minTimeSeconds * 1e9) {
+        setup();
+        auto start = chrono::steady_clock::now();
+        body();
+        auto end = chrono::steady_clock::now();
+        double ns = chrono::duration<double, nano>(end - start).count();
+        samples.push_back(ns);
+        total += ns;
+    }
+
+    BenchResult result;
+    result.function = name;
+    result.layout = layout;
+    result.iterations = (long)samples.size();
+    result.meanNs = total / samples.size();
+    sort(samples.begin(), samples.end());
+    result.medianNs = samples[samples.size() / 2];
+    result.minNs = samples.front();
+    result.maxNs = samples.back();
+    return result;
+}
+
+// 对一种布局运行全部基准测试
+void benchLayout(const Layout &layout, vector<BenchResult> &results) {
+    auto nothing = [] {};
+    auto reloadFixture = [&] {
+        writeFixture(layout);
+        loadData();
+    };
+    auto selected = [&](const string &name) {
+        return filterName.empty() || name.find(filterName) != string::npos;
+    };
+
+    writeAttributes(layout);
+    reloadFixture();
+    UserId viewer = internUser("u1");
+    UserId reserver = internUser("Z");
+    currentUser = viewer;
+    isAdmin = false;
+
+    if (selected("loadData")) {
+        results.push_back(runBench("loadData", layout, nothing, [] { loadData(); }));
+    }
+    if (selected("saveData")) {
+        results.push_back(runBench("saveData", layout, nothing, [] { saveData(); }));
+    }
+    if (selected("reserveSeat")) {
+        // 用户 Z 依次预约周一每四个座位中的第三个，每次预约都会取消上一次的预约
+        long seatsPerDay = (long)layout.floors * layout.rows * layout.cols;
+        long next = 2;
+        results.push_back(runBench("reserveSeat", layout, [&] { currentUser = reserver; }, [&] {
+            long index = next;
+            next = (next + 4 < seatsPerDay) ? next + 4 : 2;
+            int c = (int)(index % layout.cols);
+            int r = (int)(index / layout.cols % layout.rows);
+            int f = (int)(index / layout.cols / layout.rows);
+            reserveSeat("Monday", f + 1, r + 1, c + 1);
+        }));
+        currentUser = viewer;
+        reloadFixture();
+    }
+    if (selected("reserveBest")) {
+        // 用户 Z 按偏好在周一自动选座，每次都会取消上一次的预约并触发保存
+        vector<string> prefs = {"quiet", "window", "power"};
+        results.push_back(runBench("reserveBest", layout, [&] { currentUser = reserver; }, [&] {
+            reserveBest("Monday", 0, 0, prefs);
+        }));
+        currentUser = viewer;
+        reloadFixture();
+    }
+    if (selected("showSeats")) {
+        results.push_back(runBench("showSeats", layout, nothing, [] { showSeats("Monday", 1); }));
+    }
+    if (selected("showReservations")) {
+        results.push_back(runBench("showReservations", layout, nothing, [] { showReservations(); }));
+    }
+    if (selected("clearUserData")) {
+        UserId cleared = internUser("u2");
+        results.push_back(runBench("clearUserData", layout, reloadFixture, [&] { clearUserData(cleared); }));
+        reloadFixture();
+    }
+    if (selected("manageSeats")) {
+        results.push_back(runBench("manageSeats", layout, nothing, [&] {
+            manageSeats(layout.floors, layout.rows, layout.cols);
+        }));
+    }
+}
+
+// 以 JSON 格式输出结果
+void writeJson(FILE *out, const vector<BenchResult> &results) {
+    char date[32];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+    fprintf(out, "{\n  \"context\": {\"date\": \"%s\", \"executable\": \"seat_bench\", \"min_time_s\": %g},\n",
+            date, minTimeSeconds);
+    fprintf(out, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult &r = results[i];
+        string layout = layoutName(r.layout);
+        long seats = (long)NUM_DAYS * r.layout.floors * r.layout.rows * r.layout.cols;
+        fprintf(out, "    {\"name\": \"%s/%s\", \"function\": \"%s\", \"layout\": \"%s\", \"seats\": %ld, "
+                     "\"iterations\": %ld, \"mean_ns\": %.0f, \"median_ns\": %.0f, \"min_ns\": %.0f, \"max_ns\": %.0f}%s\n",
+                r.function.c_str(), layout.c_str(), r.function.c_str(), layout.c_str(), seats,
+                r.iterations, r.meanNs, r.medianNs, r.minNs, r.maxNs, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// 以 CSV 格式输出结果
+void writeCsv(FILE *out, const vector<BenchResult> &results) {
+    fprintf(out, "name,function,layout,seats,iterations,mean_ns,median_ns,min_ns,max_ns\n");
+    for (const BenchResult &r : results) {
+        string layout = layoutName(r.layout);
+        long seats = (long)NUM_DAYS * r.layout.floors * r.layout.rows * r.layout.cols;
+        fprintf(out, "%s/%s,%s,%s,%ld,%ld,%.0f,%.0f,%.0f,%.0f\n",
+                r.function.c_str(), layout.c_str(), r.function.c_str(), layout.c_str(), seats,
+                r.iterations, r.meanNs, r.medianNs, r.minNs, r.maxNs);
+    }
+}
+
+int main(int argc, char **argv) {
+    vector<Layout> layouts;
+    parseLayouts("5x4x4,10x10x10,20x20x20,50x50x50,100x100x100", layouts);
+
+    // 解析命令行参数
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--layouts" && hasValue) {
+            if (!parseLayouts(argv[++i], layouts)) {
+                fprintf(stderr, "Invalid layouts: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (arg == "--min-time" && hasValue) {
+            minTimeSeconds = atof(argv[++i]);
+        } else if (arg == "--filter" && hasValue) {
+            filterName = argv[++i];
+        } else if (arg == "--format" && hasValue) {
+            outputFormat = argv[++i];
+        } else if (arg == "--out" && hasValue) {
+            outputPath = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--layouts 5x4x4,...] [--min-time s] [--filter name] "
+                            "[--format json|csv] [--out file]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (outputFormat != "json" && outputFormat != "csv") {
+        fprintf(stderr, "Unknown format: %s\n", outputFormat.c_str());
+        return 1;
+    }
+
+    // 结果文件路径在切换工作目录前确定
+    FILE *out = stdout;
+    if (!outputPath.empty()) {
+        out = fopen(outputPath.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "Cannot open %s\n", outputPath.c_str());
+            return 1;
+        }
+    }
+
+    // 在临时目录中运行，避免覆盖真实的数据文件
+    char workDir[] = "/tmp/seat_bench.XXXXXX";
+    if (!mkdtemp(workDir) || chdir(workDir) != 0) {
+        fprintf(stderr, "Cannot create working directory.\n");
+        return 1;
+    }
+
+    // 被测函数的控制台输出写入 /dev/null，保留真实的写入与刷新开销
+    filebuf devNull;
+    devNull.open("/dev/null", ios::out);
+    streambuf *consoleBuf = cout.rdbuf(&devNull);
+
+    vector<BenchResult> results;
+    for (const Layout &layout : layouts) {
+        fprintf(stderr, "Running layout %s...\n", layoutName(layout).c_str());
+        benchLayout(layout, results);
+    }
+
+    cout.rdbuf(consoleBuf);
+    remove(DATA_FILE.c_str());
+    remove(USERS_FILE.c_str());
+    remove(CHANGES_FILE.c_str());
+    remove(ARCHIVE_FILE.c_str());
+    remove(SEAT_ATTRIBUTES_FILE.c_str());
+    if (chdir("/") == 0) {
+        rmdir(workDir);
+    }
+
+    if (outputFormat == "json") {
+        writeJson(out, results);
+    } else {
+        writeCsv(out, results);
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}
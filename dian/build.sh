@@ -0,0 +1,46 @@
+#!/bin/sh
+# Linux build script: compile with g++
+# Usage:
+#   ./build.sh
+# Executables are written to build/
+
+set -e
+cd "$(dirname "$0")"
+
+# Ensure g++ exists
+if ! command -v g++ >/dev/null 2>&1; then
+	echo 'g++ not found. Please install g++.' >&2
+	exit 1
+fi
+
+mkdir -p build
+
+# Build level2
+echo 'Building level2...'
+g++ -O2 -Wall -std=c++17 -pthread -o build/library_system level2/main.cpp
+
+# Build test1
+echo 'Building test1...'
+gcc -O2 -Wall -o build/test1 test1/main.c
+
+# Build test2 (the server mode needs -pthread)
+echo 'Building test2...'
+gcc -O2 -Wall -pthread -o build/test2 test2/main.c
+
+# Build benchmarks
+echo 'Building seat_bench...'
+g++ -O2 -Wall -std=c++17 -pthread -o build/seat_bench bench/seat_bench.cpp
+echo 'Building load_gen...'
+g++ -O2 -Wall -std=c++17 -pthread -o build/load_gen bench/load_gen.cpp
+echo 'Building kv_bench...'
+gcc -O2 -Wall -pthread -o build/kv_bench bench/kv_bench.c
+echo 'Building rule_bench...'
+gcc -O2 -Wall -o build/rule_bench bench/rule_bench.c
+
+# Build tests
+echo 'Building transaction_test...'
+g++ -O2 -Wall -std=c++17 -pthread -o build/transaction_test tests/transaction_test.cpp
+echo 'Building reserve_best_test...'
+g++ -O2 -Wall -std=c++17 -pthread -o build/reserve_best_test tests/reserve_best_test.cpp
+
+echo 'Build completed. Executables: build/library_system, build/test1, build/test2, build/seat_bench, build/load_gen, build/kv_bench, build/rule_bench, build/transaction_test, build/reserve_best_test'
@@ -3,17 +3,87 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
+#include <unordered_map>
+#include <memory>
 #include <algorithm>
+#include <array>
+#include <charconv>
 #include <cctype>
 #include <limits>
+#include <type_traits>
+#include <utility>
 #include <sstream>
+#include <chrono>
+#include <cstdint>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 using namespace std;
 
-// 定义日期常量数组
+// 位运算：MSVC 没有 __builtin_ctzll 等内建函数，改用 _BitScanForward64/_BitScanReverse64 和分组累加的位计数
+// 非零字中最低置位的位序号
+inline int lowestBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// 非零字中最高置位的位序号
+inline int highestBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, word);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(word);
+#endif
+}
+
+// 字中置位的位数
+inline int popCount(uint64_t word) {
+#ifdef _MSC_VER
+    word -= (word >> 1) & 0x5555555555555555ull;
+    word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+    word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (int)((word * 0x0101010101010101ull) >> 56);
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+// 定义星期名称数组（下标0为星期一）
 const string DAYS[] = {"Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday", "Sunday"};
 const int NUM_DAYS = 7;     // 一周天数
 
+// 可预约的日期范围：从今天起的 HORIZON_DAYS 天（约一个学期）
+// 日期统一用"日期编号"表示，即自1970-01-01起的天数
+const int HORIZON_DAYS = 183;
+
 // 可变的楼层和座位数，以便管理员可以增加或删除座位
 int FLOORS = 5;       // 楼层数（可由管理员调整）
 int ROWS = 4;         // 每层的行数（可由管理员调整）
@@ -24,21 +94,255 @@ const char EMPTY = '0';       // 空闲状态
 const char RESERVED = '1';    // 已预约状态
 const char CURRENT_USER = '2'; // 当前用户预约状态
 const char UNAVAILABLE = 'X'; // 不可预约状态
+const char PARTIAL = 'P';     // 部分时段已被预约
+
+// 时段：每天 8:00 到 22:00 按小时划分为 14 个时段，时段集合用位掩码表示（第 i 位为 8+i 点开始的时段）
+const int SLOT_START_HOUR = 8;
+const int NUM_SLOTS = 14;
+typedef uint16_t SlotMask;
+const SlotMask ALL_SLOTS = (1u << NUM_SLOTS) - 1;
 
-// 定义数据文件路径
-const string DATA_FILE = "library_data.txt";
+// 签到：预约开始后（预约时已经开始的从预约时起）超过该分钟数仍未签到，预约自动释放
+const int CHECKIN_GRACE_MINUTES = 30;
+const int CHECKED_IN = -1;    // 签到截止时间为该值表示已签到
 
-// 座位数据结构
+// 定义数据文件路径（分片模式下每个分片进程改用自己的文件）
+string DATA_FILE = "library_data.txt";
+// 历史归档文件：已经过去或被清空的日期的预约记录按列压缩后追加到这里
+string ARCHIVE_FILE = "library_archive.dat";
+// 用户名表文件：每行一个用户名，行号即用户编号；只追加不修改，因此编号永久有效
+const string USERS_FILE = "library_users.txt";
+
+// 用户编号：用户名在用户名表中的行号，0 表示没有用户
+typedef uint32_t UserId;
+const UserId NO_USER = 0;
+const UserId MAX_USER = (1u << 24) - 1;   // 座位记录中用户编号占24位
+const size_t MAX_USERNAME_LENGTH = 32;     // 用户名最大长度
+
+// 座位数据结构（4字节）
 struct Seat {
-    char status;       // 座位状态（空闲、已预约、当前用户预约、不可预约）
-    char user;         // 预约用户标识（单个字母）
+    uint32_t status : 8;   // 座位状态（空闲、已预约、当前用户预约、不可预约）
+    uint32_t user : 24;    // 预约用户编号
+};
+
+// 某个座位上的一条按时段预约
+struct SlotBooking {
+    UserId user;          // 预约用户编号
+    SlotMask slots;       // 预约的时段
+};
+
+// ===================== 内存统计 =====================
+// 座位存储的各个容器都使用 CountingAllocator 分配内存，按所属部分累计当前占用的字节数和块数，
+// 管理员用 Memory 命令查看，--memory-budget 据此限制常驻内存（见"内存预算"）。
+// 统计的是实际向堆申请的大小（glibc 下为 malloc_usable_size 加上块头），
+// 因此容器的头部、哈希表的桶数组和节点、vector 预留的容量、分配器的对齐补齐都计算在内。
+
+// 内存占用的组成部分
+enum MemoryComponent {
+    MEM_SEATS, MEM_SLOTS, MEM_DAYS, MEM_CACHES, MEM_JOURNAL, MEM_TIMERS, MEM_USERS, MEM_SNAPSHOT, MEM_ATTRIBUTES,
+    MEM_COUNT
+};
+const char *MEMORY_NAMES[MEM_COUNT] = {
+    "seats", "slot bitmaps", "day indexes", "render caches", "journal buffers", "timers", "users", "snapshot index",
+    "seat attributes"
+};
+uint64_t memoryBytes[MEM_COUNT];    // 各部分当前占用的字节数（含分配器开销）
+uint64_t memoryBlocks[MEM_COUNT];   // 各部分当前分配的块数
+uint64_t memoryPeak = 0;            // 各部分合计的峰值
+uint64_t memoryBudget = 0;          // 内存预算（字节，0 表示不限制），启动参数 --memory-budget
+uint64_t daysEvicted = 0;           // 因超出内存预算被卸载回快照文件的日期数
+
+// 分配 size 字节并计入 component
+void *countedAllocate(int component, size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+#ifdef __GLIBC__
+    size = malloc_usable_size(p) + sizeof(size_t);
+#endif
+    memoryBytes[component] += size;
+    memoryBlocks[component]++;
+    uint64_t total = 0;
+    for (uint64_t bytes : memoryBytes) total += bytes;
+    memoryPeak = max(memoryPeak, total);
+    return p;
+}
+
+// 释放 countedAllocate 分配的 size 字节
+void countedFree(int component, void *p, size_t size) {
+    if (!p) return;
+#ifdef __GLIBC__
+    size = malloc_usable_size(p) + sizeof(size_t);
+#endif
+    memoryBytes[component] -= size;
+    memoryBlocks[component]--;
+    free(p);
+}
+
+// 计数分配器：标准容器通过它分配内存，占用计入 Component
+template <class T, int Component>
+struct CountingAllocator {
+    typedef T value_type;
+    template <class U>
+    struct rebind {
+        typedef CountingAllocator<U, Component> other;
+    };
+
+    CountingAllocator() = default;
+    template <class U>
+    CountingAllocator(const CountingAllocator<U, Component> &) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(countedAllocate(Component, n * sizeof(T)));
+    }
+    void deallocate(T *p, size_t n) {
+        countedFree(Component, p, n * sizeof(T));
+    }
+};
+template <class T, class U, int Component>
+bool operator==(const CountingAllocator<T, Component> &, const CountingAllocator<U, Component> &) {
+    return true;
+}
+template <class T, class U, int Component>
+bool operator!=(const CountingAllocator<T, Component> &, const CountingAllocator<U, Component> &) {
+    return false;
+}
+
+// 计入指定部分的容器
+template <class T, int Component>
+using CountedVector = vector<T, CountingAllocator<T, Component>>;
+template <class T, int Component>
+using CountedDeque = deque<T, CountingAllocator<T, Component>>;
+template <class K, class V, int Component>
+using CountedMap = unordered_map<K, V, hash<K>, equal_to<K>, CountingAllocator<pair<const K, V>, Component>>;
+
+typedef CountedVector<Seat, MEM_SEATS> SeatList;             // 一层的座位
+typedef CountedVector<SlotBooking, MEM_SLOTS> BookingList;   // 一个座位上的按时段预约
+
+// 渲染好的整层座位图（不含当前用户自己的座位，显示时再替换）
+struct RenderedView {
+    string text;                 // 座位图文本（含换行），为空表示尚未渲染或已失效
+    CountedVector<uint32_t, MEM_CACHES> rowStarts;  // 各行在 text 中的起始位置（共 ROWS+1 项），紧凑模式下用于重新渲染单独一行
+    int rows = 0;                // 渲染时的行数、列数和显示方式，与当前不同时视为失效
+    int cols = 0;
+    bool compact = false;
+};
+
+// 某一天某一层的座位数据
+// 只有当该层存在预约或不可预约的座位时才会分配
+struct FloorData {
+    SeatList seats;       // ROWS×COLS 个座位，按行优先存放
+    int used = 0;         // 非空闲座位数，为0时保存数据时会释放该层
+    // 每个时段一张空闲位图（共 NUM_SLOTS 张，依次存放），位为1表示该座位在该时段空闲；
+    // 每行按64位字对齐，查询某个时间段的空闲座位只需把对应时段的位图按字相与
+    CountedVector<uint64_t, MEM_SLOTS> slotFree;
+    // 状态为 PARTIAL 的座位上的按时段预约（键为座位在本层内的下标）
+    CountedMap<uint32_t, BookingList, MEM_SLOTS> slotBookings;
+    // 座位图缓存：普通用户视角和管理员视角，座位被修改时失效
+    RenderedView userView;
+    RenderedView adminView;
+
+    static void *operator new(size_t size) { return countedAllocate(MEM_SEATS, size); }
+    static void operator delete(void *p, size_t size) { countedFree(MEM_SEATS, p, size); }
+};
+
+// 候补队列中的一项
+struct WaitEntry {
+    UserId user;          // 候补用户编号
+    uint64_t seq;         // 加入候补的序号，越小越早
+};
+typedef CountedDeque<WaitEntry, MEM_DAYS> WaitQueue;
+
+// 用户当前有效的候补：序号与楼层（0 表示任意楼层）
+struct WaitInfo {
+    uint64_t seq;
+    int floor;
+};
+
+// 某一天的座位数据
+struct DayData {
+    int date;                              // 日期编号
+    CountedVector<unique_ptr<FloorData>, MEM_DAYS> floors;  // 各楼层数据，未分配的楼层视为全部空闲
+    CountedMap<UserId, uint32_t, MEM_DAYS> userSeat;  // 用户当天预约的座位（楼层×行×列的扁平下标）
+    CountedMap<UserId, uint32_t, MEM_DAYS> userSlot;  // 用户当天按时段预约的座位（同上）
+    // 候补队列：下标0为任意楼层，下标 i 为第 i 层；用户重新候补或被移除后，
+    // 队列中原来的项以 waiting 为准视为失效，出队时跳过
+    CountedVector<WaitQueue, MEM_DAYS> waitlists;
+    CountedMap<UserId, WaitInfo, MEM_DAYS> waiting;   // 当天有效的候补
+    uint64_t nextWaitSeq = 1;
+    // 有预约的用户的签到截止时间（当天0点起的分钟数，CHECKED_IN 表示已签到），没有记录的预约不会被释放
+    CountedMap<UserId, int, MEM_DAYS> checkInDeadlines;
+
+    static void *operator new(size_t size) { return countedAllocate(MEM_DAYS, size); }
+    static void operator delete(void *p, size_t size) { countedFree(MEM_DAYS, p, size); }
 };
 
 // 全局变量
-vector<vector<vector<vector<Seat>>>> library;  // 四维向量：[天数][楼层][行][列] 存储座位信息
-char currentUser = ' ';       // 当前登录用户（单个字母，管理员为'A'）
+// 日历：长度为 HORIZON_DAYS 的环形数组，日期 d 存放在下标 d % HORIZON_DAYS 处，
+// 只有存在预约的日期才会分配，按日期查找为 O(1)
+CountedVector<unique_ptr<DayData>, MEM_DAYS> calendar(HORIZON_DAYS);
+// 数据文件中尚未加载的日期：与日历相同的环形数组，记录该日期的数据段在快照文件中的字节范围，
+// 第一次访问该日期时才读取并解析（见"按需加载"）
+struct ColdDay {
+    int date = -1;            // 日期编号，-1 表示该位置没有未加载的日期
+    uint64_t offset = 0;      // 数据段在快照文件中的起始位置
+    uint32_t length = 0;      // 数据段的字节数
+};
+CountedVector<ColdDay, MEM_SNAPSHOT> coldDays(HORIZON_DAYS);
+int coldDayCount = 0;         // 尚未加载的日期数
+// 快照文件中全部日期数据段的位置（按日期排序，含已加载的日期），超出内存预算时据此把已加载的日期卸载回快照文件
+CountedVector<ColdDay, MEM_SNAPSHOT> snapshotIndex;
+#ifdef _WIN32
+string snapshotData;          // 快照文件的全部内容（Windows 下打开的文件会阻止其他进程替换数据文件，因此读入内存）
+#else
+ifstream snapshotFile;        // 加载时打开的快照文件，数据文件被其他进程替换后仍能读到加载时的版本
+#endif
+int today = 0;                // 今天的日期编号（可预约的第一天）
+long long clockOffset = 0;    // 时钟偏移（秒），用于启动参数 --now 模拟其他日期
+UserId currentUser = NO_USER; // 当前登录用户（管理员登录时为 NO_USER）
+// 本次命令中变为空闲、且当天有人候补的座位（日期编号，楼层×行×列的扁平下标），保存数据前依次分配给候补用户
+CountedVector<pair<int, uint32_t>, MEM_JOURNAL> freedSeats;
+// 分片模式：本进程负责的分片（0-based，-1 表示未分片），以及本次命令中获得座位的用户（日期编号，用户编号），
+// 路由进程据此取消这些用户当天在其他分片上的预约
+int shardIndex = -1;
+CountedVector<pair<int, UserId>, MEM_JOURNAL> acquiredSeats;
 bool isAdmin = false;         // 是否为管理员用户
 
+// 用户名表：用户编号到用户名（下标0保留），以及用户名到编号的哈希索引
+CountedVector<string, MEM_USERS> userNames(1);
+CountedMap<string, UserId, MEM_USERS> userIds;
+streamoff usersFileOffset = 0;   // 用户名表文件已读取到的位置，之后只增量读取新增的用户
+
+// 输出缓冲区
+// 座位图和预约列表先整体写入该缓冲区，再一次性输出，避免逐字符输出和逐行刷新；
+// 缓冲区在命令之间复用，不会反复分配内存
+string outputBuffer;
+bool compactGrid = false;     // 是否以行程编码（如 0*12 1 X*4）紧凑显示座位图，适合很宽的楼层
+RenderedView emptyFloorView;  // 未分配楼层（全部空闲）的座位图缓存
+
+// 把输出缓冲区的内容一次性写出并清空
+void flushOutput() {
+    cout.write(outputBuffer.data(), (streamsize)outputBuffer.size());
+    cout.flush();
+    outputBuffer.clear();
+}
+
+// 当前命令是否失败（输出过错误信息），事务提交时据此判断能否提交
+bool commandFailed = false;
+
+// 输出错误信息并把当前命令标记为失败
+void reportError(const string &message) {
+    cout << message << endl;
+    commandFailed = true;
+}
+
+// 事务：Begin 之后的命令只修改内存中的数据，不重新加载也不写文件，
+// Commit 时检查后一次性写入，Rollback 时丢弃修改重新加载
+bool inTransaction = false;
+int transactionErrors = 0;        // 事务中失败的命令数
+uint64_t dataVersion = 0;         // 数据文件的版本号，每次写入加1
+uint64_t transactionBaseVersion = 0;  // Begin 时数据文件的版本号，用于检测其他会话的并发修改
+string dataStamp;                 // 最近一次加载或写入的数据文件的版本行，为空表示需要重新加载
+
 // 座位配置结构体
 // 用于保存和管理图书馆座位的整体配置
 struct SeatConfig {
@@ -47,300 +351,3550 @@ struct SeatConfig {
     int cols;          // 每层列数
 } seatConfig = {FLOORS, ROWS, COLS};
 
-// 初始化座位库
-// 根据当前配置调整座位库大小并设置所有座位为初始状态
-void initializeLibrary() {
-    // 重新调整library的四维向量大小
-    library.resize(NUM_DAYS);
-    for (int d = 0; d < NUM_DAYS; d++) {
-        library[d].resize(FLOORS);
-        for (int f = 0; f < FLOORS; f++) {
-            library[d][f].resize(ROWS);
-            for (int r = 0; r < ROWS; r++) {
-                library[d][f][r].resize(COLS);
-                for (int c = 0; c < COLS; c++) {
-                    library[d][f][r][c].status = EMPTY;  // 设置为空闲状态
-                    library[d][f][r][c].user = ' ';      // 清空用户标识
-                }
-            }
+// ===================== 性能统计 =====================
+// 可选的运行时统计：按命令类型统计次数与延迟分布，并拆分出各阶段耗时
+// （解析、加载、执行、保存）以及文件读写字节数和打开次数。
+// 默认关闭，关闭时每个统计点只有一次布尔判断。
+
+// 命令类型
+enum CommandKind {
+    KIND_LOGIN, KIND_EXIT, KIND_SHOW, KIND_RESERVE, KIND_RESERVATION, KIND_CLEAR, KIND_CLEAR_USER,
+    KIND_ADMIN_RESERVE, KIND_ADMIN_CANCEL, KIND_MANAGE_SEATS, KIND_CLEAR_DAY, KIND_CLEAR_FLOOR,
+    KIND_SET_UNAVAILABLE, KIND_SET_AVAILABLE, KIND_METRICS, KIND_FREE, KIND_RESERVE_GROUP, KIND_WAITLIST, KIND_TRANSACTION, KIND_CHANGES, KIND_CHECK_IN, KIND_ANALYTICS, KIND_EXPORT, KIND_MEMORY, KIND_RESERVE_BEST, KIND_OTHER, KIND_COUNT
+};
+const char *KIND_NAMES[KIND_COUNT] = {
+    "Login", "Exit", "Show", "Reserve", "Reservation", "Clear", "ClearUser",
+    "AdminReserve", "AdminCancel", "ManageSeats", "ClearDay", "ClearFloor",
+    "SetUnavailable", "SetAvailable", "Metrics", "Free", "ReserveGroup", "Waitlist", "Transaction", "Changes", "CheckIn", "Analytics", "Export", "Memory", "ReserveBest", "Other"
+};
+
+// 命令执行阶段（各阶段耗时互不重叠）
+enum Phase { PHASE_PARSE, PHASE_LOAD, PHASE_EXECUTE, PHASE_SAVE, PHASE_COUNT };
+const char *PHASE_NAMES[PHASE_COUNT] = {"parse", "load", "execute", "save"};
+
+// 延迟直方图：按2的幂分段，每段再均分为8个子桶，相对误差不超过12.5%
+const int HIST_SUB_BUCKETS = 8;
+const int HIST_BUCKETS = 64 * HIST_SUB_BUCKETS;
+
+// 单个命令类型的统计数据
+struct CommandStats {
+    uint64_t count = 0;                 // 执行次数
+    uint64_t totalNs = 0;               // 总耗时
+    uint64_t maxNs = 0;                 // 最大耗时
+    uint64_t phaseNs[PHASE_COUNT] = {}; // 各阶段累计耗时
+    uint64_t histogram[HIST_BUCKETS] = {};
+};
+
+bool metricsEnabled = false;            // 是否开启统计（启动参数 --metrics）
+string metricsDumpFile;                 // 退出时写入统计结果的文件（--metrics=文件名）
+CommandStats commandStats[KIND_COUNT];  // 各命令类型的统计
+uint64_t bytesRead = 0;                 // 从数据文件读取的字节数
+uint64_t bytesWritten = 0;              // 写入数据文件的字节数
+uint64_t fileOpensRead = 0;             // 以读方式打开数据文件的次数
+uint64_t fileOpensWrite = 0;            // 以写方式打开数据文件的次数
+uint64_t daysLoaded = 0;                // 按需加载的日期数
+
+// 当前命令的阶段计时状态
+int currentPhase = PHASE_PARSE;
+chrono::steady_clock::time_point phaseStart;
+uint64_t phaseNs[PHASE_COUNT];
+
+// 切换到新的阶段，把上一阶段的耗时计入累计值
+// 返回: 切换前的阶段，便于嵌套调用结束时恢复
+int switchPhase(int phase) {
+    auto now = chrono::steady_clock::now();
+    phaseNs[currentPhase] += chrono::duration_cast<chrono::nanoseconds>(now - phaseStart).count();
+    phaseStart = now;
+    int previous = currentPhase;
+    currentPhase = phase;
+    return previous;
+}
+
+// 阶段计时作用域：构造时进入指定阶段，析构时回到原阶段
+struct PhaseScope {
+    int previous;
+    explicit PhaseScope(int phase) : previous(-1) {
+        if (metricsEnabled) previous = switchPhase(phase);
+    }
+    ~PhaseScope() {
+        if (previous >= 0) switchPhase(previous);
+    }
+};
+
+// 计算耗时对应的直方图桶
+int histogramBucket(uint64_t ns) {
+    if (ns < HIST_SUB_BUCKETS) return (int)ns;
+    int exp = highestBit(ns);
+    int sub = (int)((ns >> (exp - 3)) & (HIST_SUB_BUCKETS - 1));
+    return (exp - 2) * HIST_SUB_BUCKETS + sub;
+}
+
+// 直方图桶的上界（纳秒）
+uint64_t histogramBucketLimit(int bucket) {
+    if (bucket < HIST_SUB_BUCKETS) return (uint64_t)bucket;
+    int exp = bucket / HIST_SUB_BUCKETS + 2;
+    uint64_t sub = (uint64_t)(bucket % HIST_SUB_BUCKETS);
+    return ((HIST_SUB_BUCKETS + sub + 1) << (exp - 3)) - 1;
+}
+
+// 从直方图估计百分位延迟
+uint64_t histogramPercentile(const CommandStats &stats, double p) {
+    if (stats.count == 0) return 0;
+    uint64_t rank = (uint64_t)(p * (stats.count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += stats.histogram[b];
+        if (seen >= rank) return min(histogramBucketLimit(b), stats.maxNs);
+    }
+    return stats.maxNs;
+}
+
+// 开始统计一条命令
+void beginCommandMetrics() {
+    for (int p = 0; p < PHASE_COUNT; p++) phaseNs[p] = 0;
+    currentPhase = PHASE_PARSE;
+    phaseStart = chrono::steady_clock::now();
+}
+
+// 结束一条命令的统计并计入对应命令类型
+void endCommandMetrics(int kind) {
+    switchPhase(PHASE_PARSE);
+    CommandStats &stats = commandStats[kind];
+    uint64_t total = 0;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        stats.phaseNs[p] += phaseNs[p];
+        total += phaseNs[p];
+    }
+    stats.count++;
+    stats.totalNs += total;
+    stats.maxNs = max(stats.maxNs, total);
+    stats.histogram[histogramBucket(total)]++;
+}
+
+// 以文本表格输出统计结果
+void writeMetricsText(ostream &out) {
+    out << "Data file: opened " << fileOpensRead << " times for reading (" << bytesRead << " bytes), "
+        << fileOpensWrite << " times for writing (" << bytesWritten << " bytes), "
+        << daysLoaded << " days loaded on demand" << endl;
+    out << "command          count     p50_us     p99_us    p999_us     max_us   parse%  load%  exec%  save%" << endl;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        const CommandStats &stats = commandStats[k];
+        if (stats.count == 0) continue;
+        char line[160];
+        double total = stats.totalNs ? (double)stats.totalNs : 1.0;
+        snprintf(line, sizeof(line), "%-14s %7llu %10.1f %10.1f %10.1f %10.1f %7.1f %6.1f %6.1f %6.1f",
+                 KIND_NAMES[k], (unsigned long long)stats.count,
+                 histogramPercentile(stats, 0.5) / 1e3, histogramPercentile(stats, 0.99) / 1e3,
+                 histogramPercentile(stats, 0.999) / 1e3, stats.maxNs / 1e3,
+                 100.0 * stats.phaseNs[PHASE_PARSE] / total, 100.0 * stats.phaseNs[PHASE_LOAD] / total,
+                 100.0 * stats.phaseNs[PHASE_EXECUTE] / total, 100.0 * stats.phaseNs[PHASE_SAVE] / total);
+        out << line << endl;
+    }
+}
+
+uint64_t memoryInUse();
+
+// 以 JSON 格式输出统计结果（退出时写入文件）
+void writeMetricsJson(ostream &out) {
+    out << "{\n  \"io\": {\"bytes_read\": " << bytesRead << ", \"bytes_written\": " << bytesWritten
+        << ", \"file_opens_read\": " << fileOpensRead << ", \"file_opens_write\": " << fileOpensWrite
+        << ", \"days_loaded\": " << daysLoaded << "},\n";
+    out << "  \"memory\": {\"bytes\": " << memoryInUse() << ", \"peak_bytes\": " << memoryPeak
+        << ", \"budget_bytes\": " << memoryBudget << ", \"days_evicted\": " << daysEvicted << "},\n";
+    out << "  \"commands\": [";
+    bool first = true;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        const CommandStats &stats = commandStats[k];
+        if (stats.count == 0) continue;
+        out << (first ? "\n" : ",\n") << "    {\"command\": \"" << KIND_NAMES[k] << "\", \"count\": " << stats.count
+            << ", \"total_ns\": " << stats.totalNs << ", \"max_ns\": " << stats.maxNs
+            << ", \"p50_ns\": " << histogramPercentile(stats, 0.5)
+            << ", \"p99_ns\": " << histogramPercentile(stats, 0.99)
+            << ", \"p999_ns\": " << histogramPercentile(stats, 0.999);
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            out << ", \"" << PHASE_NAMES[p] << "_ns\": " << stats.phaseNs[p];
         }
+        out << ", \"histogram\": [";
+        bool firstBucket = true;
+        for (int b = 0; b < HIST_BUCKETS; b++) {
+            if (stats.histogram[b] == 0) continue;
+            out << (firstBucket ? "" : ", ") << "[" << histogramBucketLimit(b) << ", " << stats.histogram[b] << "]";
+            firstBucket = false;
+        }
+        out << "]}";
+        first = false;
     }
-    // 更新座位配置结构体
-    seatConfig.floors = FLOORS;
-    seatConfig.rows = ROWS;
-    seatConfig.cols = COLS;
+    out << "\n  ]\n}\n";
 }
 
-// 保存数据到文件
-// 将座位配置信息和所有座位数据写入到指定的数据文件中
-void saveData() {
-    // 打开文件用于写入
-    ofstream file(DATA_FILE);
-    if (!file.is_open()) {
-        cout << "ERROR: Failed to save data." << endl;
+// 清零全部统计
+void resetMetrics() {
+    for (int k = 0; k < KIND_COUNT; k++) commandStats[k] = CommandStats();
+    bytesRead = bytesWritten = fileOpensRead = fileOpensWrite = daysLoaded = 0;
+}
+
+// 把统计结果写入启动参数指定的文件
+void dumpMetrics() {
+    if (!metricsEnabled || metricsDumpFile.empty()) return;
+    ofstream out(metricsDumpFile);
+    if (!out.is_open()) {
+        reportError("ERROR: Failed to write metrics.");
         return;
     }
+    writeMetricsJson(out);
+}
+
+// 根据命令字符串判断命令类型（与 executeCommand 的解析规则一致）
+int classifyCommand(const string &command) {
+    if (command == "Login") return KIND_LOGIN;
+    if (command == "Exit") return KIND_EXIT;
+    if (command == "Reservation") return KIND_RESERVATION;
+    if (command == "CheckIn") return KIND_CHECK_IN;
+    if (command == "Clear") return KIND_CLEAR;
+    if (command == "Begin" || command == "Commit" || command == "Rollback") return KIND_TRANSACTION;
+    if (command.compare(0, 7, "Metrics") == 0) return KIND_METRICS;
+    if (command == "Memory") return KIND_MEMORY;
+    if (command.compare(0, 9, "Analytics") == 0) return KIND_ANALYTICS;
+    if (command.compare(0, 6, "Export") == 0) return KIND_EXPORT;
+    if (command.compare(0, 7, "Changes") == 0 || command.compare(0, 7, "Version") == 0) return KIND_CHANGES;
+    if (command.compare(0, 12, "AdminReserve") == 0) return KIND_ADMIN_RESERVE;
+    if (command.compare(0, 11, "AdminCancel") == 0) return KIND_ADMIN_CANCEL;
+    if (command.compare(0, 11, "ManageSeats") == 0) return KIND_MANAGE_SEATS;
+    if (command.compare(0, 8, "ClearDay") == 0) return KIND_CLEAR_DAY;
+    if (command.compare(0, 10, "ClearFloor") == 0) return KIND_CLEAR_FLOOR;
+    if (command.compare(0, 6, "Clear ") == 0) return KIND_CLEAR_USER;
+    if (command.compare(0, 14, "SetUnavailable") == 0) return KIND_SET_UNAVAILABLE;
+    if (command.compare(0, 12, "SetAvailable") == 0) return KIND_SET_AVAILABLE;
+    if (command.compare(0, 12, "ReserveGroup") == 0) return KIND_RESERVE_GROUP;
+    if (command.compare(0, 11, "ReserveBest") == 0) return KIND_RESERVE_BEST;
+    if (command.compare(0, 7, "Reserve") == 0) return KIND_RESERVE;
+    if (command.compare(0, 5, "Free ") == 0) return KIND_FREE;
+    if (command.compare(0, 9, "Waitlist ") == 0) return KIND_WAITLIST;
+    if (command.find("Floor") != string::npos) return KIND_SHOW;
+    return KIND_OTHER;
+}
 
-    // 首先保存座位配置信息（楼层数、行数、列数）
-    file << FLOORS << " " << ROWS << " " << COLS << endl;
+// ===================== 日期处理 =====================
 
-    // 然后保存所有座位的数据
-    for (int d = 0; d < NUM_DAYS; d++) {
-        for (int f = 0; f < FLOORS; f++) {
-            for (int r = 0; r < ROWS; r++) {
-                for (int c = 0; c < COLS; c++) {
-                    // 每行写入一个座位的状态和用户标识
-                    file << library[d][f][r][c].status << library[d][f][r][c].user << endl;
-                }
+// 星期名称到下标的映射，用于 O(1) 解析星期名称
+const unordered_map<string, int> WEEKDAY_INDEX = {
+    {"Monday", 0}, {"Tuesday", 1}, {"Wednesday", 2}, {"Thursday", 3},
+    {"Friday", 4}, {"Saturday", 5}, {"Sunday", 6}
+};
+
+// 由公历年月日计算日期编号（自1970-01-01起的天数）
+int daysFromCivil(int year, int month, int day) {
+    year -= month <= 2;
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+// 由日期编号计算公历年月日
+void civilFromDays(int date, int &year, int &month, int &day) {
+    date += 719468;
+    int era = (date >= 0 ? date : date - 146096) / 146097;
+    int dayOfEra = date - era * 146097;
+    int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    int mp = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = yearOfEra + era * 400 + (month <= 2);
+}
+
+// 计算日期是星期几
+// 返回: 0为星期一，6为星期日（1970-01-01是星期四）
+int weekdayOf(int date) {
+    return ((date + 3) % NUM_DAYS + NUM_DAYS) % NUM_DAYS;
+}
+
+// 把日期编号格式化为 YYYY-MM-DD
+string formatDate(int date) {
+    int year, month, day;
+    civilFromDays(date, year, month, day);
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d", year, month, day);
+    return buffer;
+}
+
+// 解析 YYYY-MM-DD 格式的日期
+// 返回: 日期编号，格式错误或日期不存在时返回-1
+int parseIsoDate(const string &text) {
+    int year, month, day;
+    char extra;
+    if (sscanf(text.c_str(), "%d-%d-%d%c", &year, &month, &day, &extra) != 3) {
+        return -1;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31) {
+        return -1;
+    }
+    // 通过反向换算排除 2月30日 之类不存在的日期
+    int date = daysFromCivil(year, month, day);
+    int y, m, d;
+    civilFromDays(date, y, m, d);
+    return (y == year && m == month && d == day) ? date : -1;
+}
+
+// 当前时间（包含 --now 设置的偏移）
+time_t currentTime() {
+    return time(nullptr) + clockOffset;
+}
+
+// 今天的日期编号（按本地时区）
+int currentDate() {
+    time_t now = currentTime();
+    tm local = *localtime(&now);
+    return daysFromCivil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday);
+}
+
+// 获取当前时间（分钟），即 日期编号×1440 + 当天0点起的分钟数（本地时间）
+int currentMinute() {
+    time_t now = currentTime();
+    tm local = *localtime(&now);
+    return daysFromCivil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday) * 1440 + local.tm_hour * 60 +
+           local.tm_min;
+}
+
+// ===================== 用户名表 =====================
+
+// 增量读取用户名表文件中新增的用户名
+// 用户名表只追加，程序启动时完整读取一次，之后只读取其他进程新追加的部分
+void loadUsers() {
+    ifstream file(USERS_FILE);
+    if (!file.is_open()) return;
+    file.seekg(usersFileOffset);
+    string name;
+    while (getline(file, name)) {
+        if (file.eof()) break;   // 最后一行尚未写完整，下次再读
+        usersFileOffset = file.tellg();
+        userNames.push_back(name);
+        // 同名用户重复追加时以第一次出现的编号为准
+        userIds.emplace(name, (UserId)(userNames.size() - 1));
+    }
+}
+
+// 按用户名查找用户编号（哈希查找）
+// 返回: 用户编号，用户不存在时返回 NO_USER
+UserId findUser(const string &name) {
+    auto it = userIds.find(name);
+    return it == userIds.end() ? NO_USER : it->second;
+}
+
+// 获取用户编号，用户不存在时追加到用户名表
+// 返回: 用户编号，用户名表已满或无法写入时返回 NO_USER
+UserId internUser(const string &name) {
+    UserId id = findUser(name);
+    if (id != NO_USER) return id;
+    // 先读入其他进程新增的用户，避免重复分配
+    loadUsers();
+    id = findUser(name);
+    if (id != NO_USER || userNames.size() > MAX_USER) return id;
+    ofstream file(USERS_FILE, ios::app);
+    if (!file.is_open()) return NO_USER;
+    file << name << '\n';
+    file.close();
+    loadUsers();
+    return findUser(name);
+}
+
+// 用户编号对应的用户名
+const string &userName(UserId id) {
+    static const string unknown = "?";
+    return id < userNames.size() ? userNames[id] : unknown;
+}
+
+// 规范化用户名：单个字母的用户名统一为大写（兼容原来的 A-Z 用户）
+string normalizeUsername(const string &name) {
+    if (name.length() == 1 && isalpha((unsigned char)name[0])) {
+        return string(1, (char)toupper((unsigned char)name[0]));
+    }
+    return name;
+}
+
+// ===================== 日志复制 =====================
+// 主进程（--replicate-to 目录）每次写入数据文件后，把本次修改过的座位、候补和新用户
+// 以"整座位映像"的形式追加到该目录的日志文件；备用进程（--follow 目录）持续读取并应用，
+// 内存中始终保持与主进程一致的数据，主进程退出后可以立即接管。
+// 日志格式（每个块以 V 开始、以 E 结束，备用进程只应用完整的块）：
+//   JOURNAL 代数                     （日志被压缩重写时代数加1，备用进程从头重放）
+//   V 版本号 今天日期
+//   U 用户编号 用户名                 （新用户）
+//   R 楼层数 行数 列数               （清空全部数据并设置布局，用于完整快照）
+//   D 日期                           （清空某一天）
+//   S 日期 楼层 行 列 状态 用户编号     （座位映像，PARTIAL 座位随后是其全部 B 记录）
+//   B 日期 楼层 行 列 用户编号 时间段
+//   Q 日期                           （清空某一天的候补，随后是按顺序的 W 记录）
+//   W 日期 楼层 用户编号
+//   C 日期 用户编号 截止时间          （签到状态，截止时间为当天0点起的分钟数，-1 表示已签到；省略时表示已失效）
+//   E
+const string JOURNAL_FILE = "library_journal.log";
+const string LEADER_PID_FILE = "leader.pid";
+const uint64_t JOURNAL_COMPACT_BYTES = 16 << 20;   // 日志超过该大小时重写为完整快照
+
+string replicationDir;                // 主进程：日志目录，为空表示不复制
+// 以下修改记录同时用于日志复制和变更记录（见"变更记录"）
+bool recordChanges = true;            // 是否记录修改（加载数据和备用进程应用日志时不是修改，不记录）
+CountedVector<pair<int, uint32_t>, MEM_JOURNAL> journalSeats;   // 自上次写入后修改过的座位（日期编号，扁平下标）
+CountedVector<int, MEM_JOURNAL> journalDays;              // 自上次写入后候补或座位有变化的日期
+CountedVector<int, MEM_JOURNAL> journalDroppedDays;       // 自上次写入后被整天清空的日期
+CountedVector<pair<int, UserId>, MEM_JOURNAL> journalCheckIns;  // 自上次写入后签到状态有变化的预约（日期编号，用户编号）
+bool journalSnapshot = false;         // 是否需要写入完整快照（布局变化、清空全部数据等）
+size_t journalUsers = 1;              // 已写入日志的用户数（含保留的0号）
+
+void appendJournal(bool fullSnapshot = false);
+void appendChanges();
+
+// 记录修改过的座位（0-based）
+void journalSeat(int date, int floor, int row, int col) {
+    if (recordChanges) {
+        journalSeats.push_back({date, (uint32_t)((floor * ROWS + row) * COLS + col)});
+    }
+}
+
+// 记录候补有变化的日期
+void journalDay(int date) {
+    if (recordChanges) {
+        journalDays.push_back(date);
+    }
+}
+
+// 记录签到状态有变化的预约
+void journalCheckIn(int date, UserId user) {
+    if (recordChanges) {
+        journalCheckIns.push_back({date, user});
+    }
+}
+
+// 丢弃尚未写入的日志记录（重新加载数据后调用，加载本身不是修改）
+void clearJournalPending() {
+    journalSeats.clear();
+    journalDays.clear();
+    journalDroppedDays.clear();
+    journalCheckIns.clear();
+    journalSnapshot = false;
+}
+
+// ===================== 定时器轮 =====================
+// 分层定时器轮：共4层，每层64格，第 l 层每格跨 64^l 分钟，可容纳约31年内到期的定时器。
+// 加入定时器为 O(1)；时间推进时低层每转完一圈，就把高层对应格子中的定时器下放到低层，
+// 每个定时器最多下放3次，因此到期处理的均摊代价也是 O(1)。定时器不单独删除，到期时再检查是否仍然有效；
+// 只有卸载日期时才整体删除该日期的定时器，重新加载时由数据文件再加入。
+
+// 签到截止定时器
+struct Timer {
+    int deadline;   // 到期时间（分钟，见 currentMinute）
+    int date;       // 预约的日期编号
+    UserId user;    // 预约用户
+};
+typedef CountedVector<Timer, MEM_TIMERS> TimerList;
+
+const int WHEEL_BITS = 6;
+const int WHEEL_SIZE = 1 << WHEEL_BITS;
+const int WHEEL_LEVELS = 4;
+TimerList timerWheel[WHEEL_LEVELS][WHEEL_SIZE];
+TimerList dueTimers;          // 已经到期、等待处理的定时器
+int wheelTime = 0;            // 定时器轮已推进到的时间（分钟）
+
+// 清空定时器轮，并从 now 开始计时
+void resetTimerWheel(int now) {
+    for (auto &level : timerWheel) {
+        for (TimerList &slot : level) {
+            slot.clear();
+        }
+    }
+    dueTimers.clear();
+    wheelTime = now;
+}
+
+// 加入定时器：按距到期的时间选择层，按到期时间在该层的位选择格子
+void addTimer(const Timer &timer) {
+    long long delta = (long long)timer.deadline - wheelTime;
+    if (delta <= 0) {
+        dueTimers.push_back(timer);
+        return;
+    }
+    int level = 0;
+    while (level + 1 < WHEEL_LEVELS && delta >= (1ll << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    timerWheel[level][(timer.deadline >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1)].push_back(timer);
+}
+
+// 删除某一日期的所有定时器（卸载日期时调用，否则重新加载后同一预约会有重复的定时器）
+void removeTimers(int date) {
+    auto ofDate = [date](const Timer &timer) { return timer.date == date; };
+    for (auto &level : timerWheel) {
+        for (TimerList &slot : level) {
+            slot.erase(remove_if(slot.begin(), slot.end(), ofDate), slot.end());
+        }
+    }
+    dueTimers.erase(remove_if(dueTimers.begin(), dueTimers.end(), ofDate), dueTimers.end());
+}
+
+// 把定时器轮推进到 now，到期的定时器移入 dueTimers
+void advanceTimerWheel(int now) {
+    while (wheelTime < now) {
+        wheelTime++;
+        // 低层转完一圈时，把高层当前格子中的定时器下放
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            if (wheelTime & ((1 << (WHEEL_BITS * level)) - 1)) break;
+            TimerList cascade;
+            cascade.swap(timerWheel[level][(wheelTime >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1)]);
+            for (const Timer &timer : cascade) {
+                addTimer(timer);
             }
         }
+        TimerList &slot = timerWheel[0][wheelTime & (WHEEL_SIZE - 1)];
+        dueTimers.insert(dueTimers.end(), slot.begin(), slot.end());
+        slot.clear();
     }
+}
 
-    // 关闭文件
-    file.close();
+// ===================== 固定布局 =====================
+// 楼层、行、列数与编译期已知的布局一致时，逐个访问非空闲座位的扫描改用 SeatGrid 的实现：
+// 维数都是常量，整层的座位状态用一次完全展开、不含分支的扫描压缩成一个字（每个座位2位），
+// 之后按位只访问非空闲的座位。布局不一致时使用按运行时行列数循环的通用实现。
+// 布局可以在运行时被 ManageSeats 或数据文件改变，因此每次扫描前都检查当前布局。
+
+// 座位状态的2位编码：空闲为0，部分时段预约为2，不可预约为3，其余（已预约）为1
+constexpr array<uint8_t, 256> makeStatusCodes() {
+    array<uint8_t, 256> codes = {};
+    for (int i = 0; i < 256; i++) {
+        codes[i] = i == EMPTY ? 0 : i == PARTIAL ? 2 : i == UNAVAILABLE ? 3 : 1;
+    }
+    return codes;
 }
+constexpr array<uint8_t, 256> STATUS_CODES = makeStatusCodes();
 
-// 从文件加载数据
-// 从指定的数据文件中读取座位配置和座位信息
-void loadData() {
-    // 打开文件用于读取
-    ifstream file(DATA_FILE);
-    if (!file.is_open()) {
-        // 如果文件不存在，初始化数据
-        initializeLibrary();
+// 固定布局的座位扫描（每层最多32个座位，整层状态放在一个字里；4×4 的一层正好是一个32位字）
+template <int Floors, int Rows, int Cols>
+struct SeatGrid {
+    static constexpr int SEATS = Rows * Cols;
+    static_assert(SEATS <= 32, "A floor must fit in one 64-bit status word.");
+    typedef typename conditional<SEATS <= 16, uint32_t, uint64_t>::type Word;
+    // 每个座位取低位的掩码（...0101）
+    static constexpr Word LOW_BITS = (Word)(~(Word)0 / 3) >> (sizeof(Word) * 8 - 2 * SEATS);
+
+    // 当前布局是否就是该布局
+    static bool matches() {
+        return FLOORS == Floors && ROWS == Rows && COLS == Cols;
+    }
+
+    template <size_t... I>
+    static Word pack(const Seat *seats, index_sequence<I...>) {
+        return (((Word)STATUS_CODES[seats[I].status] << (2 * I)) | ...);
+    }
+
+    // 把整层的座位状态压缩成一个字：第 i 个座位占第 2i、2i+1 位
+    static Word statusWord(const Seat *seats) {
+        return pack(seats, make_index_sequence<SEATS>());
+    }
+
+    // 非空闲的座位：第 i 个座位非空闲时结果的第 2i 位为1
+    static Word occupied(Word word) {
+        return (word | word >> 1) & LOW_BITS;
+    }
+
+    // 按下标递增的顺序访问掩码中的座位
+    template <typename Visit>
+    static void forEachSeat(Word mask, Visit &visit) {
+        while (mask) {
+            visit(lowestBit(mask) / 2);
+            mask &= mask - 1;
+        }
+    }
+
+    // 逐层访问一天中非空闲的座位
+    template <typename Visit>
+    static void forEachOccupied(const DayData &day, Visit &visit) {
+        int floors = min((int)day.floors.size(), Floors);
+        for (int f = 0; f < floors; f++) {
+            const FloorData *floorData = day.floors[f].get();
+            if (!floorData) continue;
+            auto visitSeat = [&](int i) { visit(f, i); };
+            forEachSeat(occupied(statusWord(floorData->seats.data())), visitSeat);
+        }
+    }
+};
+
+// 默认布局（5层，每层4×4）
+typedef SeatGrid<5, 4, 4> DefaultSeatGrid;
+
+// 按下标递增的顺序访问某层中非空闲的座位
+// 参数: visit - 以座位在本层内的下标调用
+template <typename Visit>
+void forEachOccupiedSeat(const FloorData &floorData, Visit visit) {
+    if (DefaultSeatGrid::matches()) {
+        DefaultSeatGrid::forEachSeat(DefaultSeatGrid::occupied(DefaultSeatGrid::statusWord(floorData.seats.data())), visit);
+        return;
+    }
+    for (int i = 0; i < ROWS * COLS; i++) {
+        if (floorData.seats[i].status != EMPTY) visit(i);
+    }
+}
+
+// 按楼层、下标递增的顺序访问某一天中非空闲的座位
+// 参数: visit - 以楼层（0-based）和座位在本层内的下标调用
+template <typename Visit>
+void forEachOccupiedSeat(const DayData &day, Visit visit) {
+    if (DefaultSeatGrid::matches()) {
+        DefaultSeatGrid::forEachOccupied(day, visit);
         return;
     }
+    for (int f = 0; f < (int)day.floors.size(); f++) {
+        const FloorData *floorData = day.floors[f].get();
+        if (!floorData) continue;
+        for (int i = 0; i < ROWS * COLS; i++) {
+            if (floorData->seats[i].status != EMPTY) visit(f, i);
+        }
+    }
+}
+
+// ===================== 座位存储 =====================
+
+// 未分配楼层中的座位一律视为空闲
+const Seat EMPTY_SEAT = {(uint32_t)EMPTY, NO_USER};
+
+// 时段位图中每行占用的64位字数
+int rowWords() {
+    return (COLS + 63) / 64;
+}
+
+// 一张时段位图的字数
+size_t slotPlaneWords() {
+    return (size_t)ROWS * rowWords();
+}
+
+// 设置某个座位（0-based）在各时段的空闲位：free 中的时段置1，其余时段置0
+void setSlotBits(FloorData &floorData, int row, int col, SlotMask free) {
+    size_t word = (size_t)row * rowWords() + col / 64;
+    uint64_t bit = 1ull << (col % 64);
+    size_t plane = slotPlaneWords();
+    for (int s = 0; s < NUM_SLOTS; s++) {
+        uint64_t &w = floorData.slotFree[s * plane + word];
+        w = (free >> s & 1) ? (w | bit) : (w & ~bit);
+    }
+}
+
+// 座位（0-based）已被占用的时段：空闲座位没有，整天预约或不可预约的座位占用全部时段
+SlotMask busySlots(const FloorData &floorData, int row, int col) {
+    const Seat &seat = floorData.seats[row * COLS + col];
+    if (seat.status == EMPTY) return 0;
+    if (seat.status != PARTIAL) return ALL_SLOTS;
+    SlotMask busy = 0;
+    auto it = floorData.slotBookings.find((uint32_t)(row * COLS + col));
+    if (it != floorData.slotBookings.end()) {
+        for (const SlotBooking &booking : it->second) {
+            busy |= booking.slots;
+        }
+    }
+    return busy;
+}
+
+// 根据座位状态和按时段预约重建整层的时段位图（楼层布局变化后调用）
+void rebuildSlotBits(FloorData &floorData) {
+    floorData.slotFree.assign(NUM_SLOTS * slotPlaneWords(), 0);
+    for (int r = 0; r < ROWS; r++) {
+        for (int c = 0; c < COLS; c++) {
+            setSlotBits(floorData, r, c, ALL_SLOTS & ~busySlots(floorData, r, c));
+        }
+    }
+}
+
+void loadColdDay(int date);
+
+// 按日期编号查找已加载到内存的日期数据，不触发按需加载（保存数据、释放空日期时使用）
+// 返回: 日期数据，未分配、未加载或超出可预约范围时返回 nullptr
+DayData *loadedDay(int date) {
+    if (date < today || date >= today + HORIZON_DAYS) {
+        return nullptr;
+    }
+    DayData *day = calendar[date % HORIZON_DAYS].get();
+    return (day && day->date == date) ? day : nullptr;
+}
+
+// 按日期编号查找已分配的日期数据，数据文件中尚未加载的日期先加载
+// 返回: 日期数据，未分配或超出可预约范围时返回 nullptr
+DayData *findDay(int date) {
+    DayData *day = loadedDay(date);
+    if (!day && date >= today && date < today + HORIZON_DAYS && coldDays[date % HORIZON_DAYS].date == date) {
+        loadColdDay(date);
+        day = loadedDay(date);
+    }
+    return day;
+}
+
+// 查找某天某层（0-based）已分配的楼层数据，未分配时返回 nullptr
+FloorData *findFloor(int date, int floor) {
+    DayData *day = findDay(date);
+    if (!day || floor >= (int)day->floors.size()) {
+        return nullptr;
+    }
+    return day->floors[floor].get();
+}
+
+// 获取某天的日期数据，不存在时分配
+// 调用者需保证日期在可预约范围内
+DayData &ensureDay(int date) {
+    if (DayData *loaded = findDay(date)) {
+        return *loaded;
+    }
+    unique_ptr<DayData> &day = calendar[date % HORIZON_DAYS];
+    day.reset(new DayData());
+    day->date = date;
+    return *day;
+}
+
+// 获取某天某层（0-based）的楼层数据，不存在时分配并把所有座位设为空闲
+// 调用者需保证日期在可预约范围内
+FloorData &ensureFloor(int date, int floor) {
+    DayData *day = &ensureDay(date);
+    if ((int)day->floors.size() < FLOORS) {
+        day->floors.resize(FLOORS);
+    }
+    unique_ptr<FloorData> &floorData = day->floors[floor];
+    if (!floorData) {
+        floorData.reset(new FloorData());
+        floorData->seats.assign(ROWS * COLS, EMPTY_SEAT);
+        // 所有座位在所有时段都空闲：每行的有效列置1，行尾的填充位保持为0
+        floorData->slotFree.assign(NUM_SLOTS * slotPlaneWords(), ~0ull);
+        if (COLS % 64 != 0) {
+            for (size_t w = rowWords() - 1; w < floorData->slotFree.size(); w += rowWords()) {
+                floorData->slotFree[w] = (1ull << (COLS % 64)) - 1;
+            }
+        }
+    }
+    return *floorData;
+}
+
+// 为用户某天的新预约设置签到截止时间并加入定时器轮（加载数据时不调用，截止时间从数据文件读取）
+// 参数: startMinute - 预约开始的时刻（当天0点起的分钟数）
+void scheduleCheckIn(int date, UserId user, int startMinute) {
+    DayData *day = findDay(date);
+    auto it = day->checkInDeadlines.find(user);
+    if (it != day->checkInDeadlines.end() && it->second == CHECKED_IN) {
+        return;   // 已签到的用户当天换座位无需重新签到
+    }
+    int deadline = max(date * 1440 + startMinute, currentMinute()) + CHECKIN_GRACE_MINUTES;
+    day->checkInDeadlines[user] = deadline - date * 1440;
+    journalCheckIn(date, user);
+    addTimer({deadline, date, user});
+}
+
+// 读取座位（0-based），未分配的座位视为空闲
+Seat seatAt(int date, int floor, int row, int col) {
+    FloorData *floorData = findFloor(date, floor);
+    return floorData ? floorData->seats[row * COLS + col] : EMPTY_SEAT;
+}
+
+// 修改座位（0-based），所有对座位状态的修改都经过这里，同时维护当天的用户预约索引和时段位图
+// 座位从 PARTIAL 变为其他状态时，其上的按时段预约一并取消
+// 参数: status - 新状态；user - 新的预约用户编号
+void setSeat(int date, int floor, int row, int col, char status, UserId user) {
+    FloorData *floorData = findFloor(date, floor);
+    if (!floorData) {
+        // 未分配的楼层本来就全部空闲，置空无需分配
+        if (status == EMPTY) {
+            return;
+        }
+        floorData = &ensureFloor(date, floor);
+    }
+    DayData &day = *findDay(date);
+    uint32_t index = (uint32_t)((floor * ROWS + row) * COLS + col);
+    Seat &seat = floorData->seats[row * COLS + col];
+    if (seat.status == RESERVED) {
+        auto it = day.userSeat.find(seat.user);
+        if (it != day.userSeat.end() && it->second == index) {
+            day.userSeat.erase(it);
+        }
+    }
+    if (status == EMPTY && seat.status != EMPTY && !day.waiting.empty()) {
+        freedSeats.push_back({date, index});
+    }
+    journalSeat(date, floor, row, col);
+    if (seat.status == PARTIAL && status != PARTIAL) {
+        auto it = floorData->slotBookings.find((uint32_t)(row * COLS + col));
+        if (it != floorData->slotBookings.end()) {
+            for (const SlotBooking &booking : it->second) {
+                day.userSlot.erase(booking.user);
+            }
+            floorData->slotBookings.erase(it);
+        }
+    }
+    floorData->used += (status != EMPTY) - (seat.status != EMPTY);
+    floorData->userView.text.clear();
+    floorData->adminView.text.clear();
+    seat.status = (uint32_t)status;
+    seat.user = user;
+    if (status == RESERVED) {
+        day.userSeat[user] = index;
+        if (shardIndex >= 0) acquiredSeats.push_back({date, user});
+        if (recordChanges) scheduleCheckIn(date, user, SLOT_START_HOUR * 60);
+    }
+    // PARTIAL 座位的时段位由按时段预约的函数维护
+    if (status != PARTIAL) {
+        setSlotBits(*floorData, row, col, status == EMPTY ? ALL_SLOTS : 0);
+    }
+}
+
+// 按时段预约座位（0-based），调用者需保证这些时段空闲且该用户当天没有其他预约
+void bookSlots(int date, int floor, int row, int col, UserId user, SlotMask slots) {
+    FloorData &floorData = ensureFloor(date, floor);
+    if (floorData.seats[row * COLS + col].status == EMPTY) {
+        setSeat(date, floor, row, col, PARTIAL, NO_USER);
+    }
+    floorData.slotBookings[(uint32_t)(row * COLS + col)].push_back({user, slots});
+    journalSeat(date, floor, row, col);
+    setSlotBits(floorData, row, col, ALL_SLOTS & ~busySlots(floorData, row, col));
+    findDay(date)->userSlot[user] = (uint32_t)((floor * ROWS + row) * COLS + col);
+    if (shardIndex >= 0) acquiredSeats.push_back({date, user});
+    if (recordChanges) scheduleCheckIn(date, user, (SLOT_START_HOUR + lowestBit(slots)) * 60);
+}
+
+// 取消某用户在某一天的按时段预约，座位上没有其他预约时恢复为空闲
+void cancelSlotBooking(int date, UserId user) {
+    DayData *day = findDay(date);
+    if (!day) return;
+    auto it = day->userSlot.find(user);
+    if (it == day->userSlot.end()) return;
+    int index = (int)it->second;
+    day->userSlot.erase(it);
+    int floor = index / (ROWS * COLS), row = index / COLS % ROWS, col = index % COLS;
+    FloorData &floorData = *day->floors[floor];
+    BookingList &bookings = floorData.slotBookings[(uint32_t)(row * COLS + col)];
+    bookings.erase(remove_if(bookings.begin(), bookings.end(),
+                             [user](const SlotBooking &booking) { return booking.user == user; }),
+                   bookings.end());
+    journalSeat(date, floor, row, col);
+    if (bookings.empty()) {
+        floorData.slotBookings.erase((uint32_t)(row * COLS + col));
+        setSeat(date, floor, row, col, EMPTY, NO_USER);
+    } else {
+        setSlotBits(floorData, row, col, ALL_SLOTS & ~busySlots(floorData, row, col));
+    }
+}
+
+// 查找某用户在某一天对某座位（0-based）的按时段预约
+// 返回: 预约的时段，没有时返回0
+SlotMask userSlotsAt(int date, int floor, int row, int col, UserId user) {
+    DayData *day = findDay(date);
+    if (!day) return 0;
+    auto it = day->userSlot.find(user);
+    if (it == day->userSlot.end() || it->second != (uint32_t)((floor * ROWS + row) * COLS + col)) return 0;
+    for (const SlotBooking &booking : day->floors[floor]->slotBookings[(uint32_t)(row * COLS + col)]) {
+        if (booking.user == user) return booking.slots;
+    }
+    return 0;
+}
+
+// 计算某天某层（0-based）在 slots 中所有时段都空闲的座位位图（每行按64位字对齐）
+void freeSeatBits(int date, int floor, SlotMask slots, vector<uint64_t> &bits) {
+    FloorData *floorData = findFloor(date, floor);
+    size_t plane = slotPlaneWords();
+    if (!floorData) {
+        // 未分配的楼层全部空闲
+        bits.assign(plane, ~0ull);
+        if (COLS % 64 != 0) {
+            for (size_t w = rowWords() - 1; w < plane; w += rowWords()) {
+                bits[w] = (1ull << (COLS % 64)) - 1;
+            }
+        }
+        return;
+    }
+    bits.assign(plane, ~0ull);
+    for (int s = 0; s < NUM_SLOTS; s++) {
+        if (!(slots >> s & 1)) continue;
+        const uint64_t *p = &floorData->slotFree[s * plane];
+        for (size_t w = 0; w < plane; w++) {
+            bits[w] &= p[w];
+        }
+    }
+}
+
+// 取消某用户在某一天的预约（同一用户同一天只能预约一个座位），同时移除其当天的候补
+// 通过当天的用户预约索引直接定位，无需扫描座位
+// 参数: date - 日期编号
+// 参数: user - 用户编号
+void cancelUserReservation(int date, UserId user) {
+    DayData *day = findDay(date);
+    if (!day) return;
+    if (day->waiting.erase(user)) {
+        journalDay(date);
+    }
+    cancelSlotBooking(date, user);
+    auto it = day->userSeat.find(user);
+    if (it == day->userSeat.end()) return;
+    int index = (int)it->second;
+    setSeat(date, index / (ROWS * COLS), index / COLS % ROWS, index % COLS, EMPTY, NO_USER);
+}
+
+// ===================== 候补队列 =====================
+
+// 把用户加入某天的候补队列（floor 为 0-based 楼层，-1 表示任意楼层）
+// 用户当天已有候补时，原来的候补失效，重新排到队尾
+void enqueueWaiter(int date, int floor, UserId user) {
+    DayData &day = ensureDay(date);
+    if ((int)day.waitlists.size() < FLOORS + 1) {
+        day.waitlists.resize(FLOORS + 1);
+    }
+    uint64_t seq = day.nextWaitSeq++;
+    day.waitlists[floor + 1].push_back({user, seq});
+    day.waiting[user] = {seq, floor};
+    journalDay(date);
+}
+
+// 取出队首的有效候补项（跳过已失效的项）
+// 返回: 队首项的序号，队列为空时返回0
+uint64_t waitlistHead(DayData &day, WaitQueue &queue) {
+    while (!queue.empty()) {
+        auto it = day.waiting.find(queue.front().user);
+        if (it != day.waiting.end() && it->second.seq == queue.front().seq) {
+            return queue.front().seq;
+        }
+        queue.pop_front();
+    }
+    return 0;
+}
+
+// 为某层（0-based）空出的座位选出候补用户：该层的候补与任意楼层的候补中先加入者优先
+// 均摊 O(1)：每个失效项只会被跳过一次
+// 返回: 候补用户编号（已移出队列），没有候补时返回 NO_USER
+UserId popWaiter(DayData &day, int floor) {
+    if (floor + 1 >= (int)day.waitlists.size()) return NO_USER;
+    WaitQueue &floorQueue = day.waitlists[floor + 1];
+    WaitQueue &anyQueue = day.waitlists[0];
+    uint64_t floorSeq = waitlistHead(day, floorQueue);
+    uint64_t anySeq = waitlistHead(day, anyQueue);
+    if (floorSeq == 0 && anySeq == 0) return NO_USER;
+    WaitQueue &queue = (anySeq == 0 || (floorSeq != 0 && floorSeq < anySeq)) ? floorQueue : anyQueue;
+    UserId user = queue.front().user;
+    queue.pop_front();
+    day.waiting.erase(user);
+    return user;
+}
+
+// 把本次命令中空出的座位依次分配给候补用户
+// 被分配的用户原有的预约按"每天一个座位"的规则取消，空出的座位继续分配给下一位候补
+void promoteWaitlist() {
+    for (size_t i = 0; i < freedSeats.size(); i++) {
+        int date = freedSeats[i].first;
+        int index = (int)freedSeats[i].second;
+        DayData *day = findDay(date);
+        if (!day || day->waiting.empty()) continue;
+        int floor = index / (ROWS * COLS), row = index / COLS % ROWS, col = index % COLS;
+        // 座位可能已在同一命令中被再次占用
+        if (floor >= FLOORS || seatAt(date, floor, row, col).status != EMPTY) continue;
+        UserId user = popWaiter(*day, floor);
+        if (user == NO_USER) continue;
+        cancelUserReservation(date, user);
+        setSeat(date, floor, row, col, RESERVED, user);
+    }
+    freedSeats.clear();
+}
+
+// 释放超过签到截止时间仍未签到的预约，空出的座位随即恢复空闲（有候补时分配给候补用户）
+// 返回: 是否释放了预约
+bool releaseNoShows() {
+    advanceTimerWheel(currentMinute());
+    bool released = false;
+    for (const Timer &timer : dueTimers) {
+        DayData *day = findDay(timer.date);
+        if (!day) continue;
+        // 预约已取消、已签到或截止时间已更新（换了座位）时，定时器已失效
+        auto it = day->checkInDeadlines.find(timer.user);
+        if (it == day->checkInDeadlines.end() || it->second == CHECKED_IN ||
+            timer.date * 1440 + it->second != timer.deadline) {
+            continue;
+        }
+        day->checkInDeadlines.erase(it);
+        journalCheckIn(timer.date, timer.user);
+        if (day->userSeat.count(timer.user) || day->userSlot.count(timer.user)) {
+            cancelUserReservation(timer.date, timer.user);
+            released = true;
+        }
+    }
+    dueTimers.clear();
+    return released;
+}
+
+// 根据座位数据重建某一天的用户预约索引（楼层布局变化后调用）
+void rebuildUserIndex(DayData &day) {
+    day.userSeat.clear();
+    day.userSlot.clear();
+    for (int f = 0; f < (int)day.floors.size(); f++) {
+        FloorData *floorData = day.floors[f].get();
+        if (!floorData) continue;
+        for (int i = 0; i < ROWS * COLS; i++) {
+            if (floorData->seats[i].status == RESERVED) {
+                day.userSeat[floorData->seats[i].user] = (uint32_t)(f * ROWS * COLS + i);
+            }
+        }
+        for (const auto &entry : floorData->slotBookings) {
+            for (const SlotBooking &booking : entry.second) {
+                day.userSlot[booking.user] = (uint32_t)(f * ROWS * COLS) + entry.first;
+            }
+        }
+    }
+}
+
+// 释放已经没有预约的楼层和日期，使内存只与实际预约数量相关
+void releaseEmptyDays() {
+    for (unique_ptr<DayData> &day : calendar) {
+        if (!day) continue;
+        bool hasFloor = false;
+        for (unique_ptr<FloorData> &floorData : day->floors) {
+            if (floorData && floorData->used == 0) {
+                floorData.reset();
+            }
+            hasFloor = hasFloor || floorData;
+        }
+        if (!hasFloor && day->waiting.empty()) {
+            day.reset();
+        }
+    }
+}
+
+// 把某个座位写成一行文本：楼层 行 列 状态 用户编号（1-based，无用户时编号为0）
+void writeSeatLine(ostream &out, int floor, int row, int col, const Seat &seat) {
+    out << (floor + 1) << ' ' << (row + 1) << ' ' << (col + 1) << ' ' << (char)seat.status << ' '
+        << seat.user << '\n';
+}
+
+// 解析时间段，如 "14-16" 或 "14:00-16:00"（整点，8点到22点之间）
+// 返回: 时段掩码，格式错误时返回0
+SlotMask parseTimeRange(const string &text) {
+    int startHour, startMinute = 0, endHour, endMinute = 0;
+    char extra;
+    if (sscanf(text.c_str(), "%d:%d-%d:%d %c", &startHour, &startMinute, &endHour, &endMinute, &extra) != 4 &&
+        sscanf(text.c_str(), "%d-%d %c", &startHour, &endHour, &extra) != 2) {
+        return 0;
+    }
+    if (startMinute != 0 || endMinute != 0 || startHour < SLOT_START_HOUR || endHour <= startHour ||
+        endHour > SLOT_START_HOUR + NUM_SLOTS) {
+        return 0;
+    }
+    return (SlotMask)(((1u << (endHour - startHour)) - 1) << (startHour - SLOT_START_HOUR));
+}
+
+// 把连续的时段掩码写成 "14-16" 的形式
+string formatTimeRange(SlotMask slots) {
+    int first = 0, last = NUM_SLOTS - 1;
+    while (first < NUM_SLOTS && !(slots >> first & 1)) first++;
+    while (last > first && !(slots >> last & 1)) last--;
+    return to_string(SLOT_START_HOUR + first) + "-" + to_string(SLOT_START_HOUR + last + 1);
+}
+
+// 从 p 处读取一个非负整数并跳过其后的一个空格或行尾
+// 返回: 格式正确时返回true
+bool readNumber(const char *&p, uint32_t &number) {
+    if (!isdigit((unsigned char)*p)) return false;
+    number = 0;
+    while (isdigit((unsigned char)*p)) {
+        number = number * 10 + (uint32_t)(*p++ - '0');
+    }
+    if (*p == ' ') p++;
+    return true;
+}
+
+// 解析 writeSeatLine 写出的座位行（每条命令都会重新加载数据，因此不使用较慢的 sscanf）
+// 旧版（LIBRARY 2）文件中用户是单个字母，无用户时为'-'，读取时转换为用户编号；
+// 状态为 PARTIAL 的行是一条按时段预约，行尾还有时间段，如 "1 2 3 P 17 14-16"
+// 返回: 格式正确时返回true
+bool parseSeatLine(const string &line, int version, int &floor, int &row, int &col, char &status, UserId &user,
+                   SlotMask &slots) {
+    const char *p = line.c_str();
+    uint32_t f, r, c;
+    if (!readNumber(p, f) || !readNumber(p, r) || !readNumber(p, c)) return false;
+    if (p[0] == '\0' || p[1] != ' ' || p[2] == '\0') return false;
+    floor = (int)f;
+    row = (int)r;
+    col = (int)c;
+    status = p[0];
+    p += 2;
+    if (version == 2) {
+        user = (*p == '-') ? NO_USER : internUser(string(1, *p));
+        return true;
+    }
+    uint32_t id;
+    if (!readNumber(p, id)) return false;
+    user = id;
+    slots = 0;
+    if (status == PARTIAL) {
+        slots = parseTimeRange(p);
+        return slots != 0 && user != NO_USER;
+    }
+    return true;
+}
+
+// ===================== 历史归档 =====================
+// 座位数据被移出数据文件时（日期滚动、ClearDay、ClearFloor、Clear）追加到归档文件，供 Analytics 统计使用率。
+// 归档按列存储：每块最多 HISTORY_BLOCK_ROWS 条记录，块内每列单独编码——先对相邻值取差，
+// 差值做 zigzag 变换后按"值 重复次数"写成变长整数。记录按日期、楼层、行、列排序，
+// 日期和楼层列几乎全是重复的0差值，每块只占几个字节；统计时各块可以独立解码，由多个线程并行扫描。
+// 块格式（整数均为小端）：
+//   "HIST" 类型(1字节) 记录数(4字节)，随后每列：字节数(4字节) 编码后的数据
+// 类型见 HistoryKind；列依次为 日期编号、楼层、行、列（0-based）、用户编号、状态、时段
+
+// 归档的原因
+enum HistoryKind { HISTORY_ROLLOVER, HISTORY_CLEAR_DAY, HISTORY_CLEAR_FLOOR, HISTORY_CLEAR_ALL };
+
+// 归档的列
+enum HistoryColumn { COLUMN_DATE, COLUMN_FLOOR, COLUMN_ROW, COLUMN_COL, COLUMN_USER, COLUMN_STATUS, COLUMN_SLOTS, COLUMN_COUNT };
+
+const uint32_t HISTORY_BLOCK_ROWS = 1 << 16;   // 每块最多的记录数，块是并行扫描的单位
+
+// 待归档的一批记录（按列存放）
+struct HistoryBatch {
+    vector<int32_t> columns[COLUMN_COUNT];
+
+    size_t size() const { return columns[COLUMN_DATE].size(); }
+
+    // 追加一条记录（楼层、行、列为 0-based；slots 为0表示整天）
+    void add(int date, int floor, int row, int col, UserId user, char status, SlotMask slots) {
+        int32_t values[COLUMN_COUNT] = {date, floor, row, col, (int32_t)user, (unsigned char)status, slots};
+        for (int i = 0; i < COLUMN_COUNT; i++) {
+            columns[i].push_back(values[i]);
+        }
+    }
+};
+
+// 写入变长整数（每字节7位，最高位表示后面还有字节）
+void putVarint(string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+// 读取变长整数
+// 返回: 数据完整时返回true
+bool getVarint(const uint8_t *&p, const uint8_t *end, uint64_t &value) {
+    value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// 写入小端的32位整数
+void putUint32(string &out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out += (char)(value >> (8 * i));
+    }
+}
+
+// 读取小端的32位整数
+uint32_t getUint32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// 编码一列中 [begin, end) 的值：相邻差值经 zigzag 变换后按"值 重复次数"写出
+void encodeColumn(const vector<int32_t> &values, size_t begin, size_t end, string &out) {
+    int64_t previous = 0;
+    size_t i = begin;
+    while (i < end) {
+        int64_t delta = (int64_t)values[i] - previous;
+        size_t run = 1;
+        while (i + run < end && (int64_t)values[i + run] - values[i + run - 1] == delta) {
+            run++;
+        }
+        putVarint(out, (uint64_t)((delta << 1) ^ (delta >> 63)));
+        putVarint(out, run);
+        previous = values[i + run - 1];
+        i += run;
+    }
+}
+
+// 解码一列，得到 rows 个值
+// 返回: 数据完整时返回true
+bool decodeColumn(const uint8_t *p, const uint8_t *end, uint32_t rows, vector<int32_t> &values) {
+    values.clear();
+    int64_t previous = 0;
+    while (values.size() < rows) {
+        uint64_t zigzag, run;
+        if (!getVarint(p, end, zigzag) || !getVarint(p, end, run) || run == 0 || run > rows - values.size()) {
+            return false;
+        }
+        int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        for (uint64_t k = 0; k < run; k++) {
+            previous += delta;
+            values.push_back((int32_t)previous);
+        }
+    }
+    return true;
+}
+
+// 事务中被清空的记录：提交成功后才写入归档文件，回滚时丢弃
+vector<pair<HistoryKind, HistoryBatch>> pendingHistory;
+
+// 把一批记录按块编码后追加到归档文件（事务中先暂存，见 pendingHistory）
+void appendHistory(const HistoryBatch &batch, HistoryKind kind) {
+    if (batch.size() == 0) return;
+    if (inTransaction) {
+        pendingHistory.push_back({kind, batch});
+        return;
+    }
+    string data;
+    for (size_t begin = 0; begin < batch.size(); begin += HISTORY_BLOCK_ROWS) {
+        size_t end = min(batch.size(), begin + HISTORY_BLOCK_ROWS);
+        data += "HIST";
+        data += (char)kind;
+        putUint32(data, (uint32_t)(end - begin));
+        for (int i = 0; i < COLUMN_COUNT; i++) {
+            string column;
+            encodeColumn(batch.columns[i], begin, end, column);
+            putUint32(data, (uint32_t)column.size());
+            data += column;
+        }
+    }
+    ofstream file(ARCHIVE_FILE, ios::binary | ios::app);
+    file.write(data.data(), (streamsize)data.size());
+    file.close();
+    if (file.fail()) {
+        reportError("ERROR: Failed to write archive.");
+    }
+}
+
+// 把某天某层（0-based）的全部非空闲座位加入待归档的记录，按时段预约的座位每条预约一条记录
+void collectFloorHistory(int date, int floor, HistoryBatch &batch) {
+    FloorData *floorData = findFloor(date, floor);
+    if (!floorData) return;
+    forEachOccupiedSeat(*floorData, [&](int i) {
+        const Seat &seat = floorData->seats[i];
+        if (seat.status == PARTIAL) {
+            for (const SlotBooking &booking : floorData->slotBookings[(uint32_t)i]) {
+                batch.add(date, floor, i / COLS, i % COLS, booking.user, PARTIAL, booking.slots);
+            }
+        } else {
+            batch.add(date, floor, i / COLS, i % COLS, seat.user, (char)seat.status, 0);
+        }
+    });
+}
+
+// 把某一天的全部非空闲座位加入待归档的记录
+void collectDayHistory(int date, HistoryBatch &batch) {
+    DayData *day = findDay(date);
+    if (!day) return;
+    for (int f = 0; f < (int)day->floors.size(); f++) {
+        collectFloorHistory(date, f, batch);
+    }
+}
+
+// 归档文件中一个块的位置（列数据指向读入内存的文件内容）
+struct HistoryBlock {
+    HistoryKind kind;
+    uint32_t rows;
+    const uint8_t *columns[COLUMN_COUNT];   // 每列编码数据的起点
+    const uint8_t *columnEnds[COLUMN_COUNT];
+};
+
+// 解析归档文件的块目录，不解码列数据；末尾写到一半的块被忽略
+// 返回: 格式正确时返回true
+bool indexHistory(const string &data, vector<HistoryBlock> &blocks) {
+    const uint8_t *p = (const uint8_t *)data.data();
+    const uint8_t *end = p + data.size();
+    while (end - p >= 9) {
+        if (memcmp(p, "HIST", 4) != 0 || p[4] > HISTORY_CLEAR_ALL) return false;
+        HistoryBlock block;
+        block.kind = (HistoryKind)p[4];
+        block.rows = getUint32(p + 5);
+        p += 9;
+        for (int i = 0; i < COLUMN_COUNT; i++) {
+            if (end - p < 4 || getUint32(p) > (uint64_t)(end - p - 4)) return true;
+            block.columns[i] = p + 4;
+            block.columnEnds[i] = p + 4 + getUint32(p);
+            p = block.columnEnds[i];
+        }
+        blocks.push_back(block);
+    }
+    return true;
+}
+
+// 一个扫描线程的统计结果
+struct HistoryStats {
+    uint64_t records = 0;               // 扫描的记录数
+    int firstDate = INT32_MAX;          // 日期滚动归档的最早日期
+    int lastDate = -1;                  // 日期滚动归档的最晚日期
+    vector<double> occupied;            // [楼层 * 7 + 星期] 被使用的座位·天数
+    map<int, double> weekly;            // 周一的日期 -> 该周被使用的座位·天数
+    vector<double> seatDays;            // 指定楼层每个座位被使用的天数
+    vector<uint32_t> used;              // 每个用户到期使用的预约数
+    vector<uint32_t> cleared;           // 每个用户被管理员清空的预约数
+
+    // 合并另一个线程的结果
+    void merge(const HistoryStats &other) {
+        records += other.records;
+        firstDate = min(firstDate, other.firstDate);
+        lastDate = max(lastDate, other.lastDate);
+        for (size_t i = 0; i < occupied.size(); i++) occupied[i] += other.occupied[i];
+        for (const auto &entry : other.weekly) weekly[entry.first] += entry.second;
+        for (size_t i = 0; i < seatDays.size(); i++) seatDays[i] += other.seatDays[i];
+        if (used.size() < other.used.size()) {
+            used.resize(other.used.size());
+            cleared.resize(other.used.size());
+        }
+        for (size_t i = 0; i < other.used.size(); i++) {
+            used[i] += other.used[i];
+            cleared[i] += other.cleared[i];
+        }
+    }
+};
+
+// 扫描编号为 first, first + step, ... 的块
+// 只有日期滚动归档的记录计入使用率（被清空的预约没有真正使用），用户统计包括全部记录
+// 参数: heatmapFloor - 需要逐座位统计的楼层（0-based），-1 表示不需要
+void scanHistory(const vector<HistoryBlock> &blocks, size_t first, size_t step, int heatmapFloor, HistoryStats &stats) {
+    vector<int32_t> columns[COLUMN_COUNT];
+    for (size_t b = first; b < blocks.size(); b += step) {
+        const HistoryBlock &block = blocks[b];
+        bool complete = true;
+        for (int i = 0; i < COLUMN_COUNT && complete; i++) {
+            complete = decodeColumn(block.columns[i], block.columnEnds[i], block.rows, columns[i]);
+        }
+        if (!complete) continue;
+        stats.records += block.rows;
+        for (uint32_t k = 0; k < block.rows; k++) {
+            char status = (char)columns[COLUMN_STATUS][k];
+            uint32_t user = (uint32_t)columns[COLUMN_USER][k];
+            if ((status != RESERVED && status != PARTIAL) || user > MAX_USER) continue;
+            if (user >= stats.used.size()) {
+                stats.used.resize(user + 1);
+                stats.cleared.resize(user + 1);
+            }
+            if (block.kind != HISTORY_ROLLOVER) {
+                stats.cleared[user]++;
+                continue;
+            }
+            stats.used[user]++;
+
+            // 按时段预约的记录按占用的时段比例计入
+            int date = columns[COLUMN_DATE][k];
+            int floor = columns[COLUMN_FLOOR][k];
+            int row = columns[COLUMN_ROW][k];
+            int col = columns[COLUMN_COL][k];
+            double share = status == PARTIAL ? popCount((unsigned)columns[COLUMN_SLOTS][k]) / (double)NUM_SLOTS : 1.0;
+            stats.firstDate = min(stats.firstDate, date);
+            stats.lastDate = max(stats.lastDate, date);
+            if (floor >= 0 && floor < FLOORS) {
+                stats.occupied[floor * NUM_DAYS + weekdayOf(date)] += share;
+            }
+            stats.weekly[date - weekdayOf(date)] += share;
+            if (floor == heatmapFloor && row >= 0 && row < ROWS && col >= 0 && col < COLS) {
+                stats.seatDays[row * COLS + col] += share;
+            }
+        }
+    }
+}
+
+// 管理员查看历史使用情况
+// 归档文件读入内存后按块分给多个线程并行解码统计，最后合并各线程的结果
+// 参数: args - 为空时显示各楼层按星期的使用率和每周趋势；"Floor n" 显示该层每个座位的使用率；
+//             "Users [k]" 显示预约最多的 k 个用户（默认10个）
+void showAnalytics(const string &args) {
+    PhaseScope phase(PHASE_EXECUTE);
+    istringstream iss(args);
+    string mode;
+    int number = 0;
+    iss >> mode;
+    if (mode == "Floor") {
+        if (!(iss >> number) || number < 1 || number > FLOORS) {
+            reportError("ERROR: Invalid floor.");
+            return;
+        }
+    } else if (mode == "Users") {
+        number = 10;
+        if (!(iss >> number) && !iss.eof()) number = 0;
+        if (number < 1) {
+            reportError("ERROR: Invalid parameters.");
+            return;
+        }
+    } else if (!mode.empty()) {
+        reportError("ERROR");
+        return;
+    }
+    string extra;
+    if (iss >> extra) {
+        reportError("ERROR");
+        return;
+    }
+
+    auto start = chrono::steady_clock::now();
+    ifstream file(ARCHIVE_FILE, ios::binary);
+    string data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    vector<HistoryBlock> blocks;
+    if (!indexHistory(data, blocks)) {
+        reportError("ERROR: Archive is corrupted.");
+        return;
+    }
+    if (blocks.empty()) {
+        cout << "No history." << endl;
+        return;
+    }
+
+    // 每个线程扫描间隔排列的块，块数少于核数时不开多余的线程
+    int heatmapFloor = mode == "Floor" ? number - 1 : -1;
+    size_t threadCount = max(1u, thread::hardware_concurrency());
+    threadCount = min(threadCount, blocks.size());
+    vector<HistoryStats> partial(threadCount);
+    for (HistoryStats &stats : partial) {
+        stats.occupied.assign(FLOORS * NUM_DAYS, 0);
+        if (heatmapFloor >= 0) stats.seatDays.assign(ROWS * COLS, 0);
+    }
+    vector<thread> workers;
+    for (size_t t = 1; t < threadCount; t++) {
+        workers.emplace_back(scanHistory, cref(blocks), t, threadCount, heatmapFloor, ref(partial[t]));
+    }
+    scanHistory(blocks, 0, threadCount, heatmapFloor, partial[0]);
+    for (thread &worker : workers) {
+        worker.join();
+    }
+    HistoryStats &stats = partial[0];
+    for (size_t t = 1; t < threadCount; t++) {
+        stats.merge(partial[t]);
+    }
+    double elapsedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    char line[160];
+    if (mode == "Users") {
+        // 按预约总数从多到少排序，相同时按用户名排序
+        vector<uint32_t> order;
+        for (uint32_t id = 1; id < stats.used.size(); id++) {
+            if (stats.used[id] + stats.cleared[id] > 0) order.push_back(id);
+        }
+        sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            uint32_t totalA = stats.used[a] + stats.cleared[a], totalB = stats.used[b] + stats.cleared[b];
+            return totalA != totalB ? totalA > totalB : userName(a) < userName(b);
+        });
+        outputBuffer += "user                total    used  cleared\n";
+        for (size_t i = 0; i < order.size() && i < (size_t)number; i++) {
+            uint32_t id = order[i];
+            snprintf(line, sizeof(line), "%-16s %8u %7u %8u\n", userName(id).c_str(),
+                     stats.used[id] + stats.cleared[id], stats.used[id], stats.cleared[id]);
+            outputBuffer += line;
+        }
+    } else if (stats.lastDate < 0) {
+        outputBuffer += "No past reservations.\n";
+    } else {
+        // 使用率 = 被使用的座位·天数 / (统计范围内的天数 × 座位数)
+        int dayCounts[NUM_DAYS] = {};
+        for (int date = stats.firstDate; date <= stats.lastDate; date++) {
+            dayCounts[weekdayOf(date)]++;
+        }
+        outputBuffer += "From " + formatDate(stats.firstDate) + " to " + formatDate(stats.lastDate) + ":\n";
+        if (mode == "Floor") {
+            // 每个座位的使用率按 0-9 显示（9 表示 90% 及以上）
+            int days = stats.lastDate - stats.firstDate + 1;
+            for (int r = 0; r < ROWS; r++) {
+                for (int c = 0; c < COLS; c++) {
+                    outputBuffer += (char)('0' + min(9, (int)(stats.seatDays[r * COLS + c] * 10 / days)));
+                }
+                outputBuffer += '\n';
+            }
+        } else {
+            // 分片模式下只显示本分片有记录的楼层
+            vector<int> floors;
+            for (int f = 0; f < FLOORS; f++) {
+                bool hasData = false;
+                for (int d = 0; d < NUM_DAYS; d++) {
+                    hasData = hasData || stats.occupied[f * NUM_DAYS + d] > 0;
+                }
+                if (shardIndex < 0 || hasData) floors.push_back(f);
+            }
+            outputBuffer += "Occupancy (%)";
+            for (int f : floors) {
+                snprintf(line, sizeof(line), " %7s", ("F" + to_string(f + 1)).c_str());
+                outputBuffer += line;
+            }
+            outputBuffer += '\n';
+            for (int d = 0; d < NUM_DAYS; d++) {
+                snprintf(line, sizeof(line), "%-13s", DAYS[d].c_str());
+                outputBuffer += line;
+                for (int f : floors) {
+                    double percent = dayCounts[d] ? 100.0 * stats.occupied[f * NUM_DAYS + d] / (dayCounts[d] * ROWS * COLS) : 0;
+                    snprintf(line, sizeof(line), " %7.1f", percent);
+                    outputBuffer += line;
+                }
+                outputBuffer += '\n';
+            }
+            for (const auto &week : stats.weekly) {
+                int days = min(week.first + NUM_DAYS - 1, stats.lastDate) - max(week.first, stats.firstDate) + 1;
+                double capacity = (double)days * max((size_t)1, floors.size()) * ROWS * COLS;
+                snprintf(line, sizeof(line), "Week of %s: %.1f%%\n", formatDate(week.first).c_str(),
+                         100.0 * week.second / capacity);
+                outputBuffer += line;
+            }
+        }
+    }
+    snprintf(line, sizeof(line), "Scanned %" PRIu64 " records in %zu blocks (%zu bytes) with %zu threads in %.2f ms.\n",
+             stats.records, blocks.size(), data.size(), threadCount, elapsedMs);
+    outputBuffer += line;
+    flushOutput();
+}
+
+// ===================== 按需加载 =====================
+// 数据文件（LIBRARY 4）在文件头之后有一张日期索引：INDEX 天数，随后每天一行"日期 起始位置 长度"，
+// 指出该天的 DAY 数据段在文件中的字节范围。加载时只读取文件头和索引，以及今天的数据段
+// （其中的签到截止时间可能已经到期），其余日期在第一次被访问（findDay）时才读取并解析；
+// 保存时仍未加载的日期直接从快照文件复制原始字节。启动耗时和常驻内存因此只与实际访问的日期有关。
+// 快照文件在加载时打开并一直保持到下一次加载，读到的总是加载时的版本，与原来一次性读入全部数据的语义相同。
+
+const int INDEX_LINE_WIDTH = 39;    // 索引行的宽度（含换行）：日期 起始位置（16位） 长度（10位）
+
+// 加载数据时的解析状态
+struct LoadState {
+    int version = 3;            // 数据文件格式版本
+    int date = -1;              // 当前正在读取的日期
+    bool archiving = false;     // 当前日期是否已经过去，需要归档
+    bool changed = false;       // 是否有日期被归档，需要重新保存
+    HistoryBatch archive;       // 待归档的记录
+};
+
+// 丢弃未加载日期的索引并关闭快照文件
+void closeSnapshot() {
+    for (ColdDay &cold : coldDays) {
+        cold.date = -1;
+    }
+    coldDayCount = 0;
+    snapshotIndex.clear();
+#ifdef _WIN32
+    string().swap(snapshotData);
+#else
+    if (snapshotFile.is_open()) snapshotFile.close();
+    snapshotFile.clear();
+#endif
+}
+
+// 从快照文件读取一个日期的数据段
+// 返回: 是否读取成功
+bool readSnapshotSection(const ColdDay &cold, string &out) {
+#ifdef _WIN32
+    if (cold.offset + cold.length > snapshotData.size()) return false;
+    out.assign(snapshotData, (size_t)cold.offset, cold.length);
+    return true;
+#else
+    out.resize(cold.length);
+    snapshotFile.clear();
+    snapshotFile.seekg((streamoff)cold.offset);
+    snapshotFile.read(&out[0], cold.length);
+    if (metricsEnabled) bytesRead += cold.length;
+    return snapshotFile.gcount() == (streamsize)cold.length;
+#endif
+}
+
+// 解析数据文件中的一行（文件头、DAY 行、座位行、候补行、签到行）
+void parseDataLine(const string &line, LoadState &state) {
+    if (line.empty()) return;
+    int &date = state.date;
+    if (isdigit((unsigned char)line[0])) {
+        // 座位行：楼层 行 列 状态 用户
+        if (date == -1) return;
+        int f, r, c;
+        char status;
+        UserId user;
+        SlotMask slots = 0;
+        if (state.archiving) {
+            if (parseSeatLine(line, state.version, f, r, c, status, user, slots) && status != EMPTY) {
+                state.archive.add(date, f - 1, r - 1, c - 1, user, status, slots);
+            }
+            return;
+        }
+        if (parseSeatLine(line, state.version, f, r, c, status, user, slots) &&
+            f >= 1 && f <= FLOORS && r >= 1 && r <= ROWS && c >= 1 && c <= COLS && status != EMPTY) {
+            // 同一用户同一天只能预约一个座位，重复的记录只保留第一条
+            DayData *day = findDay(date);
+            if ((status == RESERVED || status == PARTIAL) && day &&
+                (day->userSeat.count(user) || day->userSlot.count(user))) {
+                return;
+            }
+            if (status == PARTIAL) {
+                // 与已读取的预约时段冲突的记录被丢弃
+                FloorData *floorData = findFloor(date, f - 1);
+                if (!floorData || (busySlots(*floorData, r - 1, c - 1) & slots) == 0) {
+                    bookSlots(date, f - 1, r - 1, c - 1, user, slots);
+                }
+                return;
+            }
+            setSeat(date, f - 1, r - 1, c - 1, status, user);
+        }
+        return;
+    }
+    if (line[0] == 'C' && line[1] == ' ') {
+        // 签到状态：C 用户编号 截止时间，未签到的预约加入定时器轮（每个预约一行，不经过字符串流解析）
+        const char *p = line.c_str() + 2;
+        uint32_t user, deadline = 0;
+        bool checkedIn = false;     // 截止时间为 -1
+        DayData *day = date != -1 && !state.archiving ? findDay(date) : nullptr;
+        if (day && readNumber(p, user) && ((checkedIn = *p == '-') || readNumber(p, deadline)) &&
+            (day->userSeat.count(user) || day->userSlot.count(user))) {
+            day->checkInDeadlines[user] = checkedIn ? CHECKED_IN : (int)deadline;
+            if (!checkedIn) {
+                addTimer({date * 1440 + (int)deadline, date, user});
+            }
+        }
+        return;
+    }
+
+    istringstream iss(line);
+    string tag, value;
+    iss >> tag;
+    if (tag == "VERSION") {
+        iss >> dataVersion;
+        dataStamp = line;
+    } else if (tag == "LAYOUT") {
+        int floors, rows, cols;
+        if (iss >> floors >> rows >> cols && floors > 0 && rows > 0 && cols > 0) {
+            FLOORS = floors;
+            ROWS = rows;
+            COLS = cols;
+            seatConfig.floors = FLOORS;
+            seatConfig.rows = ROWS;
+            seatConfig.cols = COLS;
+        }
+    } else if (tag == "TODAY") {
+        // 日期范围只会向前滚动，不会因为时钟回拨而后退
+        iss >> value;
+        today = max(today, parseIsoDate(value));
+    } else if (tag == "W") {
+        // 候补：W 楼层 用户编号
+        int floor;
+        UserId user;
+        if (date != -1 && !state.archiving && iss >> floor >> user && floor >= 0 && floor <= FLOORS &&
+            user != NO_USER && !(findDay(date) && findDay(date)->waiting.count(user))) {
+            enqueueWaiter(date, floor - 1, user);
+        }
+    } else if (tag == "DAY") {
+        iss >> value;
+        date = parseIsoDate(value);
+        state.archiving = date != -1 && date < today;
+        if (date >= today + HORIZON_DAYS) {
+            date = -1;
+        }
+        state.changed = state.changed || state.archiving;
+    }
+}
+
+// 解析快照文件中的一个日期数据段（过去的日期写入 state 的归档记录）
+void parseSnapshotSection(const ColdDay &cold, LoadState &state) {
+    string text;
+    if (!readSnapshotSection(cold, text)) {
+        reportError("ERROR: Failed to load data for " + formatDate(cold.date) + ".");
+        return;
+    }
+    state.date = -1;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == string::npos) end = text.size();
+        parseDataLine(text.substr(start, end - start), state);
+        start = end + 1;
+    }
+}
+
+// 按需加载一个日期：从索引中移除后解析其数据段（加载不是修改，不记录日志，也不算作本次命令获得的座位）
+void loadColdDay(int date) {
+    ColdDay &slot = coldDays[date % HORIZON_DAYS];
+    if (slot.date != date) return;
+    ColdDay cold = slot;
+    slot.date = -1;
+    coldDayCount--;
+    PhaseScope phase(PHASE_LOAD);
+    bool savedRecord = recordChanges;
+    size_t acquired = acquiredSeats.size(), freed = freedSeats.size();
+    recordChanges = false;
+    LoadState state;
+    state.version = 4;
+    parseSnapshotSection(cold, state);
+    recordChanges = savedRecord;
+    acquiredSeats.resize(acquired);
+    freedSeats.resize(freed);
+    if (metricsEnabled) daysLoaded++;
+}
+
+// 加载所有尚未加载的日期（修改布局等需要遍历全部日期数据的操作之前调用）
+void loadAllDays() {
+    for (int date = today; coldDayCount > 0 && date < today + HORIZON_DAYS; date++) {
+        loadColdDay(date);
+    }
+}
+
+// ===================== 内存预算 =====================
+// 启动参数 --memory-budget 限制座位存储的内存占用。每条命令结束时检查：超出预算时先丢弃座位图缓存，
+// 仍超出时从最远的日期开始把已加载的日期卸载回快照文件（今天除外），之后再访问时重新按需加载。
+// 只有内存中的数据与快照文件一致（不在事务中、没有未写入的修改）时才卸载，卸载不会丢失修改。
+
+// 短字符串存放在对象内部，不占用堆
+uint64_t stringHeapBytes(const string &text) {
+    return text.capacity() > 15 ? text.capacity() + 1 : 0;
+}
+
+// 座位图缓存中的文本占用的字节数（文本用 std::string 存放，不经过计数分配器）
+uint64_t renderTextBytes() {
+    uint64_t bytes = stringHeapBytes(emptyFloorView.text);
+    for (const unique_ptr<DayData> &day : calendar) {
+        if (!day) continue;
+        for (const unique_ptr<FloorData> &floorData : day->floors) {
+            if (floorData) {
+                bytes += stringHeapBytes(floorData->userView.text) + stringHeapBytes(floorData->adminView.text);
+            }
+        }
+    }
+    return bytes;
+}
+
+// 当前的内存占用：计数分配器统计的各部分，加上座位图缓存文本和输出缓冲区
+uint64_t memoryInUse() {
+    uint64_t total = renderTextBytes() + stringHeapBytes(outputBuffer);
+    for (uint64_t bytes : memoryBytes) total += bytes;
+#ifdef _WIN32
+    total += stringHeapBytes(snapshotData);
+#endif
+    return total;
+}
+
+// 丢弃所有座位图缓存，之后显示时重新渲染
+void dropRenderCaches() {
+    RenderedView empty;
+    emptyFloorView = empty;
+    for (unique_ptr<DayData> &day : calendar) {
+        if (!day) continue;
+        for (unique_ptr<FloorData> &floorData : day->floors) {
+            if (floorData) {
+                floorData->userView = empty;
+                floorData->adminView = empty;
+            }
+        }
+    }
+}
+
+// 超出内存预算时释放缓存、卸载日期
+void enforceMemoryBudget() {
+    if (memoryBudget == 0 || memoryInUse() <= memoryBudget) return;
+    dropRenderCaches();
+    if (inTransaction || dataStamp.empty() || !journalSeats.empty() || !journalDays.empty() ||
+        !journalDroppedDays.empty() || !journalCheckIns.empty() || journalSnapshot) {
+        return;
+    }
+    for (auto it = snapshotIndex.rbegin(); it != snapshotIndex.rend() && memoryInUse() > memoryBudget; ++it) {
+        int slot = it->date % HORIZON_DAYS;
+        if (it->date == today || !loadedDay(it->date) || coldDays[slot].date == it->date) continue;
+        calendar[slot].reset();
+        removeTimers(it->date);
+        coldDays[slot] = *it;
+        coldDayCount++;
+        daysEvicted++;
+    }
+}
+
+// 解析字节数，可带 K、M、G 后缀（如 64M）
+// 返回: 字节数，格式错误时返回0
+uint64_t parseByteSize(const string &text) {
+    char *end = nullptr;
+    uint64_t value = strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) return 0;
+    string suffix = end;
+    if (suffix == "K" || suffix == "k") return value << 10;
+    if (suffix == "M" || suffix == "m") return value << 20;
+    if (suffix == "G" || suffix == "g") return value << 30;
+    return suffix.empty() ? value : 0;
+}
+
+// 进程的常驻内存（字节），无法获取时为0；与统计的合计之差即堆碎片、代码和其他未统计的内存
+uint64_t residentBytes() {
+#ifdef __linux__
+    ifstream statm("/proc/self/statm");
+    uint64_t pages = 0, resident = 0;
+    if (statm >> pages >> resident) {
+        return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+    }
+#endif
+    return 0;
+}
+
+// 管理员查看内存占用：各部分的字节数和块数、已加载的日期与每个座位的平均开销、内存预算
+void showMemory() {
+    PhaseScope phase(PHASE_EXECUTE);
+    uint64_t blocks = 0;
+    for (uint64_t count : memoryBlocks) blocks += count;
+    int loadedDays = 0;
+    uint64_t seats = 0;
+    for (const unique_ptr<DayData> &day : calendar) {
+        if (!day || !loadedDay(day->date)) continue;
+        loadedDays++;
+        for (const unique_ptr<FloorData> &floorData : day->floors) {
+            if (floorData) seats += floorData->seats.size();
+        }
+    }
+    char line[160];
+    outputBuffer += "component                 bytes     blocks\n";
+    for (int k = 0; k < MEM_COUNT; k++) {
+        uint64_t bytes = memoryBytes[k] + (k == MEM_CACHES ? renderTextBytes() : 0);
+        snprintf(line, sizeof(line), "%-16s %14llu %10llu\n", MEMORY_NAMES[k], (unsigned long long)bytes,
+                 (unsigned long long)memoryBlocks[k]);
+        outputBuffer += line;
+    }
+    snprintf(line, sizeof(line), "%-16s %14llu\n%-16s %14llu %10llu\n", "output buffer",
+             (unsigned long long)stringHeapBytes(outputBuffer), "total", (unsigned long long)memoryInUse(),
+             (unsigned long long)blocks);
+    outputBuffer += line;
+    snprintf(line, sizeof(line), "Peak: %llu bytes, process resident: %llu bytes\n",
+             (unsigned long long)memoryPeak, (unsigned long long)residentBytes());
+    outputBuffer += line;
+    snprintf(line, sizeof(line), "Days: %d loaded (%llu seats, %.1f bytes per seat), %d on disk\n", loadedDays,
+             (unsigned long long)seats, seats ? (double)(memoryBytes[MEM_SEATS] + memoryBytes[MEM_SLOTS]) / seats : 0.0,
+             coldDayCount);
+    outputBuffer += line;
+    if (memoryBudget == 0) {
+        outputBuffer += "Budget: unlimited\n";
+    } else {
+        snprintf(line, sizeof(line), "Budget: %llu bytes, %llu days unloaded to stay within it\n",
+                 (unsigned long long)memoryBudget, (unsigned long long)daysEvicted);
+        outputBuffer += line;
+    }
+    flushOutput();
+}
+
+// 初始化座位库
+// 释放所有日期的座位数据（全部座位恢复为空闲），并重新计算今天的日期
+void initializeLibrary() {
+    for (unique_ptr<DayData> &day : calendar) {
+        day.reset();
+    }
+    closeSnapshot();
+    freedSeats.clear();
+    today = currentDate();
+    resetTimerWheel(currentMinute());
+    // 更新座位配置结构体
+    seatConfig.floors = FLOORS;
+    seatConfig.rows = ROWS;
+    seatConfig.cols = COLS;
+}
+
+// 保存数据到文件
+// 文件格式：
+//   LIBRARY 4
+//   VERSION 版本号 写入标记    （写入标记由进程号和写入时间组成，用于判断文件是否已被其他进程改写）
+//   LAYOUT 楼层数 行数 列数
+//   TODAY YYYY-MM-DD
+//   INDEX 天数
+//   YYYY-MM-DD 起始位置 长度   （每个保存的日期一行，定宽，数据段在文件中的字节范围）
+//   DAY YYYY-MM-DD          （只保存存在预约或不可预约座位的日期，以下各行组成该日期的数据段）
+//   楼层 行 列 状态 用户编号   （只保存非空闲的座位，用户名见用户名表文件）
+//   楼层 行 列 P 用户编号 时间段（按时段预约，每条预约一行）
+//   W 楼层 用户编号          （候补，按加入顺序保存，楼层为0表示任意楼层）
+//   C 用户编号 截止时间       （签到截止时间，当天0点起的分钟数，-1 表示已签到）
+// 保存前先把本次命令空出的座位分配给候补用户；事务中只修改内存，提交时才写入。
+// 尚未加载的日期直接从快照文件复制原始数据段。
+// 先写入临时文件再替换原文件，写到一半失败时原文件不受影响
+void saveData() {
+    PhaseScope phase(PHASE_SAVE);
+    promoteWaitlist();
+    if (inTransaction) {
+        return;
+    }
+    releaseEmptyDays();
+
+    // 打开临时文件用于写入
+    string tempFile = DATA_FILE + ".tmp";
+    ofstream file(tempFile, ios::binary);
+    if (!file.is_open()) {
+        reportError("ERROR: Failed to save data.");
+        return;
+    }
+    if (metricsEnabled) fileOpensWrite++;
+
+    // 首先保存版本号、座位配置信息（楼层数、行数、列数）和今天的日期
+    file << "LIBRARY 4\n";
+    string versionLine = "VERSION " + to_string(++dataVersion) + ' ' + to_string(getpid()) + '.' +
+                         to_string(chrono::system_clock::now().time_since_epoch().count());
+    file << versionLine << "\n";
+    file << "LAYOUT " << FLOORS << " " << ROWS << " " << COLS << "\n";
+    file << "TODAY " << formatDate(today) << "\n";
+
+    // 日期索引先写入占位行，数据段写完后再回填
+    CountedVector<ColdDay, MEM_SNAPSHOT> sections;   // 写入的各日期数据段在新文件中的位置
+    for (int date = today; date < today + HORIZON_DAYS; date++) {
+        if (loadedDay(date) || coldDays[date % HORIZON_DAYS].date == date) {
+            sections.push_back(ColdDay{date, 0, 0});
+        }
+    }
+    file << "INDEX " << sections.size() << "\n";
+    streamoff indexStart = file.tellp();
+    file << string(sections.size() * INDEX_LINE_WIDTH, ' ');
+
+    // 然后按日期顺序保存所有非空闲座位
+    string coldText;
+    for (ColdDay &section : sections) {
+        int date = section.date;
+        section.offset = (uint64_t)file.tellp();
+        DayData *day = loadedDay(date);
+        if (!day) {
+            // 未加载的日期：复制快照文件中的原始数据段
+            if (!readSnapshotSection(coldDays[date % HORIZON_DAYS], coldText)) {
+                file.close();
+                remove(tempFile.c_str());
+                reportError("ERROR: Failed to save data.");
+                return;
+            }
+            file << coldText;
+            section.length = (uint32_t)((uint64_t)file.tellp() - section.offset);
+            continue;
+        }
+        file << "DAY " << formatDate(date) << "\n";
+        forEachOccupiedSeat(*day, [&](int f, int i) {
+            FloorData &floorData = *day->floors[f];
+            const Seat &seat = floorData.seats[i];
+            int r = i / COLS, c = i % COLS;
+            if (seat.status == PARTIAL) {
+                for (const SlotBooking &booking : floorData.slotBookings[(uint32_t)i]) {
+                    file << (f + 1) << ' ' << (r + 1) << ' ' << (c + 1) << ' ' << PARTIAL << ' '
+                         << booking.user << ' ' << formatTimeRange(booking.slots) << '\n';
+                }
+            } else {
+                writeSeatLine(file, f, r, c, seat);
+            }
+        });
+        // 有效的候补按加入顺序保存
+        if (!day->waiting.empty()) {
+            vector<pair<uint64_t, UserId>> waiters;
+            for (const auto &entry : day->waiting) {
+                waiters.push_back({entry.second.seq, entry.first});
+            }
+            sort(waiters.begin(), waiters.end());
+            for (const auto &waiter : waiters) {
+                file << "W " << (day->waiting[waiter.second].floor + 1) << ' ' << waiter.second << '\n';
+            }
+        }
+        // 仍有预约的用户的签到状态
+        vector<pair<UserId, int>> checkIns;
+        for (const auto &entry : day->checkInDeadlines) {
+            if (day->userSeat.count(entry.first) || day->userSlot.count(entry.first)) {
+                checkIns.push_back(entry);
+            }
+        }
+        sort(checkIns.begin(), checkIns.end());
+        for (const auto &checkIn : checkIns) {
+            file << "C " << checkIn.first << ' ' << checkIn.second << '\n';
+        }
+        section.length = (uint32_t)((uint64_t)file.tellp() - section.offset);
+    }
+
+    // 记录写入的字节数，回填日期索引并关闭文件
+    if (metricsEnabled) bytesWritten += (uint64_t)file.tellp();
+    file.seekp(indexStart);
+    for (const ColdDay &section : sections) {
+        char entry[INDEX_LINE_WIDTH + 1];
+        snprintf(entry, sizeof(entry), "%s %016llu %010u\n", formatDate(section.date).c_str(),
+                 (unsigned long long)section.offset, (unsigned)section.length);
+        file.write(entry, INDEX_LINE_WIDTH);
+    }
+    file.close();
+    if (file.fail()) {
+        remove(tempFile.c_str());
+        reportError("ERROR: Failed to save data.");
+        return;
+    }
+#ifndef _WIN32
+    // 新文件替换原文件之前打开，之后按需加载从新文件读取
+    ifstream snapshot(tempFile, ios::binary);
+#endif
+    // 用临时文件替换原文件（Windows 下 rename 不能覆盖已有文件，需先删除）
+    if (rename(tempFile.c_str(), DATA_FILE.c_str()) != 0) {
+        remove(DATA_FILE.c_str());
+        if (rename(tempFile.c_str(), DATA_FILE.c_str()) != 0) {
+            reportError("ERROR: Failed to save data.");
+            return;
+        }
+    }
+    // 仍未加载的日期改为指向新文件中的数据段
+    coldDayCount = 0;
+    for (const ColdDay &section : sections) {
+        ColdDay &cold = coldDays[section.date % HORIZON_DAYS];
+        if (cold.date == section.date) {
+            cold = section;
+            coldDayCount++;
+        }
+    }
+    // 有内存预算时即使全部日期都已加载也保留快照文件，超出预算时可以把日期卸载回去
+    if (coldDayCount == 0 && memoryBudget == 0) {
+        closeSnapshot();
+    } else {
+#ifdef _WIN32
+        ifstream snapshot(DATA_FILE, ios::binary);
+        snapshotData.assign(istreambuf_iterator<char>(snapshot), istreambuf_iterator<char>());
+#else
+        snapshotFile = move(snapshot);
+#endif
+        snapshotIndex.swap(sections);
+    }
+    dataStamp = versionLine;
+    // 把本次的修改写入变更记录，并发送给备用进程
+    appendChanges();
+    appendJournal();
+    clearJournalPending();
+}
+
+// 读取数据文件当前的版本号（只读取文件开头），文件不存在时为0
+uint64_t readDataVersion() {
+    ifstream file(DATA_FILE);
+    string line;
+    getline(file, line);
+    if (getline(file, line) && line.compare(0, 8, "VERSION ") == 0) {
+        return strtoull(line.c_str() + 8, nullptr, 10);
+    }
+    return 0;
+}
+
+// 内存中的数据是否仍与数据文件一致：文件的版本行与最近一次加载或写入时相同、
+// 内存中没有未写入的修改、日期也没有变化时，命令无需重新加载数据（座位图缓存因此得以跨命令保留）
+bool dataFileUnchanged() {
+    if (dataStamp.empty() || currentDate() > today || !journalSeats.empty() || !journalDays.empty() ||
+        !journalDroppedDays.empty() || !journalCheckIns.empty() || journalSnapshot) {
+        return false;
+    }
+    ifstream file(DATA_FILE);
+    if (metricsEnabled) fileOpensRead++;
+    string line;
+    return getline(file, line) && getline(file, line) && line == dataStamp;
+}
+
+// 读取旧版数据文件（第一行为"楼层数 行数 列数"，随后按 星期一到星期日、楼层、行、列
+// 的顺序每行保存一个座位的状态和用户），星期映射到从今天起最近的对应日期
+// 返回: 读取的字节数
+uint64_t loadLegacyData(ifstream &file, const string &header) {
+    uint64_t lineBytes = header.size() + 1;
+    istringstream iss(header);
+    int floors, rows, cols;
+    if (iss >> floors >> rows >> cols) {
+        // 更新全局配置变量
+        FLOORS = floors;
+        ROWS = rows;
+        COLS = cols;
+    }
+    initializeLibrary();
+
+    string line;
+    for (int d = 0; d < NUM_DAYS; d++) {
+        int date = today + (d - weekdayOf(today) + NUM_DAYS) % NUM_DAYS;
+        for (int f = 0; f < FLOORS; f++) {
+            for (int r = 0; r < ROWS; r++) {
+                for (int c = 0; c < COLS; c++) {
+                    if (getline(file, line)) {
+                        lineBytes += line.size() + 1;
+                        // 读取座位状态和用户标识，只保留非空闲的座位
+                        if (line.length() >= 2 && line[0] != EMPTY) {
+                            UserId user = line[0] == RESERVED ? internUser(string(1, line[1])) : NO_USER;
+                            // 旧版文件可能违反"同一用户同一天只能预约一个座位"，保留第一个
+                            if (user == NO_USER || !findDay(date) || !findDay(date)->userSeat.count(user)) {
+                                setSeat(date, f, r, c, line[0], user);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return lineBytes;
+}
+
+// 从文件加载数据
+// 从指定的数据文件中读取座位配置和座位信息；已经过去的日期会被追加到历史归档文件，
+// 并从数据文件中移除。带日期索引的文件只读取文件头、索引和今天的数据，其余日期按需加载
+void loadData() {
+    PhaseScope phase(PHASE_LOAD);
+    // 加载本身不是修改，不记录
+    recordChanges = false;
+    struct RecordGuard {
+        ~RecordGuard() { recordChanges = true; }
+    } recordGuard;
+    dataStamp.clear();
+    // 以二进制方式打开，索引中的起始位置是字节偏移（Windows 下写出的旧文件行尾的 \r 逐行去掉）
+    ifstream file(DATA_FILE, ios::binary);
+    if (!file.is_open()) {
+        // 如果文件不存在，初始化数据
+        initializeLibrary();
+        return;
+    }
+    if (metricsEnabled) fileOpensRead++;
+
+    // 读入其他进程新增的用户
+    loadUsers();
+
+    string line;
+    uint64_t lineBytes = 0;   // 已读取的字节数（用于统计）
+    if (!getline(file, line)) {
+        initializeLibrary();
+        return;
+    }
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.compare(0, 7, "LIBRARY") != 0) {
+        // 旧版格式，读取后立即以新格式保存
+        lineBytes = loadLegacyData(file, line);
+        if (metricsEnabled) bytesRead += lineBytes;
+        file.close();
+        saveData();
+        return;
+    }
+    lineBytes += line.size() + 1;
+    LoadState state;
+    state.version = atoi(line.c_str() + 7);
+    initializeLibrary();
+    dataVersion = 0;
+
+    vector<ColdDay> pastDays;   // 索引中已经过去、需要归档的日期
+    bool indexed = false;
+    while (getline(file, line)) {
+        lineBytes += line.size() + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.compare(0, 6, "INDEX ") != 0) {
+            parseDataLine(line, state);
+            continue;
+        }
+        // 日期索引：之后的内容全部是各日期的数据段，按需读取
+        int count = atoi(line.c_str() + 6);
+        for (int k = 0; k < count && getline(file, line); k++) {
+            lineBytes += line.size() + 1;
+            char dateText[16];
+            unsigned long long offset;
+            unsigned length;
+            if (sscanf(line.c_str(), "%15s %llu %u", dateText, &offset, &length) != 3) continue;
+            ColdDay cold;
+            cold.date = parseIsoDate(dateText);
+            cold.offset = offset;
+            cold.length = length;
+            if (cold.date == -1 || cold.date >= today + HORIZON_DAYS) continue;
+            if (cold.date < today) {
+                pastDays.push_back(cold);
+            } else if (coldDays[cold.date % HORIZON_DAYS].date != cold.date) {
+                coldDays[cold.date % HORIZON_DAYS] = cold;
+                coldDayCount++;
+                snapshotIndex.push_back(cold);
+            }
+        }
+        indexed = true;
+        break;
+    }
+    if (metricsEnabled) bytesRead += lineBytes;
+
+    if (indexed) {
+        // 保留快照文件供按需加载和保存时复制未加载的日期
+#ifdef _WIN32
+        file.clear();
+        file.seekg(0);
+        snapshotData.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        file.close();
+#else
+        snapshotFile = move(file);
+#endif
+        for (const ColdDay &cold : pastDays) {
+            parseSnapshotSection(cold, state);
+        }
+        state.changed = state.changed || !pastDays.empty();
+        // 今天的签到截止时间可能已经到期，立即加载
+        loadColdDay(today);
+    } else {
+        file.close();
+    }
+
+    // 过去的日期已归档，重新保存以从数据文件中移除
+    if (state.changed) {
+        appendHistory(state.archive, HISTORY_ROLLOVER);
+        saveData();
+    }
+}
+
+
+// ===================== 日志复制：写出与应用 =====================
+
+// 写出某个座位（0-based）当前的映像
+void writeSeatRecord(string &out, int date, int floor, int row, int col) {
+    FloorData *floorData = findFloor(date, floor);
+    Seat seat = floorData ? floorData->seats[row * COLS + col] : EMPTY_SEAT;
+    string prefix = formatDate(date) + ' ' + to_string(floor + 1) + ' ' + to_string(row + 1) + ' ' +
+                    to_string(col + 1) + ' ';
+    if (seat.status == PARTIAL) {
+        out += "S " + prefix + EMPTY + " 0\n";
+        for (const SlotBooking &booking : floorData->slotBookings[(uint32_t)(row * COLS + col)]) {
+            out += "B " + prefix + to_string(booking.user) + ' ' + formatTimeRange(booking.slots) + '\n';
+        }
+    } else {
+        out += "S " + prefix + (char)seat.status + ' ' + to_string(seat.user) + '\n';
+    }
+}
+
+// 写出某一天当前的候补队列（按加入顺序）
+void writeWaitlistRecord(string &out, DayData &day) {
+    out += "Q " + formatDate(day.date) + '\n';
+    vector<pair<uint64_t, UserId>> waiters;
+    for (const auto &entry : day.waiting) {
+        waiters.push_back({entry.second.seq, entry.first});
+    }
+    sort(waiters.begin(), waiters.end());
+    for (const auto &waiter : waiters) {
+        out += "W " + formatDate(day.date) + ' ' + to_string(day.waiting[waiter.second].floor + 1) + ' ' +
+               to_string(waiter.second) + '\n';
+    }
+}
+
+// 写出某个预约当前的签到状态，已失效（被释放）时省略截止时间
+void writeCheckInRecord(string &out, DayData &day, UserId user) {
+    out += "C " + formatDate(day.date) + ' ' + to_string(user);
+    auto it = day.checkInDeadlines.find(user);
+    if (it != day.checkInDeadlines.end()) {
+        out += ' ' + to_string(it->second);
+    }
+    out += '\n';
+}
+
+// 写出完整快照：清空并设置布局，然后写出所有非空闲座位、候补和仍有预约的用户的签到状态
+void writeSnapshotRecords(string &out) {
+    out += "R " + to_string(FLOORS) + ' ' + to_string(ROWS) + ' ' + to_string(COLS) + '\n';
+    for (int date = today; date < today + HORIZON_DAYS; date++) {
+        DayData *day = findDay(date);
+        if (!day) continue;
+        forEachOccupiedSeat(*day, [&](int f, int i) {
+            writeSeatRecord(out, date, f, i / COLS, i % COLS);
+        });
+        if (!day->waiting.empty()) {
+            writeWaitlistRecord(out, *day);
+        }
+        vector<UserId> users;
+        for (const auto &entry : day->checkInDeadlines) {
+            if (day->userSeat.count(entry.first) || day->userSlot.count(entry.first)) {
+                users.push_back(entry.first);
+            }
+        }
+        sort(users.begin(), users.end());
+        for (UserId user : users) {
+            writeCheckInRecord(out, *day, user);
+        }
+    }
+}
+
+// 读取日志文件的代数（第一行），文件不存在或为空时返回0
+uint64_t journalGeneration(const string &path) {
+    ifstream file(path);
+    string line;
+    if (getline(file, line) && line.compare(0, 8, "JOURNAL ") == 0) {
+        return strtoull(line.c_str() + 8, nullptr, 10);
+    }
+    return 0;
+}
+
+// 把本次写入的修改追加到日志（在数据文件写入成功后调用）
+// 日志不存在、超过 JOURNAL_COMPACT_BYTES 或 fullSnapshot 为真时改为写入新一代的完整快照
+void appendJournal(bool fullSnapshot) {
+    if (replicationDir.empty()) return;
+    string path = replicationDir + "/" + JOURNAL_FILE;
+    uint64_t generation = journalGeneration(path);
+    ifstream existing(path, ios::binary | ios::ate);
+    uint64_t size = existing.is_open() ? (uint64_t)existing.tellg() : 0;
+    existing.close();
+    bool rewrite = fullSnapshot || generation == 0 || size > JOURNAL_COMPACT_BYTES;
+
+    string block = "V " + to_string(dataVersion) + ' ' + formatDate(today) + '\n';
+    // 新用户（完整快照时写出全部用户）
+    for (size_t id = rewrite ? 1 : journalUsers; id < userNames.size(); id++) {
+        block += "U " + to_string(id) + ' ' + userNames[id] + '\n';
+    }
+    journalUsers = userNames.size();
+    if (rewrite || journalSnapshot) {
+        writeSnapshotRecords(block);
+    } else {
+        for (int date : journalDroppedDays) {
+            block += "D " + formatDate(date) + '\n';
+        }
+        sort(journalSeats.begin(), journalSeats.end());
+        journalSeats.erase(unique(journalSeats.begin(), journalSeats.end()), journalSeats.end());
+        for (const auto &seat : journalSeats) {
+            int index = (int)seat.second;
+            writeSeatRecord(block, seat.first, index / (ROWS * COLS), index / COLS % ROWS, index % COLS);
+            journalDays.push_back(seat.first);
+        }
+        sort(journalDays.begin(), journalDays.end());
+        journalDays.erase(unique(journalDays.begin(), journalDays.end()), journalDays.end());
+        for (int date : journalDays) {
+            DayData *day = findDay(date);
+            if (day) {
+                writeWaitlistRecord(block, *day);
+            } else if (date >= today) {
+                block += "Q " + formatDate(date) + '\n';
+            }
+        }
+        // 签到状态写在座位之后，备用进程应用时预约已经存在
+        sort(journalCheckIns.begin(), journalCheckIns.end());
+        journalCheckIns.erase(unique(journalCheckIns.begin(), journalCheckIns.end()), journalCheckIns.end());
+        for (const auto &checkIn : journalCheckIns) {
+            DayData *day = findDay(checkIn.first);
+            if (day) writeCheckInRecord(block, *day, checkIn.second);
+        }
+    }
+    clearJournalPending();
+    // 没有任何修改时不写入空块
+    if (!rewrite && block.find('\n') + 1 == block.size()) {
+        return;
+    }
+    block += "E\n";
+
+    if (rewrite) {
+        // 新一代日志先写入临时文件再替换，备用进程发现代数变化后从头重放
+        string tempPath = path + ".tmp";
+        ofstream file(tempPath, ios::binary);
+        file << "JOURNAL " << (generation + 1) << '\n' << block;
+        file.close();
+        if (file.fail() || (rename(tempPath.c_str(), path.c_str()) != 0 &&
+                            (remove(path.c_str()), rename(tempPath.c_str(), path.c_str()) != 0))) {
+            reportError("ERROR: Failed to write journal.");
+        }
+        return;
+    }
+    // 整块一次写入，多个主进程同时追加时块不会交错
+    ofstream file(path, ios::binary | ios::app);
+    file.write(block.data(), (streamsize)block.size());
+    file.close();
+    if (file.fail()) {
+        reportError("ERROR: Failed to write journal.");
+    }
+}
+
+// 主进程启动复制：记录进程号，并立即写入新一代的完整快照，
+// 备用进程据此从头重放，在主进程第一次修改之前就已预热
+void startReplication() {
+    ofstream pidFile(replicationDir + "/" + LEADER_PID_FILE);
+    pidFile << getpid() << '\n';
+    pidFile.close();
+    appendJournal(true);
+}
+
+// 主进程正常退出时删除进程号文件（文件已被之后启动的主进程改写时保留），备用进程随即接管
+void stopReplication() {
+    if (replicationDir.empty()) return;
+    string path = replicationDir + "/" + LEADER_PID_FILE;
+    ifstream pidFile(path);
+    int pid = 0;
+    if (pidFile >> pid && pid == (int)getpid()) {
+        pidFile.close();
+        remove(path.c_str());
+    }
+}
+
+// 判断进程是否仍在运行
+// Windows 下无法直接检测，只在主进程正常退出（删除进程号文件）后接管
+bool processAlive(int pid) {
+#ifdef _WIN32
+    (void)pid;
+    return true;
+#else
+    return kill(pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+// 备用进程：应用一条日志记录
+void applyJournalRecord(const string &line) {
+    istringstream iss(line);
+    string tag, dateText;
+    iss >> tag;
+    if (tag == "V") {
+        uint64_t version;
+        iss >> version >> dateText;
+        dataVersion = version;
+        today = max(today, parseIsoDate(dateText));
+        return;
+    }
+    if (tag == "U") {
+        size_t id;
+        string name;
+        if (iss >> id >> name && id == userNames.size()) {
+            ofstream file(USERS_FILE, ios::app);
+            file << name << '\n';
+            file.close();
+            loadUsers();
+        }
+        return;
+    }
+    if (tag == "R") {
+        int floors, rows, cols;
+        if (iss >> floors >> rows >> cols && floors > 0 && rows > 0 && cols > 0) {
+            FLOORS = floors;
+            ROWS = rows;
+            COLS = cols;
+            int savedToday = today;
+            initializeLibrary();
+            today = max(today, savedToday);
+        }
+        return;
+    }
+    iss >> dateText;
+    int date = parseIsoDate(dateText);
+    if (date < today || date >= today + HORIZON_DAYS) return;
+    if (tag == "D") {
+        if (findDay(date)) calendar[date % HORIZON_DAYS].reset();
+    } else if (tag == "Q") {
+        DayData *day = findDay(date);
+        if (day) {
+            day->waitlists.clear();
+            day->waiting.clear();
+        }
+    } else if (tag == "W") {
+        int floor;
+        UserId user;
+        if (iss >> floor >> user && floor >= 0 && floor <= FLOORS) {
+            enqueueWaiter(date, floor - 1, user);
+        }
+    } else if (tag == "C") {
+        // 签到状态：未签到的预约加入定时器轮，接管后按时释放
+        DayData *day = findDay(date);
+        UserId user;
+        int deadline;
+        if (!day || !(iss >> user)) return;
+        if (iss >> deadline) {
+            day->checkInDeadlines[user] = deadline;
+            if (deadline != CHECKED_IN) addTimer({date * 1440 + deadline, date, user});
+        } else {
+            day->checkInDeadlines.erase(user);
+        }
+    } else if (tag == "S" || tag == "B") {
+        int f, r, c;
+        UserId user;
+        string status;
+        if (!(iss >> f >> r >> c) || f < 1 || f > FLOORS || r < 1 || r > ROWS || c < 1 || c > COLS) return;
+        if (tag == "S" && iss >> status >> user && status.size() == 1) {
+            setSeat(date, f - 1, r - 1, c - 1, status[0], user);
+        } else if (tag == "B" && iss >> user >> status) {
+            SlotMask slots = parseTimeRange(status);
+            if (slots != 0) bookSlots(date, f - 1, r - 1, c - 1, user, slots);
+        }
+    }
+}
+
+// 备用进程：持续读取日志并应用，直到主进程退出后接管
+// 参数: dir - 主进程的日志目录
+void followLeader(const string &dir) {
+    string path = dir + "/" + JOURNAL_FILE;
+    cout << "Following " << dir << "..." << endl;
+
+    // 备用进程的用户名表完全来自日志，先清空本地的用户名表
+    ofstream(USERS_FILE, ios::trunc).close();
+    userNames.assign(1, "");
+    userIds.clear();
+    usersFileOffset = 0;
+    initializeLibrary();
+    recordChanges = false;
+
+    uint64_t generation = 0;      // 正在应用的日志代数
+    streamoff offset = 0;         // 已应用到的位置（总是某个完整块的末尾）
+    while (true) {
+        // 日志被压缩重写后从头重放
+        uint64_t current = journalGeneration(path);
+        if (current != generation) {
+            generation = current;
+            offset = 0;
+            initializeLibrary();
+        }
+        bool progressed = false;
+        ifstream file(path, ios::binary);
+        if (file.is_open() && generation != 0) {
+            file.seekg(offset);
+            string line;
+            vector<string> block;
+            streamoff position = offset;
+            while (getline(file, line)) {
+                if (file.eof()) break;   // 最后一行尚未写完整
+                position = file.tellg();
+                if (line.compare(0, 8, "JOURNAL ") == 0) {
+                    offset = position;
+                    continue;
+                }
+                block.push_back(line);
+                if (line == "E") {
+                    for (const string &record : block) {
+                        applyJournalRecord(record);
+                    }
+                    // 候补的分配结果已包含在日志中，备用进程不自行分配
+                    freedSeats.clear();
+                    block.clear();
+                    offset = position;
+                    progressed = true;
+                }
+            }
+        }
+        file.close();
+        if (progressed) continue;
+
+        // 没有新的日志时检查主进程是否仍在运行
+        ifstream pidFile(dir + "/" + LEADER_PID_FILE);
+        int pid = 0;
+        bool leaderAlive = (pidFile >> pid) && pid > 0 && processAlive(pid);
+        if (!leaderAlive && generation != 0) {
+            break;
+        }
+        this_thread::sleep_for(chrono::milliseconds(20));
+    }
+
+    // 接管：把内存中的数据写入本地数据文件，之后按普通方式运行
+    cout << "Leader stopped, taking over at version " << dataVersion << "." << endl;
+    recordChanges = true;
+    clearJournalPending();
+    saveData();
+}
+
+// ===================== 变更记录 =====================
+// 每次写入数据文件后，把本次修改过的座位追加到变更记录文件，版本号即数据文件的版本号。
+// 客户端记住上次看到的版本号，之后用 "Changes since 版本号" 只取回变化的座位，
+// 或用 "Version 日期 Floor n" 查询某天某层最后一次变化的版本号，不必反复读取整层座位图。
+// 文件格式（每行一条记录，同一版本的记录一次写入）：
+//   CHANGES 起始版本号                （文件只包含之后的全部变化，更早的变化已丢弃）
+//   版本号 S 日期 楼层 行 列 状态 用户编号 （座位的新状态，PARTIAL 座位的用户编号为0）
+//   版本号 D 日期                      （整天被清空）
+//   版本号 R                           （布局变化或清空全部数据，客户端需要重新读取）
+string CHANGES_FILE = "library_changes.log";
+const uint64_t CHANGES_COMPACT_BYTES = 1 << 20;   // 变更记录超过该大小时从当前版本重新开始
+
+// 一条变更记录（楼层、行、列为 0-based）
+struct ChangeRecord {
+    uint64_t version;
+    char type;            // S、D 或 R
+    int date;
+    int floor;
+    int row;
+    int col;
+    Seat seat;
+};
+
+CountedVector<ChangeRecord, MEM_JOURNAL> changeRecords;   // 已读入的变更记录（按版本号递增）
+uint64_t changesBase = 0;                     // 变更记录文件的起始版本号
+uint64_t changesVersion = 0;                  // 已读入的最新版本号（不小于起始版本号）
+streamoff changesFileOffset = 0;              // 已读取到的位置
+CountedMap<uint64_t, uint64_t, MEM_JOURNAL> floorVersions;   // 各（日期，楼层）最后一次变化的版本号
+CountedMap<int, uint64_t, MEM_JOURNAL> dayClearVersions;     // 各日期最后一次被整天清空的版本号
+uint64_t resyncVersion = 0;                   // 最后一次需要重新读取全部数据的版本号
+
+// 某天某层（0-based）在 floorVersions 中的键
+uint64_t floorVersionKey(int date, int floor) {
+    return (uint64_t)(uint32_t)date << 32 | (uint32_t)floor;
+}
+
+// 把本次写入修改过的座位追加到变更记录文件（在 saveData 写入数据文件后调用）
+void appendChanges() {
+    if (journalSeats.empty() && journalDroppedDays.empty() && !journalSnapshot) return;
+    string prefix = to_string(dataVersion) + ' ';
+    string block;
+    for (int date : journalDroppedDays) {
+        block += prefix + "D " + formatDate(date) + '\n';
+    }
+    if (journalSnapshot) {
+        block += prefix + "R\n";
+    } else {
+        sort(journalSeats.begin(), journalSeats.end());
+        journalSeats.erase(unique(journalSeats.begin(), journalSeats.end()), journalSeats.end());
+        for (const auto &entry : journalSeats) {
+            int index = (int)entry.second;
+            int floor = index / (ROWS * COLS), row = index / COLS % ROWS, col = index % COLS;
+            if (entry.first < today || floor >= FLOORS) continue;
+            Seat seat = seatAt(entry.first, floor, row, col);
+            block += prefix + "S " + formatDate(entry.first) + ' ' + to_string(floor + 1) + ' ' +
+                     to_string(row + 1) + ' ' + to_string(col + 1) + ' ' + (char)seat.status + ' ' +
+                     to_string(seat.status == PARTIAL ? NO_USER : (UserId)seat.user) + '\n';
+        }
+    }
+
+    // 文件不存在或过大时，从本版本重新开始（先写临时文件再替换）
+    ifstream existing(CHANGES_FILE, ios::binary | ios::ate);
+    uint64_t size = existing.is_open() ? (uint64_t)existing.tellg() : 0;
+    existing.close();
+    if (size == 0 || size > CHANGES_COMPACT_BYTES) {
+        string tempPath = CHANGES_FILE + ".tmp";
+        ofstream file(tempPath, ios::binary);
+        file << "CHANGES " << (dataVersion - 1) << '\n' << block;
+        file.close();
+        if (file.fail() || (rename(tempPath.c_str(), CHANGES_FILE.c_str()) != 0 &&
+                            (remove(CHANGES_FILE.c_str()), rename(tempPath.c_str(), CHANGES_FILE.c_str()) != 0))) {
+            reportError("ERROR: Failed to write changes.");
+        }
+        return;
+    }
+    // 整块一次写入，多个进程同时追加时不会交错
+    ofstream file(CHANGES_FILE, ios::binary | ios::app);
+    file.write(block.data(), (streamsize)block.size());
+    file.close();
+    if (file.fail()) {
+        reportError("ERROR: Failed to write changes.");
+    }
+}
+
+// 增量读入变更记录文件中新增的记录；文件被其他进程重新开始时从头读取
+void loadChanges() {
+    ifstream file(CHANGES_FILE, ios::binary);
+    string header;
+    uint64_t base = 0;
+    if (!file.is_open() || !getline(file, header) || sscanf(header.c_str(), "CHANGES %" SCNu64, &base) != 1) {
+        // 还没有变更记录：从数据文件的当前版本开始
+        changeRecords.clear();
+        floorVersions.clear();
+        dayClearVersions.clear();
+        changesBase = changesVersion = resyncVersion = dataVersion;
+        changesFileOffset = 0;
+        return;
+    }
+    file.seekg(0, ios::end);
+    streamoff size = file.tellg();
+    if (base != changesBase || changesFileOffset == 0 || size < changesFileOffset) {
+        changeRecords.clear();
+        floorVersions.clear();
+        dayClearVersions.clear();
+        changesBase = changesVersion = resyncVersion = base;
+        changesFileOffset = (streamoff)header.size() + 1;
+    }
+    if (size <= changesFileOffset) return;
+
+    // 只处理完整的行，写到一半的行留到下次读取
+    string text((size_t)(size - changesFileOffset), '\0');
+    file.seekg(changesFileOffset);
+    file.read(&text[0], (streamsize)text.size());
+    size_t end = text.rfind('\n');
+    if (end == string::npos) return;
+    changesFileOffset += (streamoff)end + 1;
+    istringstream lines(text.substr(0, end + 1));
+    string line;
+    while (getline(lines, line)) {
+        istringstream iss(line);
+        ChangeRecord record = {};
+        string value;
+        if (!(iss >> record.version >> record.type)) continue;
+        if (record.type == 'S') {
+            char status;
+            UserId user;
+            if (!(iss >> value >> record.floor >> record.row >> record.col >> status >> user)) continue;
+            record.date = parseIsoDate(value);
+            record.floor--;
+            record.row--;
+            record.col--;
+            record.seat = {(uint32_t)(unsigned char)status, user};
+            uint64_t &version = floorVersions[floorVersionKey(record.date, record.floor)];
+            version = max(version, record.version);
+        } else if (record.type == 'D') {
+            if (!(iss >> value)) continue;
+            record.date = parseIsoDate(value);
+            uint64_t &version = dayClearVersions[record.date];
+            version = max(version, record.version);
+        } else if (record.type == 'R') {
+            resyncVersion = max(resyncVersion, record.version);
+        } else {
+            continue;
+        }
+        changesVersion = max(changesVersion, record.version);
+        changeRecords.push_back(record);
+    }
+}
+
+// 某天某层（0-based）最后一次变化的版本号（变更记录开始之前的变化按起始版本号计）
+uint64_t floorVersion(int date, int floor) {
+    uint64_t version = max(changesBase, resyncVersion);
+    auto it = floorVersions.find(floorVersionKey(date, floor));
+    if (it != floorVersions.end()) version = max(version, it->second);
+    auto dayIt = dayClearVersions.find(date);
+    if (dayIt != dayClearVersions.end()) version = max(version, dayIt->second);
+    return version;
+}
+
+// 检查用户名是否合法
+// 参数: username - 待验证的用户名字符串
+// 返回: 若用户名长度为1-32且只包含字母、数字和下划线则返回true，否则返回false
+bool isValidUsername(const string &username) {
+    if (username.empty() || username.length() > MAX_USERNAME_LENGTH) {
+        return false;
+    }
+    for (char c : username) {
+        if (!isalnum((unsigned char)c) && c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 是否已有用户（或管理员）登录
+bool isLoggedIn() {
+    return isAdmin || currentUser != NO_USER;
+}
+
+// 登录功能
+// 允许用户输入用户名进行登录，支持普通用户和管理员登录
+void login() {
+    PhaseScope phase(PHASE_EXECUTE);
+    string username;
+    cout << "Please enter username" << endl;
+    cin >> username;
+    // 清除输入缓冲区中的换行符，防止getline读取到空行
+    cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+    // 验证用户名是否只包含字母、数字和下划线
+    if (!isValidUsername(username)) {
+        reportError("ERROR: Username must be 1-32 letters, digits or underscores.");
+        return;
+    }
+
+    // 处理管理员登录
+    if (username == "Admin") {
+        string password;
+        cout << "Please enter password" << endl;
+        cin >> password;
+        // 清除输入缓冲区中的换行符
+        cin.ignore(numeric_limits<streamsize>::max(), '\n');
+        if (password == "666") {
+            currentUser = NO_USER; // 管理员不占用用户编号
+            isAdmin = true;
+            cout << "Login successful." << endl;
+        } else {
+            cout << "Incorrect password, login failed." << endl;
+        }
+    } else {
+        // 处理普通用户登录，新用户自动加入用户名表
+        UserId id = internUser(normalizeUsername(username));
+        if (id != NO_USER) {
+            currentUser = id;
+            isAdmin = false;
+            cout << "Login successful." << endl;
+        } else {
+            reportError("ERROR: Failed to register user.");
+        }
+    }
+}
+
+// 退出登录
+// 清除当前用户的登录状态并保存数据
+void exitLogin() {
+    PhaseScope phase(PHASE_EXECUTE);
+    currentUser = NO_USER;
+    isAdmin = false;
+    cout << "Logged out." << endl;
+    // 保存数据以确保所有更改被持久化
+    saveData();
+}
+
+// 查找日期对应的日期编号
+// 参数: day - 星期名称（表示从今天起最近的那一天，今天也算）或 YYYY-MM-DD 格式的日期
+// 返回: 日期编号，若日期无效或不在可预约范围内则返回-1
+int getDate(const string &day) {
+    // 星期名称通过哈希表直接查找
+    auto it = WEEKDAY_INDEX.find(day);
+    if (it != WEEKDAY_INDEX.end()) {
+        return today + (it->second - weekdayOf(today) + NUM_DAYS) % NUM_DAYS;
+    }
+    // 具体日期直接换算，并检查是否在可预约范围内
+    int date = parseIsoDate(day);
+    if (date < today || date >= today + HORIZON_DAYS) {
+        return -1;
+    }
+    return date;
+}
+
+// 计算座位在当前登录用户视角下显示的字符
+// 参数: seat - 座位
+// 返回: 不可预约显示X；管理员看到预约者用户名的首字母（大写）；普通用户的自己的预约显示2
+char seatDisplayChar(const Seat &seat) {
+    // 所有用户都能看到不可预约状态
+    if (seat.status == UNAVAILABLE) {
+        return UNAVAILABLE;
+    }
+    if (isAdmin) {
+        // 管理员可以看到所有用户的预约信息
+        return seat.status == RESERVED ? (char)toupper((unsigned char)userName(seat.user)[0]) : (char)seat.status;
+    }
+    // 普通用户只能看到自己的预约和空闲/已预约状态
+    return (seat.status == RESERVED && seat.user == currentUser) ? CURRENT_USER : (char)seat.status;
+}
+
+// 把一行座位的显示字符写入输出缓冲区
+// 紧凑模式下连续相同的字符合并为"字符*个数"，各段以空格分隔
+void appendGridRow(const char *row, int cols) {
+    if (compactGrid) {
+        int c = 0;
+        while (c < cols) {
+            char ch = row[c];
+            int run = 1;
+            while (c + run < cols && row[c + run] == ch) {
+                run++;
+            }
+            if (c > 0) outputBuffer += ' ';
+            outputBuffer += ch;
+            if (run > 1) {
+                outputBuffer += '*';
+                outputBuffer += to_string(run);
+            }
+            c += run;
+        }
+    } else {
+        outputBuffer.append(row, cols);
+    }
+    outputBuffer += '\n';
+}
+
+// 渲染整层的座位图并存入缓存（不含当前用户自己的座位）
+// 参数: floorData - 楼层数据，为空表示全部空闲；admin - 是否为管理员视角
+void renderFloorView(const FloorData *floorData, bool admin, RenderedView &view) {
+    view.text.clear();
+    view.rowStarts.clear();
+    view.rows = ROWS;
+    view.cols = COLS;
+    view.compact = compactGrid;
+    string rowChars(COLS, EMPTY);
+    string saved;
+    saved.swap(outputBuffer);
+    for (int r = 0; r < ROWS; r++) {
+        view.rowStarts.push_back((uint32_t)outputBuffer.size());
+        for (int c = 0; c < COLS && floorData; c++) {
+            const Seat &seat = floorData->seats[r * COLS + c];
+            rowChars[c] = (admin && seat.status == RESERVED) ? (char)toupper((unsigned char)userName(seat.user)[0])
+                                                              : (char)seat.status;
+        }
+        appendGridRow(rowChars.data(), COLS);
+    }
+    view.rowStarts.push_back((uint32_t)outputBuffer.size());
+    view.text.swap(outputBuffer);
+    outputBuffer.swap(saved);
+}
+
+// 显示某一天某一层的座位情况
+// 整天的座位图取自缓存，只替换当前用户自己的座位；缓存在座位被修改时失效
+// 参数: day - 要查询的日期
+// 参数: floor - 要查询的楼层
+// 参数: slots - 要查询的时段，0 表示整天；指定时段时 0 表示这些时段都空闲，1 表示其中有时段被占用
+void showSeats(const string &day, int floor, SlotMask slots = 0) {
+    PhaseScope phase(PHASE_EXECUTE);
+    // 获取日期编号并验证参数有效性
+    int date = getDate(day);
+    if (date == -1 || floor < 1 || floor > FLOORS) {
+        reportError("ERROR: Invalid day or floor.");
+        return;
+    }
+
+    floor--; // 转换为0-based索引
+
+    // 未分配的楼层全部空闲
+    FloorData *floorData = findFloor(date, floor);
+    vector<Seat> emptyRow;
+    if (!floorData) {
+        emptyRow.assign(COLS, EMPTY_SEAT);
+    }
+
+    // 当前用户当天按时段预约的座位（本层内下标），显示为2
+    int ownSlotSeat = -1;
+    DayData *dayData = findDay(date);
+    if (dayData && !isAdmin) {
+        auto it = dayData->userSlot.find(currentUser);
+        if (it != dayData->userSlot.end() && (int)it->second / (ROWS * COLS) == floor) {
+            ownSlotSeat = (int)it->second % (ROWS * COLS);
+        }
+    }
+
+    if (slots == 0) {
+        RenderedView &view = !floorData ? emptyFloorView : isAdmin ? floorData->adminView : floorData->userView;
+        if (view.text.empty() || view.rows != ROWS || view.cols != COLS || view.compact != compactGrid) {
+            renderFloorView(floorData, isAdmin, view);
+        }
+        // 当前用户自己的座位（整天预约或按时段预约）显示为2
+        int ownSeat = ownSlotSeat;
+        if (dayData && !isAdmin && ownSeat < 0) {
+            auto it = dayData->userSeat.find(currentUser);
+            if (it != dayData->userSeat.end() && (int)it->second / (ROWS * COLS) == floor) {
+                ownSeat = (int)it->second % (ROWS * COLS);
+            }
+        }
+        if (ownSeat < 0) {
+            outputBuffer += view.text;
+        } else if (!compactGrid) {
+            size_t start = outputBuffer.size();
+            outputBuffer += view.text;
+            outputBuffer[start + (size_t)(ownSeat / COLS) * (COLS + 1) + ownSeat % COLS] = CURRENT_USER;
+        } else {
+            // 紧凑模式下重新渲染自己座位所在的一行
+            int r = ownSeat / COLS;
+            string rowChars;
+            for (int c = 0; c < COLS; c++) {
+                const Seat &seat = floorData->seats[r * COLS + c];
+                rowChars += r * COLS + c == ownSeat ? CURRENT_USER : (char)seat.status;
+            }
+            outputBuffer.append(view.text, 0, view.rowStarts[r]);
+            appendGridRow(rowChars.data(), COLS);
+            outputBuffer.append(view.text, view.rowStarts[r + 1], string::npos);
+        }
+        flushOutput();
+        return;
+    }
+
+    // 指定时段时由时段位图得到这些时段都空闲的座位
+    vector<uint64_t> freeBits;
+    freeSeatBits(date, floor, slots, freeBits);
+
+    // 把每行每列的座位状态写入输出缓冲区，最后一次性输出
+    string rowChars(COLS, EMPTY);
+    for (int r = 0; r < ROWS; r++) {
+        const Seat *row = floorData ? &floorData->seats[r * COLS] : emptyRow.data();
+        const uint64_t *rowBits = &freeBits[(size_t)r * rowWords()];
+        for (int c = 0; c < COLS; c++) {
+            if (r * COLS + c == ownSlotSeat && (userSlotsAt(date, floor, r, c, currentUser) & slots)) {
+                rowChars[c] = CURRENT_USER;
+            } else if (row[c].status == UNAVAILABLE) {
+                rowChars[c] = seatDisplayChar(row[c]);
+            } else if (rowBits[c / 64] >> (c % 64) & 1) {
+                rowChars[c] = EMPTY;
+            } else {
+                rowChars[c] = (row[c].status == RESERVED && row[c].user == currentUser && !isAdmin) ? CURRENT_USER : RESERVED;
+            }
+        }
+        appendGridRow(rowChars.data(), COLS);
+    }
+    flushOutput();
+}
+
+// 列出某一天某一层在指定时段都空闲的座位
+// 通过按字相与各时段的空闲位图得到结果，不逐个检查座位的预约
+// 参数: day - 日期；floor - 楼层；slots - 时段
+void showFreeSeats(const string &day, int floor, SlotMask slots) {
+    PhaseScope phase(PHASE_EXECUTE);
+    int date = getDate(day);
+    if (date == -1 || floor < 1 || floor > FLOORS || slots == 0) {
+        reportError("ERROR: Invalid parameters.");
+        return;
+    }
+    floor--;
+
+    vector<uint64_t> freeBits;
+    freeSeatBits(date, floor, slots, freeBits);
+    size_t count = 0;
+    for (uint64_t word : freeBits) {
+        count += (size_t)popCount(word);
+    }
+    outputBuffer += "Free seats: ";
+    outputBuffer += to_string(count);
+    outputBuffer += '\n';
+    // 逐个取出位图中为1的位
+    int words = rowWords();
+    for (size_t w = 0; w < freeBits.size(); w++) {
+        uint64_t word = freeBits[w];
+        while (word) {
+            int bit = lowestBit(word);
+            word &= word - 1;
+            outputBuffer += "Seat ";
+            outputBuffer += to_string(w / words + 1);
+            outputBuffer += ' ';
+            outputBuffer += to_string((int)(w % words) * 64 + bit + 1);
+            outputBuffer += '\n';
+        }
+    }
+    flushOutput();
+}
+
+// 预约座位
+// 参数: day - 预约日期
+// 参数: floor - 预约楼层
+// 参数: row - 预约座位行号
+// 参数: col - 预约座位列号
+// 参数: slots - 预约的时段，0 表示整天
+void reserveSeat(const string &day, int floor, int row, int col, SlotMask slots = 0) {
+    PhaseScope phase(PHASE_EXECUTE);
+    // 获取日期编号并验证所有参数有效性
+    int date = getDate(day);
+    if (date == -1 || floor < 1 || floor > FLOORS || row < 1 || row > ROWS || col < 1 || col > COLS) {
+        reportError("ERROR: Invalid parameters.");
+        return;
+    }
+
+    // 管理员没有自己的预约，应使用 AdminReserve 为用户预约
+    if (currentUser == NO_USER) {
+        reportError("ERROR: Use AdminReserve to reserve for a user.");
+        return;
+    }
+
+    // 将1-based索引转换为0-based索引
+    floor--; row--; col--;
+
+    if (slots != 0) {
+        // 按时段预约：这些时段必须都空闲（用户自己在该座位上的原预约不算冲突）
+        FloorData *floorData = findFloor(date, floor);
+        SlotMask busy = floorData ? busySlots(*floorData, row, col) : 0;
+        if (floorData && floorData->seats[row * COLS + col].status == PARTIAL) {
+            busy &= ~userSlotsAt(date, floor, row, col, currentUser);
+        }
+        if (busy & slots) {
+            reportError("ERROR");
+            return;
+        }
+        cancelUserReservation(date, currentUser);
+        bookSlots(date, floor, row, col, currentUser, slots);
+        cout << "OK" << endl;
+        saveData();
+        return;
+    }
+
+    // 检查座位是否为空（可预约）
+    if (seatAt(date, floor, row, col).status != EMPTY) {
+        reportError("ERROR");
+        return;
+    }
+
+    // 如果用户在同一天已经预约了座位，则取消之前的预约
+    cancelUserReservation(date, currentUser);
+
+    // 预约新座位
+    setSeat(date, floor, row, col, RESERVED, currentUser);
+    cout << "OK" << endl;
+
+    // 保存数据
+    saveData();
+}
+
+// 在一行的空闲位图（每个字64个座位，行尾填充位为0）中查找连续 k 个为1的位
+// 反复执行 bits &= bits >> step（跨字移位），每次使连续长度翻倍，共 O(log k) 遍，
+// 之后第 i 位为1表示从第 i 列起的 k 个座位都空闲
+// 参数: bits - 该行的空闲位图（会被修改）；k - 需要的连续座位数
+// 返回: 第一段的起始列（0-based），没有时返回-1
+int findFreeRun(vector<uint64_t> &bits, int k) {
+    int words = (int)bits.size();
+    for (int len = 1; len < k;) {
+        int step = min(len, k - len);
+        int wordShift = step / 64, bitShift = step % 64;
+        for (int w = 0; w < words; w++) {
+            uint64_t shifted = 0;
+            if (w + wordShift < words) {
+                shifted = bits[w + wordShift] >> bitShift;
+                if (bitShift != 0 && w + wordShift + 1 < words) {
+                    shifted |= bits[w + wordShift + 1] << (64 - bitShift);
+                }
+            }
+            bits[w] &= shifted;
+        }
+        len += step;
+    }
+    for (int w = 0; w < words; w++) {
+        if (bits[w]) {
+            return w * 64 + lowestBit(bits[w]);
+        }
+    }
+    return -1;
+}
+
+// 为一组用户预约同一行中相邻的座位
+// 在每一行整天空闲的座位位图中查找连续的空位，全部预约成功或全部不预约；
+// 每个组员当天原有的预约按"每天一个座位"的规则被取消
+// 参数: day - 日期；floor - 楼层；count - 座位数；members - With 后列出的组员用户名
+void reserveGroup(const string &day, int floor, int count, const vector<string> &members) {
+    PhaseScope phase(PHASE_EXECUTE);
+    int date = getDate(day);
+    if (date == -1 || floor < 1 || floor > FLOORS || count < 1 || count > COLS) {
+        reportError("ERROR: Invalid parameters.");
+        return;
+    }
+
+    // 组员：当前用户（管理员除外）加上 With 后列出的用户，人数必须与座位数一致
+    vector<UserId> users;
+    if (currentUser != NO_USER) {
+        users.push_back(currentUser);
+    }
+    for (const string &name : members) {
+        if (!isValidUsername(name) || name == "Admin") {
+            reportError("ERROR: Invalid parameters.");
+            return;
+        }
+        UserId user = internUser(normalizeUsername(name));
+        if (user == NO_USER || find(users.begin(), users.end(), user) != users.end()) {
+            reportError("ERROR: Invalid group members.");
+            return;
+        }
+        users.push_back(user);
+    }
+    // 每个座位都必须记在一名组员名下（数据文件和索引中每人每天只有一个座位），
+    // 因此省略 With 时只能预约 Count 1
+    if (members.empty() && count > 1) {
+        reportError("ERROR: Name the other group members with With.");
+        return;
+    }
+    if ((int)users.size() != count) {
+        reportError("ERROR: Group size does not match Count.");
+        return;
+    }
+
+    // 逐行查找，整天空闲即所有时段都空闲
+    floor--;
+    int words = rowWords();
+    vector<uint64_t> freeBits, rowBits(words);
+    freeSeatBits(date, floor, ALL_SLOTS, freeBits);
+    int row = -1, col = -1;
+    for (int r = 0; r < ROWS && col == -1; r++) {
+        copy(freeBits.begin() + (size_t)r * words, freeBits.begin() + (size_t)(r + 1) * words, rowBits.begin());
+        col = findFreeRun(rowBits, count);
+        row = r;
+    }
+    if (col == -1) {
+        reportError("ERROR: No " + to_string(count) + " adjacent free seats.");
+        return;
+    }
+
+    // 找到后再为每个组员预约
+    outputBuffer += "OK\n";
+    for (int i = 0; i < count; i++) {
+        cancelUserReservation(date, users[i]);
+        setSeat(date, floor, row, col + i, RESERVED, users[i]);
+        outputBuffer += userName(users[i]);
+        outputBuffer += " Floor ";
+        outputBuffer += to_string(floor + 1);
+        outputBuffer += " Seat ";
+        outputBuffer += to_string(row + 1);
+        outputBuffer += ' ';
+        outputBuffer += to_string(col + i + 1);
+        outputBuffer += '\n';
+    }
+    flushOutput();
+    saveData();
+}
+
+// ===================== 座位属性 =====================
+// 座位属性文件为每个座位标注属性（靠窗、安静区、有电源等），ReserveBest 按用户的偏好自动分配最合适的空闲座位。
+// 文件格式（每行一条，# 开头的行为注释；楼层、行、列为 1-based，写 * 表示全部）：
+//   楼层 行 列 属性...       （如 "* * 1 window" 表示每层第1列靠窗，"3 * * quiet" 表示3楼是安静区）
+// 每个属性预先计算一张座位位图（每层一张，与时段位图的布局相同）。查找时把偏好组合的属性位图与当天的空闲位图
+// 按字相与，空闲位图随每次预约和取消同步更新，因此不需要逐个座位打分，也不需要另外维护每个属性的空闲列表。
+const string SEAT_ATTRIBUTES_FILE = "library_seat_attributes.txt";
+const int MAX_ATTRIBUTES = 32;     // 属性种类上限（属性集合用32位掩码表示）
+const int MAX_PREFERENCES = 6;     // ReserveBest 一次最多的偏好数（查找时最多检查 2^6 种组合）
+
+// 属性文件中的一条标注
+struct AttributeRule {
+    int floor;        // 楼层（0-based），-1 表示全部
+    int row;          // 行（0-based），-1 表示全部
+    int col;          // 列（0-based），-1 表示全部
+    uint32_t mask;    // 属性集合
+};
+
+vector<string> attributeNames;         // 属性名，下标即属性编号
+vector<AttributeRule> attributeRules;  // 属性文件中的全部标注
+// 各属性的座位位图：attributeBits[a] 依次存放 FLOORS 层，每层 slotPlaneWords() 个字，位为1表示该座位有属性 a
+vector<CountedVector<uint64_t, MEM_ATTRIBUTES>> attributeBits;
+int attributeFloors = 0;   // 位图对应的布局，与当前布局不同时重新计算
+int attributeRows = 0;
+int attributeCols = 0;
+
+// 读取座位属性文件（启动时调用），文件不存在时没有任何属性；格式错误的行被忽略
+void loadSeatAttributes() {
+    attributeNames.clear();
+    attributeRules.clear();
+    attributeFloors = 0;
+    ifstream file(SEAT_ATTRIBUTES_FILE);
+    string line;
+    while (getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        istringstream iss(line);
+        string coords[3], name;
+        int values[3];
+        if (!(iss >> coords[0] >> coords[1] >> coords[2])) continue;
+        bool valid = true;
+        for (int i = 0; i < 3; i++) {
+            values[i] = coords[i] == "*" ? -1 : atoi(coords[i].c_str()) - 1;
+            valid = valid && (coords[i] == "*" || values[i] >= 0);
+        }
+        if (!valid) continue;
+        AttributeRule rule = {values[0], values[1], values[2], 0};
+        while (iss >> name) {
+            size_t index = find(attributeNames.begin(), attributeNames.end(), name) - attributeNames.begin();
+            if (index == attributeNames.size()) {
+                if (attributeNames.size() == MAX_ATTRIBUTES) continue;
+                attributeNames.push_back(name);
+            }
+            rule.mask |= 1u << index;
+        }
+        if (rule.mask != 0) {
+            attributeRules.push_back(rule);
+        }
+    }
+}
+
+// 按当前布局计算各属性的座位位图（布局未变化时直接返回），超出布局的标注被忽略
+void buildAttributeBits() {
+    if (attributeFloors == FLOORS && attributeRows == ROWS && attributeCols == COLS) return;
+    attributeFloors = FLOORS;
+    attributeRows = ROWS;
+    attributeCols = COLS;
+    size_t plane = slotPlaneWords();
+    attributeBits.assign(attributeNames.size(), CountedVector<uint64_t, MEM_ATTRIBUTES>());
+    for (auto &bits : attributeBits) {
+        bits.assign((size_t)FLOORS * plane, 0);
+    }
+    for (const AttributeRule &rule : attributeRules) {
+        for (int f = max(rule.floor, 0); f < (rule.floor == -1 ? FLOORS : min(rule.floor + 1, FLOORS)); f++) {
+            for (int r = max(rule.row, 0); r < (rule.row == -1 ? ROWS : min(rule.row + 1, ROWS)); r++) {
+                for (int c = max(rule.col, 0); c < (rule.col == -1 ? COLS : min(rule.col + 1, COLS)); c++) {
+                    size_t word = f * plane + (size_t)r * rowWords() + c / 64;
+                    for (size_t a = 0; a < attributeBits.size(); a++) {
+                        if (rule.mask >> a & 1) attributeBits[a][word] |= 1ull << (c % 64);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// 按偏好自动预约最合适的空闲座位
+// 偏好按重要性从高到低排列：座位的得分是它满足的偏好的权重之和（第 i 个偏好的权重是其后所有偏好之和再加1），
+// 得分相同时选楼层、行、列最小的座位。从满分的组合开始依次检查各个偏好组合，
+// 第一个存在空闲座位的组合就是最高得分——得分更高的座位一定会在更早的组合中被找到。
+// 调用者当天原有的座位预约前会被取消，因此也是候选，得分相同时保留原座位
+// 参数: day - 日期；floor - 楼层（1-based），0 表示任意楼层；slots - 预约的时段，0 表示整天；prefs - 偏好的属性名
+void reserveBest(const string &day, int floor, SlotMask slots, const vector<string> &prefs) {
+    PhaseScope phase(PHASE_EXECUTE);
+    int date = getDate(day);
+    if (date == -1 || floor < 0 || floor > FLOORS || (int)prefs.size() > MAX_PREFERENCES) {
+        reportError("ERROR: Invalid parameters.");
+        return;
+    }
+    if (currentUser == NO_USER) {
+        reportError("ERROR: Use AdminReserve to reserve for a user.");
+        return;
+    }
+    vector<int> wanted;   // 偏好的属性编号
+    for (const string &pref : prefs) {
+        int index = (int)(find(attributeNames.begin(), attributeNames.end(), pref) - attributeNames.begin());
+        if (index == (int)attributeNames.size()) {
+            reportError("ERROR: Unknown seat attribute " + pref + ".");
+            return;
+        }
+        wanted.push_back(index);
+    }
+    buildAttributeBits();
+
+    // 候选楼层在所需时段都空闲的座位位图
+    size_t plane = slotPlaneWords();
+    int firstFloor = floor == 0 ? 0 : floor - 1;
+    int lastFloor = floor == 0 ? FLOORS : floor;
+    vector<uint64_t> freeBits, floorBits;
+    for (int f = firstFloor; f < lastFloor; f++) {
+        freeSeatBits(date, f, slots != 0 ? slots : ALL_SLOTS, floorBits);
+        freeBits.insert(freeBits.end(), floorBits.begin(), floorBits.end());
+    }
 
-    string line;
-    
-    // 首先读取座位配置信息
-    if (getline(file, line)) {
-        istringstream iss(line);
-        int floors, rows, cols;
-        if (iss >> floors >> rows >> cols) {
-            // 更新全局配置变量
-            FLOORS = floors;
-            ROWS = rows;
-            COLS = cols;
+    // 调用者原有的座位：整天预约的座位取消后全部时段空闲，按时段预约的座位只需其他人的预约不占用所需时段
+    int ownFloor = -1, ownSeat = -1;
+    DayData *current = findDay(date);
+    if (current) {
+        auto seatIt = current->userSeat.find(currentUser);
+        auto slotIt = current->userSlot.find(currentUser);
+        int index = seatIt != current->userSeat.end() ? (int)seatIt->second
+                  : slotIt != current->userSlot.end() ? (int)slotIt->second : -1;
+        if (index != -1 && index / (ROWS * COLS) >= firstFloor && index / (ROWS * COLS) < lastFloor) {
+            ownFloor = index / (ROWS * COLS);
+            ownSeat = index % (ROWS * COLS);
+            if (seatIt == current->userSeat.end()) {
+                SlotMask others = 0;
+                for (const SlotBooking &booking : current->floors[ownFloor]->slotBookings[(uint32_t)ownSeat]) {
+                    if (booking.user != currentUser) others |= booking.slots;
+                }
+                if (others & (slots != 0 ? slots : ALL_SLOTS)) ownSeat = -1;
+            }
         }
     }
-    
-    // 初始化library以适应新的大小
-    initializeLibrary();
 
-    // 然后按顺序读取每个座位的信息
-    for (int d = 0; d < NUM_DAYS; d++) {
-        for (int f = 0; f < FLOORS; f++) {
-            for (int r = 0; r < ROWS; r++) {
-                for (int c = 0; c < COLS; c++) {
-                    if (getline(file, line)) {
-                        if (line.length() >= 2) {
-                            // 读取座位状态和用户标识
-                            library[d][f][r][c].status = line[0];
-                            library[d][f][r][c].user = line[1];
-                        }
-                    }
+    // 组合 m 的第 k-1-i 位表示第 i 个偏好，数值越大得分越高
+    int k = (int)wanted.size();
+    int bestFloor = -1, bestSeat = -1, bestMask = 0;
+    for (int m = (1 << k) - 1; m >= 0 && bestSeat == -1; m--) {
+        if (ownSeat != -1) {
+            size_t w = ownFloor * plane + (size_t)(ownSeat / COLS) * rowWords() + ownSeat % COLS / 64;
+            uint64_t bit = 1ull << (ownSeat % COLS % 64);
+            bool matches = true;
+            for (int i = 0; i < k && matches; i++) {
+                if (m >> (k - 1 - i) & 1) matches = (attributeBits[wanted[i]][w] & bit) != 0;
+            }
+            if (matches) {
+                bestFloor = ownFloor;
+                bestSeat = ownSeat;
+                bestMask = m;
+                break;
+            }
+        }
+        for (int f = firstFloor; f < lastFloor && bestSeat == -1; f++) {
+            const uint64_t *free = &freeBits[(f - firstFloor) * plane];
+            for (size_t w = 0; w < plane; w++) {
+                uint64_t word = free[w];
+                for (int i = 0; i < k && word; i++) {
+                    if (m >> (k - 1 - i) & 1) word &= attributeBits[wanted[i]][f * plane + w];
+                }
+                if (word) {
+                    bestFloor = f;
+                    bestSeat = (int)(w / rowWords()) * COLS + (int)(w % rowWords()) * 64 + lowestBit(word);
+                    bestMask = m;
+                    break;
                 }
             }
         }
     }
+    if (bestSeat == -1) {
+        reportError("ERROR: No free seats.");
+        return;
+    }
 
-    // 关闭文件
-    file.close();
-}
-
-// 检查用户名是否只包含字母
-// 参数: username - 待验证的用户名字符串
-// 返回: 若用户名为纯字母（允许空格）则返回true，否则返回false
-bool isValidUsername(const string &username) {
-    for (char c : username) {
-        if (!isalpha(c) && c != ' ') {
-            return false;
+    // 取消当天原有的预约后预约找到的座位，输出座位和满足的偏好
+    int row = bestSeat / COLS, col = bestSeat % COLS;
+    cancelUserReservation(date, currentUser);
+    if (slots != 0) {
+        bookSlots(date, bestFloor, row, col, currentUser, slots);
+    } else {
+        setSeat(date, bestFloor, row, col, RESERVED, currentUser);
+    }
+    outputBuffer += "OK Floor ";
+    outputBuffer += to_string(bestFloor + 1);
+    outputBuffer += " Seat ";
+    outputBuffer += to_string(row + 1);
+    outputBuffer += ' ';
+    outputBuffer += to_string(col + 1);
+    for (int i = 0; i < k; i++) {
+        if (bestMask >> (k - 1 - i) & 1) {
+            outputBuffer += ' ';
+            outputBuffer += prefs[i];
         }
     }
-    return true;
+    outputBuffer += '\n';
+    flushOutput();
+    saveData();
 }
 
-// 登录功能
-// 允许用户输入用户名进行登录，支持普通用户和管理员登录
-void login() {
-    string username;
-    cout << "Please enter username" << endl;
-    cin >> username;
-    // 清除输入缓冲区中的换行符，防止getline读取到空行
-    cin.ignore(numeric_limits<streamsize>::max(), '\n');
-
-    // 验证用户名是否只包含字母
-    if (!isValidUsername(username)) {
-        cout << "ERROR:ALPHABETS ONLY!" << endl;
+// 加入候补队列
+// 所选楼层（或任意楼层）已没有整天空闲的座位时才能候补；有座位空出时自动为队首的用户预约，
+// 无需反复重试预约
+// 参数: day - 日期
+// 参数: floor - 楼层（1-based），0 表示任意楼层
+void joinWaitlist(const string &day, int floor) {
+    PhaseScope phase(PHASE_EXECUTE);
+    int date = getDate(day);
+    if (date == -1 || floor < 0 || floor > FLOORS) {
+        reportError("ERROR: Invalid parameters.");
+        return;
+    }
+    if (currentUser == NO_USER) {
+        reportError("ERROR: Admin cannot join the waitlist.");
         return;
     }
 
-    // 处理管理员登录
-    if (username == "Admin") {
-        string password;
-        cout << "Please enter password" << endl;
-        cin >> password;
-        // 清除输入缓冲区中的换行符
-        cin.ignore(numeric_limits<streamsize>::max(), '\n');
-        if (password == "666") {
-            currentUser = 'A'; // 管理员用A表示
-            isAdmin = true;
-            cout << "Login successful." << endl;
-        } else {
-            cout << "Incorrect password, login failed." << endl;
-        }
-    } else {
-        // 处理普通用户登录
-        if (username.length() == 1 && isalpha(username[0])) {
-            currentUser = toupper(username[0]);
-            isAdmin = false;
-            cout << "Login successful." << endl;
-        } else {
-            cout << "Invalid username format, should be a single letter." << endl;
+    // 检查所选楼层是否还有整天空闲的座位
+    vector<uint64_t> freeBits;
+    for (int f = (floor == 0 ? 0 : floor - 1); f < (floor == 0 ? FLOORS : floor); f++) {
+        freeSeatBits(date, f, ALL_SLOTS, freeBits);
+        for (uint64_t word : freeBits) {
+            if (word) {
+                reportError("ERROR: Free seats available, please reserve directly.");
+                return;
+            }
         }
     }
-}
 
-// 退出登录
-// 清除当前用户的登录状态并保存数据
-void exitLogin() {
-    currentUser = ' ';
-    isAdmin = false;
-    cout << "Logged out." << endl;
-    // 保存数据以确保所有更改被持久化
+    enqueueWaiter(date, floor - 1, currentUser);
+    cout << "Added to waitlist." << endl;
     saveData();
 }
 
-// 查找日期对应的索引
-// 参数: day - 日期字符串
-// 返回: 日期对应的索引，若日期无效则返回-1
-int getDayIndex(const string &day) {
-    // 遍历日期数组查找匹配的日期
-    for (int i = 0; i < NUM_DAYS; i++) {
-        if (DAYS[i] == day) {
-            return i;  // 找到匹配的日期，返回索引
+// 显示某个版本之后变化的座位
+// 输出第一行为 "VERSION 当前版本号"，随后每个变化的座位一行（显示方式与座位图相同），
+// 被整天清空的日期输出 "日期 星期 Cleared"；版本号早于变更记录的起点或布局发生变化时输出 RESYNC，
+// 客户端需要重新读取座位图
+// 参数: since - 客户端上次看到的版本号
+// 参数: day - 只显示该日期的变化（为空时显示全部）
+// 参数: floor - 只显示该楼层的变化（1-based，0 表示全部楼层）
+// 参数: waitSeconds - 没有新的变化时最多等待的秒数，0 表示不等待
+void showChanges(uint64_t since, const string &day, int floor, int waitSeconds) {
+    PhaseScope phase(PHASE_EXECUTE);
+    int date = -1;
+    if (!day.empty()) {
+        date = getDate(day);
+        if (date == -1 || floor < 1 || floor > FLOORS) {
+            reportError("ERROR: Invalid parameters.");
+            return;
         }
     }
-    return -1;  // 未找到匹配的日期，返回-1表示无效
-}
+    floor--;
 
-// 显示某一天某一层的座位情况
-// 参数: day - 要查询的日期
-// 参数: floor - 要查询的楼层
-void showSeats(const string &day, int floor) {
-    // 获取日期索引并验证参数有效性
-    int dayIndex = getDayIndex(day);
-    if (dayIndex == -1 || floor < 1 || floor > FLOORS) {
-        cout << "ERROR: Invalid day or floor." << endl;
-        return;
+    // 等待直到有新的变化（指定楼层时等待该层的变化）或超时
+    loadChanges();
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(waitSeconds);
+    while ((date == -1 ? changesVersion : floorVersion(date, floor)) <= since &&
+           chrono::steady_clock::now() < deadline) {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        loadChanges();
     }
 
-    floor--; // 转换为0-based索引
+    outputBuffer += "VERSION ";
+    outputBuffer += to_string(changesVersion);
+    outputBuffer += '\n';
+    if (since < changesBase || resyncVersion > since) {
+        outputBuffer += "RESYNC\n";
+        flushOutput();
+        return;
+    }
 
-    // 遍历显示每行每列的座位状态
-    for (int r = 0; r < ROWS; r++) {
-        for (int c = 0; c < COLS; c++) {
-            // 所有用户都能看到不可预约状态
-            if (library[dayIndex][floor][r][c].status == UNAVAILABLE) {
-                cout << UNAVAILABLE;
-            } else if (isAdmin) {
-                // 管理员可以看到所有用户的预约信息
-                if (library[dayIndex][floor][r][c].status == RESERVED) {
-                    cout << library[dayIndex][floor][r][c].user;
-                } else {
-                    cout << library[dayIndex][floor][r][c].status;
-                }
-            } else {
-                // 普通用户只能看到自己的预约和空闲/已预约状态
-                if (library[dayIndex][floor][r][c].user == currentUser) {
-                    cout << CURRENT_USER;
-                } else {
-                    cout << library[dayIndex][floor][r][c].status;
-                }
-            }
+    // 同一座位只显示最后的状态；整天清空之前的座位变化被清空取代
+    map<pair<int, int>, Seat> seats;     // （日期，扁平下标）-> 最新状态
+    vector<int> clearedDays;
+    auto first = upper_bound(changeRecords.begin(), changeRecords.end(), since,
+                             [](uint64_t version, const ChangeRecord &record) { return version < record.version; });
+    for (auto it = first; it != changeRecords.end(); ++it) {
+        const ChangeRecord &record = *it;
+        if (date != -1 && record.date != date) continue;
+        if (record.type == 'D') {
+            seats.erase(seats.lower_bound({record.date, 0}), seats.lower_bound({record.date + 1, 0}));
+            clearedDays.push_back(record.date);
+        } else if (record.type == 'S' && (floor < 0 || record.floor == floor) && record.row < ROWS &&
+                   record.col < COLS && record.floor < FLOORS) {
+            seats[{record.date, (record.floor * ROWS + record.row) * COLS + record.col}] = record.seat;
         }
-        cout << endl;
     }
+    sort(clearedDays.begin(), clearedDays.end());
+    clearedDays.erase(unique(clearedDays.begin(), clearedDays.end()), clearedDays.end());
+    for (int cleared : clearedDays) {
+        if (cleared < today) continue;
+        outputBuffer += formatDate(cleared);
+        outputBuffer += ' ';
+        outputBuffer += DAYS[weekdayOf(cleared)];
+        outputBuffer += " Cleared\n";
+    }
+    for (const auto &entry : seats) {
+        if (entry.first.first < today) continue;
+        int index = entry.first.second;
+        outputBuffer += formatDate(entry.first.first);
+        outputBuffer += ' ';
+        outputBuffer += DAYS[weekdayOf(entry.first.first)];
+        outputBuffer += " Floor ";
+        outputBuffer += to_string(index / (ROWS * COLS) + 1);
+        outputBuffer += " Seat ";
+        outputBuffer += to_string(index / COLS % ROWS + 1);
+        outputBuffer += ' ';
+        outputBuffer += to_string(index % COLS + 1);
+        outputBuffer += ' ';
+        outputBuffer += seatDisplayChar(entry.second);
+        outputBuffer += '\n';
+    }
+    flushOutput();
 }
 
-// 预约座位
-// 参数: day - 预约日期
-// 参数: floor - 预约楼层
-// 参数: row - 预约座位行号
-// 参数: col - 预约座位列号
-void reserveSeat(const string &day, int floor, int row, int col) {
-    // 获取日期索引并验证所有参数有效性
-    int dayIndex = getDayIndex(day);
-    if (dayIndex == -1 || floor < 1 || floor > FLOORS || row < 1 || row > ROWS || col < 1 || col > COLS) {
-        cout << "ERROR: Invalid parameters." << endl;
+// 显示当前版本号，指定日期和楼层时显示该层最后一次变化的版本号
+// 参数: day - 日期（为空时显示全局版本号）
+// 参数: floor - 楼层（1-based）
+void showVersion(const string &day, int floor) {
+    PhaseScope phase(PHASE_EXECUTE);
+    loadChanges();
+    if (day.empty()) {
+        cout << "VERSION " << changesVersion << endl;
         return;
     }
-
-    // 将1-based索引转换为0-based索引
-    floor--; row--; col--;
-
-    // 检查座位是否为空（可预约）
-    if (library[dayIndex][floor][row][col].status != EMPTY) {
-        cout << "ERROR" << endl;
+    int date = getDate(day);
+    if (date == -1 || floor < 1 || floor > FLOORS) {
+        reportError("ERROR: Invalid parameters.");
         return;
     }
+    cout << "VERSION " << floorVersion(date, floor - 1) << endl;
+}
 
-    // 检查用户在同一天是否已经预约了座位（同一用户同一天只能预约一个座位）
-    for (int f = 0; f < FLOORS; f++) {
-        for (int r = 0; r < ROWS; r++) {
-            for (int c = 0; c < COLS; c++) {
-                if (library[dayIndex][f][r][c].user == currentUser && library[dayIndex][f][r][c].status == RESERVED) {
-                    // 如果已经有预约，则取消之前的预约
-                    library[dayIndex][f][r][c].status = EMPTY;
-                    library[dayIndex][f][r][c].user = ' ';
-                    break;
-                }
-            }
-        }
+// 签到
+// 当前用户签到今天的预约，签到后预约不会因超时被释放
+void checkIn() {
+    PhaseScope phase(PHASE_EXECUTE);
+    if (currentUser == NO_USER) {
+        reportError("ERROR: Admin has no reservation to check in.");
+        return;
     }
-
-    // 预约新座位
-    library[dayIndex][floor][row][col].status = RESERVED;
-    library[dayIndex][floor][row][col].user = currentUser;
-    cout << "OK" << endl;
-    
-    // 保存数据
+    DayData *day = findDay(today);
+    if (!day || (!day->userSeat.count(currentUser) && !day->userSlot.count(currentUser))) {
+        reportError("ERROR: No reservation to check in today.");
+        return;
+    }
+    int &deadline = day->checkInDeadlines[currentUser];
+    if (deadline == CHECKED_IN) {
+        cout << "Already checked in." << endl;
+        return;
+    }
+    deadline = CHECKED_IN;
+    journalCheckIn(today, currentUser);
+    cout << "Checked in." << endl;
     saveData();
 }
 
 // 显示当前用户的预约
-// 显示当前登录用户的所有座位预约信息
+// 按日期顺序显示当前登录用户的所有座位预约信息
 void showReservations() {
+    PhaseScope phase(PHASE_EXECUTE);
     bool hasReservation = false;  // 标记用户是否有预约
-    
-    // 遍历所有日期、楼层、行和列查找用户的预约
-    for (int d = 0; d < NUM_DAYS; d++) {
-        for (int f = 0; f < FLOORS; f++) {
-            for (int r = 0; r < ROWS; r++) {
-                for (int c = 0; c < COLS; c++) {
-                    // 找到当前用户的预约
-                    if (library[d][f][r][c].user == currentUser) {
-                        // 显示预约信息：日期、楼层、座位位置
-                        cout << DAYS[d] << " Floor " << (f + 1) << " Seat " << (r + 1) << " " << (c + 1) << endl;
-                        hasReservation = true;
-                    }
-                }
+
+    // 按日期顺序在每天的用户预约索引中查找当前用户的预约
+    for (int date = today; date < today + HORIZON_DAYS; date++) {
+        DayData *day = findDay(date);
+        if (!day) continue;
+        auto waitIt = day->waiting.find(currentUser);
+        if (waitIt != day->waiting.end()) {
+            // 候补：日期、星期、Waitlist（指定楼层时附带楼层）
+            outputBuffer += formatDate(date);
+            outputBuffer += ' ';
+            outputBuffer += DAYS[weekdayOf(date)];
+            outputBuffer += " Waitlist";
+            if (waitIt->second.floor >= 0) {
+                outputBuffer += " Floor ";
+                outputBuffer += to_string(waitIt->second.floor + 1);
             }
+            outputBuffer += '\n';
+            hasReservation = true;
+        }
+        auto it = day->userSeat.find(currentUser);
+        SlotMask slots = 0;
+        if (it == day->userSeat.end()) {
+            it = day->userSlot.find(currentUser);
+            if (it == day->userSlot.end()) continue;
+            int index = (int)it->second;
+            slots = userSlotsAt(date, index / (ROWS * COLS), index / COLS % ROWS, index % COLS, currentUser);
+        }
+        int index = (int)it->second;
+        // 记录预约信息：日期、星期、楼层、座位位置，按时段预约时再加上时间段
+        outputBuffer += formatDate(date);
+        outputBuffer += ' ';
+        outputBuffer += DAYS[weekdayOf(date)];
+        outputBuffer += " Floor ";
+        outputBuffer += to_string(index / (ROWS * COLS) + 1);
+        outputBuffer += " Seat ";
+        outputBuffer += to_string(index / COLS % ROWS + 1);
+        outputBuffer += ' ';
+        outputBuffer += to_string(index % COLS + 1);
+        if (slots != 0) {
+            outputBuffer += " Time ";
+            outputBuffer += formatTimeRange(slots);
         }
+        auto checkInIt = day->checkInDeadlines.find(currentUser);
+        if (checkInIt != day->checkInDeadlines.end() && checkInIt->second == CHECKED_IN) {
+            outputBuffer += " Checked in";
+        }
+        outputBuffer += '\n';
+        hasReservation = true;
     }
-    
+
     // 如果没有找到预约，显示提示信息
     if (!hasReservation) {
-        cout << "No reservations." << endl;
+        outputBuffer += "No reservations.\n";
     }
+    flushOutput();
 }
 
 // 清空所有数据
 // 重置所有座位状态并清空用户数据
 void clearAllData() {
+    PhaseScope phase(PHASE_EXECUTE);
+    // 先把今天及以后的全部预约写入历史归档
+    HistoryBatch history;
+    for (int date = today; date < today + HORIZON_DAYS; date++) {
+        collectDayHistory(date, history);
+    }
+    appendHistory(history, HISTORY_CLEAR_ALL);
     // 重新初始化图书馆数据
     initializeLibrary();
+    journalSnapshot = true;
     // 保存清空后的数据
     saveData();
     // 显示操作结果
@@ -353,12 +3907,19 @@ void clearAllData() {
 // 参数: floor - 预约楼层
 // 参数: row - 预约座位行号
 // 参数: col - 预约座位列号
-// 参数: user - 被预约的用户标识
-void adminReserveSeat(const string &day, int floor, int row, int col, char user) {
-    // 获取日期索引并验证所有参数有效性
-    int dayIndex = getDayIndex(day);
-    if (dayIndex == -1 || floor < 1 || floor > FLOORS || row < 1 || row > ROWS || col < 1 || col > COLS || !isalpha(user)) {
-        cout << "ERROR: Invalid parameters." << endl;
+// 参数: username - 被预约的用户名
+void adminReserveSeat(const string &day, int floor, int row, int col, const string &username) {
+    PhaseScope phase(PHASE_EXECUTE);
+    // 获取日期编号并验证所有参数有效性
+    int date = getDate(day);
+    if (date == -1 || floor < 1 || floor > FLOORS || row < 1 || row > ROWS || col < 1 || col > COLS ||
+        !isValidUsername(username) || username == "Admin") {
+        reportError("ERROR: Invalid parameters.");
+        return;
+    }
+    UserId user = internUser(normalizeUsername(username));
+    if (user == NO_USER) {
+        reportError("ERROR: Failed to register user.");
         return;
     }
 
@@ -366,30 +3927,18 @@ void adminReserveSeat(const string &day, int floor, int row, int col, char user)
     floor--; row--; col--;
 
     // 检查座位是否为空（可预约）
-    if (library[dayIndex][floor][row][col].status != EMPTY) {
-        cout << "ERROR" << endl;
+    if (seatAt(date, floor, row, col).status != EMPTY) {
+        reportError("ERROR");
         return;
     }
 
-    // 检查指定用户在同一天是否已经预约了座位
-    for (int f = 0; f < FLOORS; f++) {
-        for (int r = 0; r < ROWS; r++) {
-            for (int c = 0; c < COLS; c++) {
-                if (library[dayIndex][f][r][c].user == user && library[dayIndex][f][r][c].status == RESERVED) {
-                    // 如果已经有预约，则取消之前的预约
-                    library[dayIndex][f][r][c].status = EMPTY;
-                    library[dayIndex][f][r][c].user = ' ';
-                    break;
-                }
-            }
-        }
-    }
+    // 如果指定用户在同一天已经预约了座位，则取消之前的预约
+    cancelUserReservation(date, user);
 
     // 为指定用户预约新座位
-    library[dayIndex][floor][row][col].status = RESERVED;
-    library[dayIndex][floor][row][col].user = user;
+    setSeat(date, floor, row, col, RESERVED, user);
     cout << "OK" << endl;
-    
+
     // 保存数据
     saveData();
 }
@@ -401,10 +3950,11 @@ void adminReserveSeat(const string &day, int floor, int row, int col, char user)
 // 参数: row - 座位行号
 // 参数: col - 座位列号
 void adminCancelReservation(const string &day, int floor, int row, int col) {
-    // 获取日期索引并验证所有参数有效性
-    int dayIndex = getDayIndex(day);
-    if (dayIndex == -1 || floor < 1 || floor > FLOORS || row < 1 || row > ROWS || col < 1 || col > COLS) {
-        cout << "ERROR: Invalid parameters." << endl;
+    PhaseScope phase(PHASE_EXECUTE);
+    // 获取日期编号并验证所有参数有效性
+    int date = getDate(day);
+    if (date == -1 || floor < 1 || floor > FLOORS || row < 1 || row > ROWS || col < 1 || col > COLS) {
+        reportError("ERROR: Invalid parameters.");
         return;
     }
 
@@ -412,15 +3962,14 @@ void adminCancelReservation(const string &day, int floor, int row, int col) {
     floor--; row--; col--;
 
     // 检查座位是否为空（没有预约可取消）
-    if (library[dayIndex][floor][row][col].status == EMPTY) {
-        cout << "ERROR" << endl;
+    if (seatAt(date, floor, row, col).status == EMPTY) {
+        reportError("ERROR");
         return;
     }
 
-    library[dayIndex][floor][row][col].status = EMPTY;
-    library[dayIndex][floor][row][col].user = ' ';
+    setSeat(date, floor, row, col, EMPTY, NO_USER);
     cout << "OK" << endl;
-    
+
     // 保存数据
     saveData();
 }
@@ -431,42 +3980,71 @@ void adminCancelReservation(const string &day, int floor, int row, int col) {
 // 参数: newRows - 每楼层新的行数
 // 参数: newCols - 每行新的列数
 void manageSeats(int newFloors, int newRows, int newCols) {
+    PhaseScope phase(PHASE_EXECUTE);
     // 验证参数有效性
     if (newFloors <= 0 || newRows <= 0 || newCols <= 0) {
-        cout << "ERROR: Invalid parameters." << endl;
+        reportError("ERROR: Invalid parameters.");
         return;
     }
-    
-    // 保存当前数据到临时变量，以便在调整后恢复原有数据
-    auto tempLibrary = library;
-    int oldFloors = FLOORS;
+
+    // 调整布局需要遍历全部日期，未加载的日期按原布局先加载
+    loadAllDays();
     int oldRows = ROWS;
     int oldCols = COLS;
-    
+    journalSnapshot = true;
+
     // 更新全局座位数量配置
     FLOORS = newFloors;
     ROWS = newRows;
     COLS = newCols;
-    
-    // 重新初始化library以适应新的大小
-    initializeLibrary();
-    
+    seatConfig.floors = FLOORS;
+    seatConfig.rows = ROWS;
+    seatConfig.cols = COLS;
+
     // 计算新旧大小的最小值，以确定可以恢复多少原有数据
-    int minFloors = min(oldFloors, newFloors);
     int minRows = min(oldRows, newRows);
     int minCols = min(oldCols, newCols);
-    
-    // 恢复尽可能多的原有数据
-    for (int d = 0; d < NUM_DAYS; d++) {
-        for (int f = 0; f < minFloors; f++) {
+
+    // 只需调整已分配的楼层，尽可能保留原有数据
+    for (unique_ptr<DayData> &day : calendar) {
+        if (!day) continue;
+        // 删除多余的楼层及其候补
+        if ((int)day->floors.size() > FLOORS) {
+            day->floors.resize(FLOORS);
+        }
+        if ((int)day->waitlists.size() > FLOORS + 1) {
+            day->waitlists.resize(FLOORS + 1);
+            for (auto it = day->waiting.begin(); it != day->waiting.end();) {
+                it = it->second.floor >= FLOORS ? day->waiting.erase(it) : next(it);
+            }
+        }
+        for (unique_ptr<FloorData> &floorData : day->floors) {
+            if (!floorData) continue;
+            SeatList seats(ROWS * COLS, EMPTY_SEAT);
+            int used = 0;
             for (int r = 0; r < minRows; r++) {
                 for (int c = 0; c < minCols; c++) {
-                    library[d][f][r][c] = tempLibrary[d][f][r][c];
+                    seats[r * COLS + c] = floorData->seats[r * oldCols + c];
+                    used += seats[r * COLS + c].status != EMPTY;
+                }
+            }
+            floorData->seats.swap(seats);
+            floorData->used = used;
+            // 按时段预约换算到新的座位下标，超出新范围的随座位一起删除
+            decltype(floorData->slotBookings) bookings;
+            for (auto &entry : floorData->slotBookings) {
+                int r = (int)entry.first / oldCols, c = (int)entry.first % oldCols;
+                if (r < minRows && c < minCols) {
+                    bookings[(uint32_t)(r * COLS + c)].swap(entry.second);
                 }
             }
+            floorData->slotBookings.swap(bookings);
+            rebuildSlotBits(*floorData);
         }
+        // 座位下标随布局变化，重建用户预约索引
+        rebuildUserIndex(*day);
     }
-    
+
     // 显示操作结果并保存数据
     cout << "Seats updated successfully." << endl;
     saveData();
@@ -476,23 +4054,23 @@ void manageSeats(int newFloors, int newRows, int newCols) {
 // 管理员专用功能：清空指定日期的所有预约
 // 参数: day - 要清空预约的日期
 void clearDayReservations(const string &day) {
-    // 获取日期索引并验证
-    int dayIndex = getDayIndex(day);
-    if (dayIndex == -1) {
-        cout << "ERROR: Invalid day." << endl;
+    PhaseScope phase(PHASE_EXECUTE);
+    // 获取日期编号并验证
+    int date = getDate(day);
+    if (date == -1) {
+        reportError("ERROR: Invalid day.");
         return;
     }
-    
-    // 遍历该日期的所有楼层、行和列，清空所有座位的预约状态
-    for (int f = 0; f < FLOORS; f++) {
-        for (int r = 0; r < ROWS; r++) {
-            for (int c = 0; c < COLS; c++) {
-                library[dayIndex][f][r][c].status = EMPTY;
-                library[dayIndex][f][r][c].user = ' ';
-            }
-        }
+
+    // 写入历史归档后直接释放该日期的全部座位数据
+    if (findDay(date)) {
+        HistoryBatch history;
+        collectDayHistory(date, history);
+        appendHistory(history, HISTORY_CLEAR_DAY);
+        calendar[date % HORIZON_DAYS].reset();
+        journalDroppedDays.push_back(date);
     }
-    
+
     // 显示操作结果并保存数据
     cout << "All reservations for " << day << " cleared." << endl;
     saveData();
@@ -502,25 +4080,35 @@ void clearDayReservations(const string &day) {
 // 管理员专用功能：清空指定楼层的所有预约
 // 参数: floor - 要清空预约的楼层
 void clearFloorReservations(int floor) {
+    PhaseScope phase(PHASE_EXECUTE);
     // 验证楼层号有效性
     if (floor < 1 || floor > FLOORS) {
-        cout << "ERROR: Invalid floor." << endl;
+        reportError("ERROR: Invalid floor.");
         return;
     }
-    
+
     // 将1-based索引转换为0-based索引
     floor--;
-    
-    // 遍历该楼层的所有日期、行和列，清空所有座位的预约状态
-    for (int d = 0; d < NUM_DAYS; d++) {
-        for (int r = 0; r < ROWS; r++) {
-            for (int c = 0; c < COLS; c++) {
-                library[d][floor][r][c].status = EMPTY;
-                library[d][floor][r][c].user = ' ';
+    journalSnapshot = true;
+    loadAllDays();
+
+    // 释放所有日期中该楼层的座位数据（先写入历史归档），并重建当天的用户预约索引；
+    // 当天有候补时，该层的座位依次分配给候补用户
+    HistoryBatch history;
+    for (int date = today; date < today + HORIZON_DAYS; date++) {
+        collectFloorHistory(date, floor, history);
+    }
+    appendHistory(history, HISTORY_CLEAR_FLOOR);
+    for (unique_ptr<DayData> &day : calendar) {
+        if (day && floor < (int)day->floors.size() && day->floors[floor]) {
+            day->floors[floor].reset();
+            rebuildUserIndex(*day);
+            for (int i = 0; i < ROWS * COLS && i < (int)day->waiting.size(); i++) {
+                freedSeats.push_back({day->date, (uint32_t)(floor * ROWS * COLS + i)});
             }
         }
     }
-    
+
     // 显示操作结果并保存数据
     cout << "All reservations for Floor " << (floor + 1) << " cleared." << endl;
     saveData();
@@ -531,29 +4119,31 @@ void clearFloorReservations(int floor) {
 // 参数: day - 日期
 // 参数: floor - 楼层
 void setUnavailable(const string &day, int floor) {
-    // 获取日期索引并验证参数有效性
-    int dayIndex = getDayIndex(day);
-    if (dayIndex == -1 || floor < 1 || floor > FLOORS) {
-        cout << "ERROR: Invalid parameters." << endl;
+    PhaseScope phase(PHASE_EXECUTE);
+    // 获取日期编号并验证参数有效性
+    int date = getDate(day);
+    if (date == -1 || floor < 1 || floor > FLOORS) {
+        reportError("ERROR: Invalid parameters.");
         return;
     }
-    
+
     // 将1-based索引转换为0-based索引
     floor--;
-    
+
     // 遍历指定日期和楼层的所有行和列，设置座位为不可用状态
+    FloorData &floorData = ensureFloor(date, floor);
     for (int r = 0; r < ROWS; r++) {
         for (int c = 0; c < COLS; c++) {
             // 如果座位已有预约，显示警告信息
-            if (library[dayIndex][floor][r][c].status == RESERVED) {
+            char status = (char)floorData.seats[r * COLS + c].status;
+            if (status == RESERVED || status == PARTIAL) {
                 cout << "Warning: Some seats are already reserved and will be unavailable." << endl;
             }
             // 设置座位为不可用状态并清空用户标识
-            library[dayIndex][floor][r][c].status = UNAVAILABLE;
-            library[dayIndex][floor][r][c].user = ' ';
+            setSeat(date, floor, r, c, UNAVAILABLE, NO_USER);
         }
     }
-    
+
     // 显示操作结果并保存数据
     cout << day << " Floor " << (floor + 1) << " is now unavailable." << endl;
     saveData();
@@ -564,59 +4154,311 @@ void setUnavailable(const string &day, int floor) {
 // 参数: day - 日期
 // 参数: floor - 楼层
 void setAvailable(const string &day, int floor) {
-    // 获取日期索引并验证参数有效性
-    int dayIndex = getDayIndex(day);
-    if (dayIndex == -1 || floor < 1 || floor > FLOORS) {
-        cout << "ERROR: Invalid parameters." << endl;
+    PhaseScope phase(PHASE_EXECUTE);
+    // 获取日期编号并验证参数有效性
+    int date = getDate(day);
+    if (date == -1 || floor < 1 || floor > FLOORS) {
+        reportError("ERROR: Invalid parameters.");
+        return;
+    }
+
+    // 将1-based索引转换为0-based索引
+    floor--;
+
+    // 遍历指定日期和楼层的所有行和列，将不可用座位设为可用
+    FloorData *floorData = findFloor(date, floor);
+    if (floorData) {
+        for (int r = 0; r < ROWS; r++) {
+            for (int c = 0; c < COLS; c++) {
+                if (floorData->seats[r * COLS + c].status == UNAVAILABLE) {
+                    setSeat(date, floor, r, c, EMPTY, NO_USER);
+                }
+            }
+        }
+    }
+
+    // 显示操作结果并保存数据
+    cout << day << " Floor " << (floor + 1) << " is now available." << endl;
+    saveData();
+}
+
+// 清空指定用户的数据
+// 管理员专用功能：清除指定用户的所有预约记录
+// 参数: user - 要清除数据的用户编号
+void clearUserData(UserId user) {
+    PhaseScope phase(PHASE_EXECUTE);
+    // 通过每天的用户预约索引查找并清除指定用户的数据
+    if (user != NO_USER) {
+        for (int date = today; date < today + HORIZON_DAYS; date++) {
+            cancelUserReservation(date, user);
+        }
+    }
+    // 保存数据并显示操作结果
+    saveData();
+    cout << "User " << userName(user) << "'s data cleared." << endl;
+}
+
+// 开始事务
+// 之后的命令只修改内存中的数据，提交时一次性写入文件
+void beginTransaction() {
+    if (inTransaction) {
+        reportError("ERROR: Transaction already in progress.");
+        return;
+    }
+    inTransaction = true;
+    transactionErrors = 0;
+    pendingHistory.clear();
+    transactionBaseVersion = dataVersion;
+    cout << "Transaction started." << endl;
+}
+
+// 回滚事务：丢弃事务中的全部修改，重新加载数据文件
+void rollbackTransaction() {
+    if (!inTransaction) {
+        reportError("ERROR: No transaction in progress.");
+        return;
+    }
+    inTransaction = false;
+    pendingHistory.clear();
+    loadData();
+    clearJournalPending();
+    cout << "Transaction rolled back." << endl;
+}
+
+// 提交事务
+// 事务中有命令失败，或数据文件在事务期间被其他会话修改时，整个事务回滚；否则一次性写入
+void commitTransaction() {
+    if (!inTransaction) {
+        reportError("ERROR: No transaction in progress.");
         return;
     }
-    
-    // 将1-based索引转换为0-based索引
-    floor--;
-    
-    // 遍历指定日期和楼层的所有行和列，将不可用座位设为可用
-    for (int r = 0; r < ROWS; r++) {
-        for (int c = 0; c < COLS; c++) {
-            if (library[dayIndex][floor][r][c].status == UNAVAILABLE) {
-                library[dayIndex][floor][r][c].status = EMPTY;
-                library[dayIndex][floor][r][c].user = ' ';
+    inTransaction = false;
+    // 事务中被清空的记录只有在写入成功后才归档
+    vector<pair<HistoryKind, HistoryBatch>> history;
+    history.swap(pendingHistory);
+    if (transactionErrors > 0) {
+        loadData();
+        reportError("ERROR: " + to_string(transactionErrors) + " command(s) failed, transaction rolled back.");
+        return;
+    }
+    if (readDataVersion() != transactionBaseVersion) {
+        loadData();
+        reportError("ERROR: Data changed by another session, transaction rolled back.");
+        return;
+    }
+    bool failedBefore = commandFailed;
+    saveData();
+    if (commandFailed && !failedBefore) {
+        return;
+    }
+    for (const auto &entry : history) {
+        appendHistory(entry.second, entry.first);
+    }
+    cout << "Transaction committed." << endl;
+}
+
+// ===================== 导出 =====================
+// Export 命令和 --export 启动参数把座位记录导出为 CSV 或 JSON：直接遍历内存中的座位数据，
+// 每条记录写入固定大小的缓冲区，缓冲区满时才写到输出流，不会先拼出整个文档，导出再大的图书馆也只占用固定内存。
+// 记录按楼层、日期、行、列的顺序输出（分片时各分片的结果依次拼接即为完整的顺序），只导出非空闲的座位，
+// 按时段预约的座位每条预约一条记录。
+// 字段：日期、星期、楼层、行、列、状态（reserved 或 unavailable）、用户名、时段（整天为空）、是否已签到
+
+// 导出时使用的缓冲写入器
+struct ExportWriter {
+    ostream &out;
+    bool json;                  // 输出 JSON（否则为 CSV）
+    bool firstRecord = true;    // 还没有写出记录（JSON 的记录之间需要逗号）
+    size_t used = 0;            // 缓冲区中待写出的字节数
+    char buffer[1 << 16];
+
+    ExportWriter(ostream &stream, bool asJson) : out(stream), json(asJson) {}
+
+    void write(const char *text, size_t length) {
+        if (used + length > sizeof(buffer)) flush();
+        memcpy(buffer + used, text, length);
+        used += length;
+    }
+
+    void write(const char *text) { write(text, strlen(text)); }
+
+    void write(const string &text) { write(text.data(), text.size()); }
+
+    void writeNumber(int value) {
+        char digits[16];
+        write(digits, (size_t)(to_chars(digits, digits + sizeof(digits), value).ptr - digits));
+    }
+
+    // 把缓冲区的内容写到输出流
+    void flush() {
+        out.write(buffer, (streamsize)used);
+        used = 0;
+    }
+
+    // 写出文件头（CSV 的列名或 JSON 数组的开头）
+    void begin() {
+        write(json ? "[" : "date,weekday,floor,row,col,status,user,time,checked_in\n");
+    }
+
+    // 写出文件尾并把缓冲区全部写出
+    void finish() {
+        if (json) write(firstRecord ? "]\n" : "\n]\n");
+        flush();
+        out.flush();
+    }
+
+    // 写出某天某层的字段前缀（同一天同一层的记录共用）
+    // 参数: floor - 1-based 楼层号
+    string prefix(int date, int floor) const {
+        if (json) {
+            return "{\"date\": \"" + formatDate(date) + "\", \"weekday\": \"" + DAYS[weekdayOf(date)] +
+                   "\", \"floor\": " + to_string(floor) + ", ";
+        }
+        return formatDate(date) + "," + DAYS[weekdayOf(date)] + "," + to_string(floor) + ",";
+    }
+
+    // 写出一条座位记录
+    // 参数: prefix - prefix() 生成的日期、星期、楼层字段
+    // 参数: row, col - 1-based 行列号
+    // 参数: user - 用户名，座位不可预约时为空
+    // 参数: slots - 预约的时段，0表示整天
+    void record(const string &prefix, int row, int col, bool unavailable, const string &user, SlotMask slots, bool checkedIn) {
+        if (json) {
+            write(firstRecord ? "\n  " : ",\n  ");
+            write(prefix);
+            write("\"row\": ");
+            writeNumber(row);
+            write(", \"col\": ");
+            writeNumber(col);
+            if (unavailable) {
+                write(", \"status\": \"unavailable\", \"user\": null");
+            } else {
+                write(", \"status\": \"reserved\", \"user\": \"");
+                write(user);
+                write("\"");
             }
+            if (slots) {
+                write(", \"time\": \"");
+                write(formatTimeRange(slots));
+                write("\"");
+            } else {
+                write(", \"time\": null");
+            }
+            write(checkedIn ? ", \"checked_in\": true}" : ", \"checked_in\": false}");
+        } else {
+            write(prefix);
+            writeNumber(row);
+            write(",");
+            writeNumber(col);
+            write(unavailable ? ",unavailable," : ",reserved,");
+            write(user);
+            write(",");
+            if (slots) write(formatTimeRange(slots));
+            write(checkedIn ? ",1\n" : ",0\n");
         }
+        firstRecord = false;
     }
-    
-    // 显示操作结果并保存数据
-    cout << day << " Floor " << (floor + 1) << " is now available." << endl;
-    saveData();
-}
+};
 
-// 清空指定用户的数据
-// 管理员专用功能：清除指定用户的所有预约记录
-// 参数: user - 要清除数据的用户标识
-void clearUserData(char user) {
-    // 遍历所有日期、楼层、行和列，查找并清除指定用户的数据
-    for (int d = 0; d < NUM_DAYS; d++) {
-        for (int f = 0; f < FLOORS; f++) {
-            for (int r = 0; r < ROWS; r++) {
-                for (int c = 0; c < COLS; c++) {
-                    if (library[d][f][r][c].user == user) {
-                        library[d][f][r][c].status = EMPTY;
-                        library[d][f][r][c].user = ' ';
+// 导出座位记录（不写文件头和文件尾）
+// 参数: date - 只导出该日期，-1 表示全部日期
+// 参数: floor - 只导出该楼层（0-based），-1 表示全部楼层
+void exportSeats(ExportWriter &writer, int date, int floor) {
+    int firstDate = date == -1 ? today : date;
+    int lastDate = date == -1 ? today + HORIZON_DAYS - 1 : date;
+    for (int f = 0; f < FLOORS; f++) {
+        if (floor != -1 && f != floor) continue;
+        for (int d = firstDate; d <= lastDate; d++) {
+            FloorData *floorData = findFloor(d, f);
+            if (!floorData || floorData->used == 0) continue;
+            const DayData &day = *findDay(d);
+            auto checkedIn = [&](UserId user) {
+                auto it = day.checkInDeadlines.find(user);
+                return it != day.checkInDeadlines.end() && it->second == CHECKED_IN;
+            };
+            string prefix = writer.prefix(d, f + 1);
+            forEachOccupiedSeat(*floorData, [&](int i) {
+                const Seat &seat = floorData->seats[i];
+                int r = i / COLS, c = i % COLS;
+                if (seat.status == PARTIAL) {
+                    for (const SlotBooking &booking : floorData->slotBookings[(uint32_t)i]) {
+                        writer.record(prefix, r + 1, c + 1, false, userName(booking.user), booking.slots,
+                                      checkedIn(booking.user));
                     }
+                } else if (seat.status == UNAVAILABLE) {
+                    writer.record(prefix, r + 1, c + 1, true, "", 0, false);
+                } else {
+                    writer.record(prefix, r + 1, c + 1, false, userName(seat.user), 0, checkedIn(seat.user));
                 }
-            }
+            });
         }
     }
-    // 保存数据并显示操作结果
-    saveData();
-    cout << "User " << user << "'s data cleared." << endl;
 }
 
+// 解析导出参数
+// 参数: args - "csv|json [day] [floor]"，日期为星期名称或 YYYY-MM-DD，楼层为数字
+// 参数: json, date, floor - 解析结果（date 为 -1 表示全部日期，floor 为 0-based，-1 表示全部楼层）
+// 返回: 参数有效时返回true
+bool parseExportArgs(const string &args, bool &json, int &date, int &floor) {
+    istringstream iss(args);
+    string format, word;
+    iss >> format;
+    if (format != "csv" && format != "json") return false;
+    json = format == "json";
+    date = -1;
+    floor = -1;
+    while (iss >> word) {
+        if (floor != -1) return false;
+        if (all_of(word.begin(), word.end(), ::isdigit)) {
+            floor = atoi(word.c_str()) - 1;
+            if (word.size() > 9 || floor < 0 || floor >= FLOORS) return false;
+        } else if (date == -1) {
+            date = getDate(word);
+            if (date == -1) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 管理员导出座位记录到控制台
+// 参数: args - "csv|json [day] [floor]"
+void exportData(const string &args) {
+    PhaseScope phase(PHASE_EXECUTE);
+    bool json;
+    int date, floor;
+    if (!parseExportArgs(args, json, date, floor)) {
+        reportError("ERROR: Invalid parameters.");
+        return;
+    }
+    ExportWriter writer(cout, json);
+    writer.begin();
+    exportSeats(writer, date, floor);
+    writer.finish();
+}
+
+// ===================== 命令解析 =====================
+
 // 解析并执行命令
 // 根据用户输入的命令字符串执行相应的操作
 // 参数: command - 用户输入的命令字符串
 void executeCommand(const string &command) {
-    // 重新加载数据以确保同步
-    loadData();
+    if (metricsEnabled) beginCommandMetrics();
+    commandFailed = false;
+
+    // 数据文件被修改过时重新加载以确保同步（事务中使用内存中已修改的数据）
+    if (!inTransaction && !dataFileUnchanged()) {
+        loadData();
+    }
+    if (!inTransaction) {
+        clearJournalPending();
+        acquiredSeats.clear();
+        // 释放超过签到截止时间仍未签到的预约
+        if (releaseNoShows()) {
+            saveData();
+        }
+    }
     
     bool commandHandled = false;  // 标记命令是否被处理
     
@@ -625,34 +4467,92 @@ void executeCommand(const string &command) {
         login();  // 用户登录
         commandHandled = true;
     } else if (command == "Exit") {
+        // 退出登录时未提交的事务被回滚
+        if (inTransaction) {
+            rollbackTransaction();
+        }
         exitLogin();  // 退出登录
         commandHandled = true;
     } else if (command == "Quit") {
         // 程序将在主函数中退出
         commandHandled = true;
-    } else if (currentUser == ' ') {
+    } else if (!isLoggedIn()) {
         // 用户未登录时，提示先登录
         cout << "Please login first." << endl;
         commandHandled = true;
     } else {
         // 处理登录后的命令
         
-        // 处理显示座位命令（如："Monday Floor 2"）
+        // 处理显示座位命令（如："Monday Floor 2" 或 "2026-11-03 Floor 2"）
         if (command.substr(0, 6) == "Monday" || command.substr(0, 7) == "Tuesday" || 
             command.substr(0, 9) == "Wednesday" || command.substr(0, 8) == "Thursday" || 
             command.substr(0, 6) == "Friday" || command.substr(0, 8) == "Saturday" || 
-            command.substr(0, 6) == "Sunday") {
+            command.substr(0, 6) == "Sunday" || isdigit((unsigned char)command[0])) {
             size_t floorPos = command.find("Floor");
+            size_t timePos = command.find(" Time ");
             if (floorPos != string::npos) {
                 string day = command.substr(0, floorPos - 1);
                 int floor = stoi(command.substr(floorPos + 5));
-                showSeats(day, floor);
+                if (timePos == string::npos) {
+                    showSeats(day, floor);
+                } else {
+                    // 按时间段显示（如："Monday Floor 3 Time 14-16"）
+                    SlotMask slots = parseTimeRange(command.substr(timePos + 6));
+                    if (slots != 0) {
+                        showSeats(day, floor, slots);
+                    } else {
+                        reportError("ERROR: Invalid time range.");
+                    }
+                }
                 commandHandled = true;
             } else {
-                cout << "ERROR" << endl;
+                reportError("ERROR");
                 commandHandled = true;
             }
         }
+        // 处理小组预约命令（如："ReserveGroup Monday Floor 2 Count 3 With B C"）
+        else if (command.substr(0, 13) == "ReserveGroup ") {
+            istringstream iss(command.substr(13));
+            string day, floorTag, countTag, withTag, name;
+            int floor = 0, count = 0;
+            vector<string> members;
+            if (iss >> day >> floorTag >> floor >> countTag >> count && floorTag == "Floor" && countTag == "Count" &&
+                (!(iss >> withTag) || withTag == "With")) {
+                while (iss >> name) {
+                    members.push_back(name);
+                }
+                reserveGroup(day, floor, count, members);
+            } else {
+                reportError("ERROR");
+            }
+            commandHandled = true;
+        }
+        // 按偏好自动预约（如："ReserveBest Monday window power"、"ReserveBest Monday Floor 2 Time 14-16 quiet"）
+        else if (command.substr(0, 12) == "ReserveBest " || command == "ReserveBest") {
+            istringstream iss(command.substr(11));
+            string day, word;
+            int floor = 0;
+            SlotMask slots = 0;
+            vector<string> prefs;
+            bool valid = (bool)(iss >> day);
+            while (valid && iss >> word) {
+                if (word == "Floor") {
+                    valid = iss >> word && all_of(word.begin(), word.end(), ::isdigit) && floor == 0;
+                    floor = valid ? max(atoi(word.c_str()), 0) : 0;
+                    valid = valid && floor > 0;
+                } else if (word == "Time") {
+                    valid = iss >> word && slots == 0 && (slots = parseTimeRange(word)) != 0;
+                } else {
+                    prefs.push_back(word);
+                }
+            }
+            if (valid) {
+                reserveBest(day, floor, slots, prefs);
+            } else {
+                reportError("ERROR");
+            }
+            commandHandled = true;
+        }
         // 处理预约座位命令（如："Reserve Monday Floor 2 Seat 3 4"）
         else if (command.substr(0, 7) == "Reserve") {
             size_t dayPos = command.find(" ") + 1;
@@ -664,30 +4564,140 @@ void executeCommand(const string &command) {
                 int floor = stoi(command.substr(floorPos + 5, seatPos - floorPos - 6));
                 
                 size_t spacePos = command.find(" ", seatPos + 5);
+                size_t timePos = command.find(" Time ");
                 if (spacePos != string::npos) {
                     try {
                         int row = stoi(command.substr(seatPos + 5, spacePos - seatPos - 5));
                         int col = stoi(command.substr(spacePos + 1));
-                        reserveSeat(day, floor, row, col);
+                        if (timePos == string::npos) {
+                            reserveSeat(day, floor, row, col);
+                        } else {
+                            // 按时段预约（如："Reserve Monday Floor 2 Seat 3 4 Time 14-16"）
+                            SlotMask slots = parseTimeRange(command.substr(timePos + 6));
+                            if (slots != 0) {
+                                reserveSeat(day, floor, row, col, slots);
+                            } else {
+                                reportError("ERROR: Invalid time range.");
+                            }
+                        }
                         commandHandled = true;
                     } catch (...) {
-                        cout << "ERROR" << endl;
+                        reportError("ERROR");
                         commandHandled = true;
                     }
                 } else {
-                    cout << "ERROR" << endl;
+                    reportError("ERROR");
                     commandHandled = true;
                 }
             } else {
-                cout << "ERROR" << endl;
+                reportError("ERROR");
                 commandHandled = true;
             }
         }
+        // 查询指定时间段的空闲座位（如："Free Monday Floor 3 Time 14-16"）
+        else if (command.substr(0, 5) == "Free ") {
+            size_t floorPos = command.find(" Floor ");
+            size_t timePos = command.find(" Time ");
+            if (floorPos != string::npos && timePos != string::npos && floorPos < timePos) {
+                try {
+                    string day = command.substr(5, floorPos - 5);
+                    int floor = stoi(command.substr(floorPos + 7, timePos - floorPos - 7));
+                    showFreeSeats(day, floor, parseTimeRange(command.substr(timePos + 6)));
+                } catch (...) {
+                    reportError("ERROR");
+                }
+            } else {
+                reportError("ERROR");
+            }
+            commandHandled = true;
+        }
+        // 加入候补队列（如："Waitlist Monday" 或 "Waitlist Monday Floor 3"）
+        else if (command.substr(0, 9) == "Waitlist ") {
+            istringstream iss(command.substr(9));
+            string day, floorTag;
+            int floor = 0;
+            if (iss >> day && (!(iss >> floorTag) || (floorTag == "Floor" && iss >> floor && floor >= 1))) {
+                joinWaitlist(day, floor);
+            } else {
+                reportError("ERROR");
+            }
+            commandHandled = true;
+        }
+        // 查询变化的座位（如："Changes since 42"、"Changes since 42 Monday Floor 2 Wait 30"）
+        else if (command.substr(0, 14) == "Changes since ") {
+            istringstream iss(command.substr(14));
+            string day, word;
+            int floor = 0, waitSeconds = 0;
+            uint64_t since = 0;
+            bool valid = (bool)(iss >> since);
+            bool pending = false;  // word 中是否已有读出但尚未处理的词
+            while (valid && (pending || iss >> word)) {
+                pending = false;
+                if (word == "Wait") {
+                    // 默认最多等待30秒，最长300秒；Wait 后没有参数或紧跟日期时使用默认值
+                    waitSeconds = 30;
+                    if (!(iss >> word)) {
+                        break;
+                    }
+                    if (getDate(word) != -1) {
+                        pending = true;  // 日期留给下一轮作为过滤条件
+                    } else {
+                        valid = word.size() <= 3 && all_of(word.begin(), word.end(), ::isdigit) &&
+                                (waitSeconds = atoi(word.c_str())) <= 300;
+                    }
+                } else if (day.empty()) {
+                    day = word;
+                    valid = iss >> word && word == "Floor" && iss >> floor;
+                } else {
+                    valid = false;
+                }
+            }
+            if (valid) {
+                showChanges(since, day, floor, waitSeconds);
+            } else {
+                reportError("ERROR");
+            }
+            commandHandled = true;
+        }
+        // 查询版本号（如："Version" 或 "Version Monday Floor 2"）
+        else if (command == "Version" || command.substr(0, 8) == "Version ") {
+            istringstream iss(command.substr(7));
+            string day, floorTag;
+            int floor = 0;
+            if (!(iss >> day) || (iss >> floorTag >> floor && floorTag == "Floor")) {
+                showVersion(day, floor);
+            } else {
+                reportError("ERROR");
+            }
+            commandHandled = true;
+        }
+        // 事务命令
+        else if (command == "Begin") {
+            beginTransaction();
+            commandHandled = true;
+        } else if (command == "Commit") {
+            commitTransaction();
+            commandHandled = true;
+        } else if (command == "Rollback") {
+            rollbackTransaction();
+            commandHandled = true;
+        }
+        // 签到今天的预约
+        else if (command == "CheckIn") {
+            checkIn();
+            commandHandled = true;
+        }
         // 处理显示预约命令
         else if (command == "Reservation") {
             showReservations();
             commandHandled = true;
         }
+        // 切换座位图的紧凑显示（如："Compact on"、"Compact off"）
+        else if (command == "Compact on" || command == "Compact off") {
+            compactGrid = (command == "Compact on");
+            cout << "Compact view " << (compactGrid ? "on." : "off.") << endl;
+            commandHandled = true;
+        }
         // 管理员功能
         else if (command == "Clear" && isAdmin) {
             // 管理员清空所有数据
@@ -695,12 +4705,17 @@ void executeCommand(const string &command) {
             commandHandled = true;
         } else if (command.substr(0, 6) == "Clear " && isAdmin) {
             // 管理员清空指定用户数据（如："Clear A"）
-            char user = toupper(command[6]);
-            if (isalpha(user)) {
-                clearUserData(user);
+            string username = normalizeUsername(command.substr(6));
+            if (isValidUsername(username)) {
+                UserId user = findUser(username);
+                if (user != NO_USER) {
+                    clearUserData(user);
+                } else {
+                    cout << "User " << username << "'s data cleared." << endl;
+                }
                 commandHandled = true;
             } else {
-                cout << "ERROR" << endl;
+                reportError("ERROR");
                 commandHandled = true;
             }
         } else if (isAdmin) {
@@ -712,10 +4727,10 @@ void executeCommand(const string &command) {
                     istringstream iss(command.substr(13));
                     string day, user; int floor, row, col;
                     iss >> day >> floor >> user >> row >> col;
-                    adminReserveSeat(day, floor, row, col, toupper(user[0]));
+                    adminReserveSeat(day, floor, row, col, user);
                     commandHandled = true;
                 } catch (...) {
-                    cout << "ERROR" << endl;
+                    reportError("ERROR");
                     commandHandled = true;
                 }
             }
@@ -728,7 +4743,7 @@ void executeCommand(const string &command) {
                     adminCancelReservation(day, floor, row, col);
                     commandHandled = true;
                 } catch (...) {
-                    cout << "ERROR" << endl;
+                    reportError("ERROR");
                     commandHandled = true;
                 }
             }
@@ -741,7 +4756,7 @@ void executeCommand(const string &command) {
                     manageSeats(floors, rows, cols);
                     commandHandled = true;
                 } catch (...) {
-                    cout << "ERROR" << endl;
+                    reportError("ERROR");
                     commandHandled = true;
                 }
             }
@@ -752,7 +4767,7 @@ void executeCommand(const string &command) {
                     clearDayReservations(day);
                     commandHandled = true;
                 } catch (...) {
-                    cout << "ERROR" << endl;
+                    reportError("ERROR");
                     commandHandled = true;
                 }
             }
@@ -763,12 +4778,12 @@ void executeCommand(const string &command) {
                     clearFloorReservations(floor);
                     commandHandled = true;
                 } catch (...) {
-                    cout << "ERROR" << endl;
+                    reportError("ERROR");
                     commandHandled = true;
                 }
             }
             // 管理员设置某日期楼层不可预约（如："SetUnavailable Monday 2"）
-            else if (command.substr(0, 13) == "SetUnavailable") {
+            else if (command.substr(0, 14) == "SetUnavailable") {
                 try {
                     istringstream iss(command.substr(14));
                     string day; int floor;
@@ -776,12 +4791,12 @@ void executeCommand(const string &command) {
                     setUnavailable(day, floor);
                     commandHandled = true;
                 } catch (...) {
-                    cout << "ERROR" << endl;
+                    reportError("ERROR");
                     commandHandled = true;
                 }
             }
             // 管理员设置某日期楼层可预约（如："SetAvailable Monday 2"）
-            else if (command.substr(0, 11) == "SetAvailable") {
+            else if (command.substr(0, 12) == "SetAvailable") {
                 try {
                     istringstream iss(command.substr(12));
                     string day; int floor;
@@ -789,33 +4804,595 @@ void executeCommand(const string &command) {
                     setAvailable(day, floor);
                     commandHandled = true;
                 } catch (...) {
-                    cout << "ERROR" << endl;
+                    reportError("ERROR");
                     commandHandled = true;
                 }
             }
+            // 管理员查看性能统计（如："Metrics" 或 "Metrics Reset"）
+            else if (command == "Metrics" || command == "Metrics Reset") {
+                if (!metricsEnabled) {
+                    cout << "Metrics disabled. Start the program with --metrics to enable." << endl;
+                } else if (command == "Metrics Reset") {
+                    resetMetrics();
+                    cout << "Metrics reset." << endl;
+                } else {
+                    writeMetricsText(cout);
+                }
+                commandHandled = true;
+            }
+            // 管理员查看内存占用
+            else if (command == "Memory") {
+                showMemory();
+                commandHandled = true;
+            }
+            // 管理员查看历史使用情况（如："Analytics"、"Analytics Floor 2" 或 "Analytics Users 5"）
+            else if (command == "Analytics" || command.substr(0, 10) == "Analytics ") {
+                showAnalytics(command.substr(9));
+                commandHandled = true;
+            }
+            // 管理员导出座位记录（如："Export csv"、"Export json Monday" 或 "Export csv 2026-11-03 2"）
+            else if (command.substr(0, 7) == "Export ") {
+                exportData(command.substr(7));
+                commandHandled = true;
+            }
         } else {
             // 对于登录后不符合任何已知格式的命令，输出ERROR
-            cout << "ERROR" << endl;
+            reportError("ERROR");
             commandHandled = true;
         }
     }
     
     // 如果命令没有被处理，输出ERROR
     if (!commandHandled && command != "Quit") {
-        cout << "ERROR" << endl;
+        reportError("ERROR");
+    }
+    if (inTransaction && commandFailed) {
+        transactionErrors++;
+    }
+    enforceMemoryBudget();
+
+    if (metricsEnabled) endCommandMetrics(classifyCommand(command));
+}
+
+// ===================== 分片 =====================
+// 启动参数 --shards N 时按楼层把图书馆分成 N 个分片：主进程只作为路由进程处理登录和命令分发，
+// 每个分片由一个子进程负责，拥有连续的一段楼层和自己的数据文件（library_data.shardK.txt），
+// 只加载和保存这些楼层，因此各分片的写入互不影响。
+// 带楼层的命令（"Monday Floor n"、Reserve、Free、ReserveGroup、Waitlist、AdminReserve 等）只发给负责该楼层的分片；
+// Reservation、Clear、Clear A、ClearDay 等跨楼层的命令同时发给所有分片并合并结果；
+// 某个分片上有用户获得座位后，路由进程取消该用户当天在其他分片上的预约，保证同一用户同一天只有一个座位。
+// 路由进程与分片进程之间通过管道逐行通信：
+//   路由 -> 分片：上下文 命令       （上下文为用户编号，管理员为 A）
+//                #CANCEL 日期 用户编号（取消该用户当天在本分片的预约）
+//                #QUIT
+//   分片 -> 路由：命令输出，随后是若干行 "#ACQ 日期 用户编号"（本次命令中获得座位的用户），最后一行 #END
+#ifndef _WIN32
+
+// 一个分片进程
+struct Shard {
+    pid_t pid;
+    FILE *in;          // 向分片发送命令
+    FILE *out;         // 读取分片的输出
+    int firstFloor;    // 负责的楼层范围（1-based，含两端）
+    int lastFloor;
+};
+
+vector<Shard> shards;
+
+// 分片的文件名：在扩展名前插入 .shardK（K 从1开始）
+string shardFileName(const string &file, int shard) {
+    size_t dot = file.rfind('.');
+    if (dot == string::npos || file.find('/', dot) != string::npos) {
+        dot = file.size();
+    }
+    return file.substr(0, dot) + ".shard" + to_string(shard + 1) + file.substr(dot);
+}
+
+// 负责某楼层（1-based）的分片，无效楼层交给第一个或最后一个分片报错
+int shardOfFloor(int floor) {
+    for (int i = 0; i < (int)shards.size(); i++) {
+        if (floor <= shards[i].lastFloor) return i;
+    }
+    return (int)shards.size() - 1;
+}
+
+// 只保留本分片楼层（0-based，[first, last)）的数据，从未分片的数据文件导入时使用；
+// 任意楼层的候补留在第一个分片
+void keepShardFloors(int first, int last) {
+    loadAllDays();
+    for (unique_ptr<DayData> &day : calendar) {
+        if (!day) continue;
+        for (int f = 0; f < (int)day->floors.size(); f++) {
+            if (f < first || f >= last) {
+                day->floors[f].reset();
+            }
+        }
+        rebuildUserIndex(*day);
+        for (auto it = day->waiting.begin(); it != day->waiting.end();) {
+            int floor = it->second.floor;
+            bool keep = floor < 0 ? first == 0 : (floor >= first && floor < last);
+            it = keep ? next(it) : day->waiting.erase(it);
+        }
     }
 }
 
+// 分片进程的命令循环：从管道读取命令并执行，输出写回管道
+void runShardWorker() {
+    string line;
+    while (getline(cin, line) && line != "#QUIT") {
+        if (line.compare(0, 8, "#CANCEL ") == 0) {
+            // 该用户已在其他分片获得座位，取消其当天在本分片的预约和候补
+            istringstream iss(line.substr(8));
+            string value;
+            UserId user;
+            if (iss >> value >> user) {
+                loadData();
+                clearJournalPending();
+                acquiredSeats.clear();
+                int date = parseIsoDate(value);
+                DayData *day = findDay(date);
+                if (day && (day->userSeat.count(user) || day->userSlot.count(user) || day->waiting.count(user))) {
+                    cancelUserReservation(date, user);
+                    saveData();
+                }
+            }
+        } else {
+            // 按路由进程传来的登录状态执行命令
+            size_t space = line.find(' ');
+            string context = line.substr(0, space);
+            isAdmin = context == "A";
+            currentUser = isAdmin ? NO_USER : (UserId)strtoul(context.c_str(), nullptr, 10);
+            executeCommand(space == string::npos ? "" : line.substr(space + 1));
+        }
+        sort(acquiredSeats.begin(), acquiredSeats.end());
+        acquiredSeats.erase(unique(acquiredSeats.begin(), acquiredSeats.end()), acquiredSeats.end());
+        for (const pair<int, UserId> &acquired : acquiredSeats) {
+            cout << "#ACQ " << formatDate(acquired.first) << ' ' << acquired.second << '\n';
+        }
+        cout << "#END" << endl;
+    }
+    dumpMetrics();
+}
+
+// 启动分片进程
+// 分片的数据文件不存在时，从已加载的（未分片的）数据中导入本分片的楼层
+// 返回: 是否全部启动成功
+bool startShards(int count) {
+    string dataFile = DATA_FILE, archiveFile = ARCHIVE_FILE;
+    for (int i = 0; i < count; i++) {
+        Shard shard;
+        shard.firstFloor = i * FLOORS / count + 1;
+        shard.lastFloor = (i + 1) * FLOORS / count;
+        int toShard[2], fromShard[2];
+        if (pipe(toShard) != 0 || pipe(fromShard) != 0) {
+            return false;
+        }
+        cout.flush();
+        shard.pid = fork();
+        if (shard.pid < 0) {
+            return false;
+        }
+        if (shard.pid == 0) {
+            // 分片进程：标准输入输出改为管道，关闭其他分片的管道
+            for (Shard &other : shards) {
+                fclose(other.in);
+                fclose(other.out);
+            }
+            dup2(toShard[0], STDIN_FILENO);
+            dup2(fromShard[1], STDOUT_FILENO);
+            close(toShard[0]);
+            close(toShard[1]);
+            close(fromShard[0]);
+            close(fromShard[1]);
+            shards.clear();
+            shardIndex = i;
+            DATA_FILE = shardFileName(dataFile, i);
+            ARCHIVE_FILE = shardFileName(archiveFile, i);
+            CHANGES_FILE = shardFileName(CHANGES_FILE, i);
+            if (!metricsDumpFile.empty()) {
+                metricsDumpFile = shardFileName(metricsDumpFile, i);
+            }
+            ifstream existing(DATA_FILE);
+            if (existing.is_open()) {
+                existing.close();
+                loadData();
+            } else {
+                keepShardFloors(shard.firstFloor - 1, shard.lastFloor);
+                saveData();
+            }
+            runShardWorker();
+            exit(0);
+        }
+        close(toShard[0]);
+        close(fromShard[1]);
+        shard.in = fdopen(toShard[1], "w");
+        shard.out = fdopen(fromShard[0], "r");
+        shards.push_back(shard);
+    }
+    return true;
+}
+
+// 向分片发送一行命令
+void sendToShard(int shard, const string &line) {
+    fputs(line.c_str(), shards[shard].in);
+    fputc('\n', shards[shard].in);
+    fflush(shards[shard].in);
+}
+
+// 读取分片对一条命令的回复，输出追加到 output，获得座位的用户追加到 acquired（日期，用户编号，分片）
+// 返回: 分片是否正常回复
+bool readShardReply(int shard, string &output, vector<pair<pair<string, UserId>, int>> &acquired) {
+    char *line = nullptr;
+    size_t capacity = 0;
+    ssize_t length;
+    bool ended = false;
+    while ((length = getline(&line, &capacity, shards[shard].out)) > 0) {
+        if (strcmp(line, "#END\n") == 0) {
+            ended = true;
+            break;
+        }
+        if (strncmp(line, "#ACQ ", 5) == 0) {
+            char date[16];
+            unsigned long user;
+            if (sscanf(line + 5, "%15s %lu", date, &user) == 2) {
+                acquired.push_back({{date, (UserId)user}, shard});
+            }
+        } else {
+            output.append(line, (size_t)length);
+        }
+    }
+    free(line);
+    return ended;
+}
+
+// 把命令发给一组分片（先全部发出再依次读取，各分片并行执行），
+// 然后取消获得座位的用户在其他分片上当天的预约（取消后其他分片的候补可能获得座位，依次处理）
+// 返回: 各分片的输出
+vector<string> dispatchToShards(const vector<int> &targets, const string &line) {
+    vector<string> outputs(targets.size());
+    vector<pair<pair<string, UserId>, int>> acquired;
+    for (int shard : targets) {
+        sendToShard(shard, line);
+    }
+    for (size_t i = 0; i < targets.size(); i++) {
+        if (!readShardReply(targets[i], outputs[i], acquired)) {
+            outputs[i] = "ERROR: Shard " + to_string(targets[i] + 1) + " is not responding.\n";
+        }
+    }
+    for (size_t i = 0; i < acquired.size(); i++) {
+        string cancel = "#CANCEL " + acquired[i].first.first + " " + to_string(acquired[i].first.second);
+        for (int shard = 0; shard < (int)shards.size(); shard++) {
+            if (shard == acquired[i].second) continue;
+            string ignored;
+            sendToShard(shard, cancel);
+            readShardReply(shard, ignored, acquired);
+        }
+    }
+    return outputs;
+}
+
+// 命令涉及的楼层（1-based），不涉及具体楼层时返回0
+int commandFloor(const string &command) {
+    istringstream iss(command);
+    vector<string> words;
+    string word;
+    while (iss >> word) {
+        words.push_back(word);
+    }
+    if (words.empty()) return 0;
+    const string &name = words[0];
+    if ((name == "AdminReserve" || name == "AdminCancel" || name == "SetUnavailable" || name == "SetAvailable") &&
+        words.size() > 2) {
+        return max(atoi(words[2].c_str()), 1);
+    }
+    if (name == "ClearFloor" && words.size() > 1) {
+        return max(atoi(words[1].c_str()), 1);
+    }
+    if (name == "Export") {
+        // 导出命令的楼层是日期之后的纯数字参数
+        for (size_t i = 2; i < words.size(); i++) {
+            if (all_of(words[i].begin(), words[i].end(), ::isdigit)) return max(atoi(words[i].c_str()), 1);
+        }
+        return 0;
+    }
+    for (size_t i = 0; i + 1 < words.size(); i++) {
+        if (words[i] == "Floor") return max(atoi(words[i + 1].c_str()), 1);
+    }
+    return 0;
+}
+
+// 路由一条已登录用户的命令
+void routeCommand(const string &command) {
+    string name = command.substr(0, command.find(' '));
+    string line = (isAdmin ? string("A") : to_string(currentUser)) + " " + command;
+    int floor = commandFloor(command);
+    if (floor > 0) {
+        cout << dispatchToShards({shardOfFloor(floor)}, line)[0];
+        cout.flush();
+        return;
+    }
+    if (name == "Begin" || name == "Commit" || name == "Rollback") {
+        reportError("ERROR: Transactions are not supported in sharded mode.");
+        return;
+    }
+    if (name == "Waitlist" || name == "Changes" || name == "Version" || name == "Export" || name == "ReserveBest") {
+        // 各分片的版本号互相独立，候补和变更查询必须指定楼层；导出的数据不经过路由进程汇总，也必须指定楼层；
+        // 按偏好预约只能在一个分片内比较座位
+        reportError("ERROR: Please specify a floor in sharded mode.");
+        return;
+    }
+    if (name == "ManageSeats" && isAdmin) {
+        istringstream iss(command.substr(11));
+        int floors = 0;
+        if (iss >> floors && floors != FLOORS) {
+            reportError("ERROR: The number of floors cannot be changed in sharded mode.");
+            return;
+        }
+    }
+    if (name != "Reservation" && name != "Clear" && name != "ClearDay" && name != "Compact" &&
+        name != "ManageSeats" && name != "Metrics" && name != "CheckIn" && name != "Analytics" &&
+        name != "Memory") {
+        // 其他命令（包括格式错误的命令）交给第一个分片处理
+        cout << dispatchToShards({0}, line)[0];
+        cout.flush();
+        return;
+    }
+
+    vector<int> all;
+    for (int i = 0; i < (int)shards.size(); i++) {
+        all.push_back(i);
+    }
+    vector<string> outputs = dispatchToShards(all, line);
+    if (name == "Reservation") {
+        // 合并各分片的预约，按日期排序（同一天的按楼层顺序）
+        vector<string> lines;
+        for (const string &output : outputs) {
+            istringstream iss(output);
+            string text;
+            while (getline(iss, text)) {
+                if (text != "No reservations.") lines.push_back(text);
+            }
+        }
+        stable_sort(lines.begin(), lines.end(), [](const string &a, const string &b) {
+            return a.compare(0, 10, b, 0, 10) < 0;
+        });
+        for (const string &text : lines) {
+            outputBuffer += text;
+            outputBuffer += '\n';
+        }
+        if (lines.empty()) {
+            outputBuffer += "No reservations.\n";
+        }
+    } else if ((command == "Metrics" || name == "Analytics" || command == "Memory") && isAdmin) {
+        // 各分片的统计分别显示
+        for (size_t i = 0; i < outputs.size(); i++) {
+            outputBuffer += "Shard " + to_string(i + 1) + " (Floor " + to_string(shards[i].firstFloor) + "-" +
+                            to_string(shards[i].lastFloor) + "):\n" + outputs[i];
+        }
+    } else {
+        // 各分片的结果相同，只显示一份；有分片出错时显示出错的结果。
+        // 签到只在用户预约所在的分片成功，显示成功的结果
+        size_t shown = 0;
+        for (size_t i = 0; i < outputs.size(); i++) {
+            if ((outputs[i].compare(0, 5, "ERROR") == 0) != (name == "CheckIn")) {
+                shown = i;
+                break;
+            }
+        }
+        outputBuffer += outputs[shown];
+    }
+    flushOutput();
+}
+
+// 路由进程：启动分片进程并处理命令，直到收到 Quit 命令
+// 返回: 进程退出码
+int runRouter(int count) {
+    signal(SIGPIPE, SIG_IGN);
+    // 布局以第一个分片的数据为准；还没有分片数据时导入未分片的数据文件
+    ifstream existing(shardFileName(DATA_FILE, 0));
+    if (existing.is_open()) {
+        existing.close();
+        string dataFile = DATA_FILE, archiveFile = ARCHIVE_FILE;
+        DATA_FILE = shardFileName(dataFile, 0);
+        ARCHIVE_FILE = shardFileName(archiveFile, 0);
+        loadData();
+        DATA_FILE = dataFile;
+        ARCHIVE_FILE = archiveFile;
+    } else {
+        loadData();
+    }
+    if (count > FLOORS) {
+        reportError("ERROR: The number of shards cannot exceed the number of floors.");
+        return 1;
+    }
+    if (!startShards(count)) {
+        reportError("ERROR: Failed to start shards.");
+        return 1;
+    }
+
+    string command;
+    while (true) {
+        cout << "Please enter command: ";
+        if (!getline(cin, command)) {
+            break;
+        }
+        size_t start = command.find_first_not_of(" ");
+        size_t end = command.find_last_not_of(" ");
+        if (start == string::npos) {
+            reportError("ERROR");
+            continue;
+        }
+        command = command.substr(start, end - start + 1);
+        if (command == "Quit") {
+            break;
+        } else if (command == "Login") {
+            login();
+        } else if (command == "Exit") {
+            // 数据由各分片保存，路由进程只清除登录状态
+            currentUser = NO_USER;
+            isAdmin = false;
+            cout << "Logged out." << endl;
+        } else if (!isLoggedIn()) {
+            cout << "Please login first." << endl;
+        } else {
+            routeCommand(command);
+        }
+    }
+
+    // 通知各分片退出并等待结束
+    for (Shard &shard : shards) {
+        sendToShard((int)(&shard - &shards[0]), "#QUIT");
+        fclose(shard.in);
+        fclose(shard.out);
+        waitpid(shard.pid, nullptr, 0);
+    }
+    cout << "Program exited." << endl;
+    return 0;
+}
+#endif
+
+// 启动参数 --export：把数据文件中的座位记录导出到标准输出后退出，不进入命令循环；
+// 分片模式下依次加载各分片的数据文件，各分片的记录按楼层顺序接在一起
+// 参数: args - "csv|json [day] [floor]"
+// 参数: shardCount - 分片数，1表示未分片
+// 返回: 进程退出码
+int runExport(const string &args, int shardCount) {
+    ExportWriter writer(cout, false);
+    string dataFile = DATA_FILE, archiveFile = ARCHIVE_FILE, changesFile = CHANGES_FILE;
+    for (int i = 0; i < shardCount; i++) {
+#ifndef _WIN32
+        if (shardCount > 1) {
+            DATA_FILE = shardFileName(dataFile, i);
+            ARCHIVE_FILE = shardFileName(archiveFile, i);
+            CHANGES_FILE = shardFileName(changesFile, i);
+        }
+#endif
+        initializeLibrary();
+        loadData();
+        int date, floor;
+        if (!parseExportArgs(args, writer.json, date, floor)) {
+            reportError("ERROR: Invalid parameters for --export.");
+            return 1;
+        }
+        if (i == 0) writer.begin();
+        exportSeats(writer, date, floor);
+    }
+    writer.finish();
+    return 0;
+}
+
+// 定义 LIBRARY_NO_MAIN 时不编译主函数，便于基准测试等工具直接包含本文件
+#ifndef LIBRARY_NO_MAIN
 // 主函数
 // 程序的入口点，负责初始化系统、处理用户命令和退出逻辑
-int main() {
+// 启动参数: --compact 紧凑显示座位图；--metrics 开启性能统计；
+//           --metrics=文件名 同时在退出时把统计结果写入该文件；
+//           --now YYYY-MM-DD 把今天视为指定日期（用于测试日期滚动）；
+//           --replicate-to 目录 把修改日志写入该目录供备用进程读取；
+//           --follow 目录 作为备用进程持续应用该目录中的日志，主进程退出后接管；
+//           --shards N 按楼层分成 N 个分片，由 N 个子进程分别负责
+int main(int argc, char *argv[]) {
+    string followDir, exportArgs;
+    int shardCount = 1;
+    // 解析启动参数
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--now" && i + 1 < argc) {
+            // YYYY-MM-DD 只改变日期；YYYY-MM-DDTHH:MM 同时指定时刻（用于测试签到超时）
+            string value = argv[++i];
+            int date = parseIsoDate(value.substr(0, 10));
+            int hour = 0, minute = 0;
+            bool hasTime = value.size() > 10;
+            if (date == -1 || (hasTime && (sscanf(value.c_str() + 10, "T%d:%d", &hour, &minute) != 2 ||
+                                           hour < 0 || hour > 23 || minute < 0 || minute > 59))) {
+                reportError("ERROR: Invalid date for --now.");
+                return 1;
+            }
+            if (hasTime) {
+                clockOffset = (long long)(date * 1440 + hour * 60 + minute - currentMinute()) * 60;
+            } else {
+                clockOffset = (long long)(date - currentDate()) * 86400;
+            }
+        } else if (arg == "--compact") {
+            compactGrid = true;
+        } else if (arg == "--replicate-to" && i + 1 < argc) {
+            replicationDir = argv[++i];
+        } else if (arg == "--follow" && i + 1 < argc) {
+            followDir = argv[++i];
+        } else if (arg == "--shards" && i + 1 < argc) {
+            shardCount = atoi(argv[++i]);
+            if (shardCount < 1) {
+                reportError("ERROR: Invalid shard count.");
+                return 1;
+            }
+        } else if (arg == "--export" && i + 1 < argc) {
+            // 格式之后的日期和楼层参数一直读到下一个以 -- 开头的参数
+            exportArgs = argv[++i];
+            while (i + 1 < argc && string(argv[i + 1]).compare(0, 2, "--") != 0) {
+                exportArgs += ' ';
+                exportArgs += argv[++i];
+            }
+        } else if (arg == "--memory-budget" && i + 1 < argc) {
+            memoryBudget = parseByteSize(argv[++i]);
+            if (memoryBudget == 0) {
+                reportError("ERROR: Invalid memory budget.");
+                return 1;
+            }
+        } else if (arg == "--metrics") {
+            metricsEnabled = true;
+        } else if (arg.substr(0, 10) == "--metrics=") {
+            metricsEnabled = true;
+            metricsDumpFile = arg.substr(10);
+        }
+    }
+
+    // 读取座位属性（分片进程从路由进程继承）
+    loadSeatAttributes();
+
+    // 导出模式：导出后直接退出
+    if (!exportArgs.empty()) {
+        return runExport(exportArgs, shardCount);
+    }
+
+    // 分片模式：本进程只负责路由，数据由各分片进程读写
+    if (shardCount > 1) {
+        if (!replicationDir.empty() || !followDir.empty()) {
+            reportError("ERROR: --shards cannot be combined with replication.");
+            return 1;
+        }
+#ifdef _WIN32
+        reportError("ERROR: --shards is not supported on Windows.");
+        return 1;
+#else
+        initializeLibrary();
+        return runRouter(shardCount);
+#endif
+    }
+
     // 初始化座位库
     // 设置初始的楼层、行、列数，并初始化所有座位为EMPTY状态
     initializeLibrary();
     
     // 加载数据
-    // 从文件中恢复之前保存的座位预约和用户数据
-    loadData();
+    // 从文件中恢复之前保存的座位预约和用户数据；备用进程的数据来自主进程的日志
+    if (!followDir.empty()) {
+        followLeader(followDir);
+    } else {
+        loadData();
+    }
+    clearJournalPending();
+    if (!replicationDir.empty()) {
+        startReplication();
+    }
+    // 启动日志：加载后的内存占用（写到标准错误，不影响命令输出）
+    enforceMemoryBudget();
+    if (metricsEnabled || memoryBudget > 0) {
+        cerr << "Memory after loading: " << memoryInUse() << " bytes";
+        for (int k = 0; k < MEM_COUNT; k++) {
+            cerr << (k ? ", " : " (") << MEMORY_NAMES[k] << ' ' << memoryBytes[k];
+        }
+        cerr << ")" << endl;
+    }
     
     // 命令循环
     // 持续接收用户输入的命令并进行处理，直到收到Quit命令
@@ -834,7 +5411,7 @@ int main() {
             command = command.substr(start, end - start + 1);
         } else {
             // 命令为空时显示错误信息
-            cout << "ERROR" << endl;
+            reportError("ERROR");
             continue;
         }
         
@@ -849,8 +5426,16 @@ int main() {
     }
     
     // 保存数据并退出
-    // 在退出前将当前所有数据保存到文件中
+    // 在退出前将当前所有数据保存到文件中（未提交的事务被丢弃）
+    if (inTransaction) {
+        inTransaction = false;
+        pendingHistory.clear();
+        loadData();
+    }
     saveData();
+    stopReplication();
+    dumpMetrics();
     cout << "Program exited." << endl;
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -1,57 +1,393 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define read _read
+#define STDIN_FD 0
+#else
+#include <unistd.h>
+#define STDIN_FD STDIN_FILENO
+#endif
 
 // 程序功能：
 // - 交互式读取用户输入（逐行读取）
 // - 当输入 "Dian" 输出 "2002" 并继续等待下一次输入
 // - 当输入 "Quit" 时退出程序
 // - 其他任意输入输出 "Error"
+// - 指定规则文件时按规则表回答：test1 rules.txt
+//   规则文件每行一条规则，格式为 输入<Tab>回答，输入与整行完全相同时输出对应的回答；
+//   没有 Tab 的行被跳过，重复的输入保留首次出现；未指定规则文件时只有内置规则 Dian → 2002
 //
 // 设计与鲁棒性：
-// - 使用 fgets 读取，避免 gets 带来的缓冲区溢出风险
+// - 标准输入按块读取（每次最多 64KB），在块中查找换行切分行，跨块的行拼接后再处理，行的长度不受限制
+// - 每处理完一块输入后刷新输出，交互使用或通过管道逐行对话时回答不会滞留在缓冲区中
 // - 统一移除行末的 \r\n 以兼容 Windows 和其他平台的换行格式
-// - 对于超长输入，fgets 会截断；逻辑上将被视为不等于目标字符串，返回 "Error"
-// - 区分大小写，按照题意严格匹配 "Dian" 与 "Quit"
+// - 规则表加载后建立完美哈希，每行输入只需计算一次哈希、访问一个槽位并比较一次字符串，
+//   与规则条数无关
+// - 区分大小写，按照题意严格匹配；"Quit" 总是退出，不受规则表影响
+
+// 一条规则：键和回答都指向规则文件内容（或内置字符串），以 '\0' 结尾
+typedef struct {
+	const char *input;
+	size_t input_len;
+	const char *response;
+	size_t response_len;
+} Rule;
+
+// 完美哈希的槽位：规则下标 + 1（0 表示空槽）和该规则输入的哈希值低32位，
+// 哈希值不同的输入（绝大多数不命中的行）只需访问槽位，不必再访问规则和规则文件内容
+typedef struct {
+	uint32_t index;
+	uint32_t check;
+} RuleSlot;
+
+// 规则表
+// 完美哈希（hash and displace）：输入的64位哈希决定所属的桶和两个探查参数，
+// 每个桶有一个位移值 displace[b]，桶中的键放在 (h1 + displace[b] * h2) % slot_count 号槽位；
+// 建表时按桶从大到小为每个桶寻找使其所有键都落在空槽位的位移值，查找时无需处理冲突。
+typedef struct {
+	char *data;               // 规则文件内容（规则指向其中的字符串）
+	Rule *rules;
+	size_t count, capacity;
+	uint64_t seed;            // 哈希种子，建表失败时换种子重试
+	uint32_t *displace;       // 每个桶的位移值
+	size_t bucket_count;
+	RuleSlot *slots;
+	size_t slot_count;
+} RuleTable;
 
-// 安全移除行末换行与回车，原地修改缓冲区
-static void strip_newline(char *buffer) {
-	if (buffer == NULL) return;
-	size_t len = strlen(buffer);
+// 安全移除行末换行与回车
+// 返回: 移除后的长度
+static size_t strip_newline(const char *buffer, size_t len) {
 	while (len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == '\r')) {
-		buffer[len - 1] = '\0';
 		len--;
 	}
+	return len;
+}
+
+// 带种子的64位哈希（FNV-1a 后再做一次 murmur3 的混合，使低位也足够均匀）
+static uint64_t hash_bytes(const char *s, size_t len, uint64_t seed) {
+	uint64_t h = 1469598103934665603ull ^ seed;
+	for (size_t i = 0; i < len; ++i) {
+		h = (h ^ (unsigned char)s[i]) * 1099511628211ull;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
 }
 
-int main(void) {
-	// 选择一个适中的缓冲区大小，足以容纳常见交互输入
-	char input_buffer[256];
+// 由哈希值和位移值计算槽位
+static size_t rule_slot(const RuleTable *table, uint64_t h, uint32_t displace) {
+	uint64_t h1 = h >> 32, h2 = (h & 0xffffffffu) | 1;
+	return (size_t)((h1 + (uint64_t)displace * h2) % table->slot_count);
+}
 
+static void rule_table_free(RuleTable *table) {
+	free(table->data);
+	free(table->rules);
+	free(table->displace);
+	free(table->slots);
+	memset(table, 0, sizeof(*table));
+}
 
-	// 提示用户输入
-	printf("Enter commands (Dian to get 2002, Quit to exit):\n");
+static int rule_table_add(RuleTable *table, const char *input, size_t input_len, const char *response, size_t response_len) {
+	if (table->count == table->capacity) {
+		size_t cap = table->capacity ? table->capacity * 2 : 16;
+		Rule *bigger = (Rule*)realloc(table->rules, cap * sizeof(Rule));
+		if (!bigger) return 0;
+		table->rules = bigger;
+		table->capacity = cap;
+	}
+	Rule *rule = &table->rules[table->count++];
+	rule->input = input;
+	rule->input_len = input_len;
+	rule->response = response;
+	rule->response_len = response_len;
+	return 1;
+}
 
-	// 交互主循环，直到用户输入 "Quit"
-	for (;;) {
-		if (fgets(input_buffer, (int)sizeof(input_buffer), stdin) == NULL) {
-			// 读到 EOF 或输入错误：安全退出
-			break;
+// 在规则表中查找与输入整行相同的规则
+// 返回: 规则，没有时返回 NULL
+static const Rule *rule_table_find(const RuleTable *table, const char *line, size_t len) {
+	if (table->slot_count == 0) return NULL;
+	uint64_t h = hash_bytes(line, len, table->seed);
+	const RuleSlot *slot = &table->slots[rule_slot(table, h, table->displace[h % table->bucket_count])];
+	if (slot->index == 0 || slot->check != (uint32_t)h) return NULL;
+	const Rule *rule = &table->rules[slot->index - 1];
+	if (rule->input_len != len || memcmp(rule->input, line, len) != 0) return NULL;
+	return rule;
+}
+
+// 按桶的大小从大到小排序时使用
+static const size_t *sort_bucket_sizes;
+
+static int compare_buckets(const void *a, const void *b) {
+	size_t x = sort_bucket_sizes[*(const uint32_t*)a], y = sort_bucket_sizes[*(const uint32_t*)b];
+	if (x != y) return x > y ? -1 : 1;
+	return 0;
+}
+
+// 用给定种子尝试建立完美哈希
+// 返回: 1 成功，0 某个桶找不到合适的位移值（换种子重试），-1 内存不足
+static int rule_table_try_build(RuleTable *table, uint64_t seed, uint64_t *hashes, size_t *bucket_sizes,
+                                size_t *bucket_start, uint32_t *bucket_keys, uint32_t *order, size_t *placed) {
+	size_t n = table->count, buckets = table->bucket_count;
+	table->seed = seed;
+	memset(bucket_sizes, 0, buckets * sizeof(size_t));
+	for (size_t i = 0; i < n; ++i) {
+		hashes[i] = hash_bytes(table->rules[i].input, table->rules[i].input_len, seed);
+		bucket_sizes[hashes[i] % buckets]++;
+	}
+	// 按桶归类键（计数排序）
+	size_t offset = 0;
+	for (size_t b = 0; b < buckets; ++b) {
+		bucket_start[b] = offset;
+		offset += bucket_sizes[b];
+	}
+	for (size_t i = 0; i < n; ++i) {
+		size_t b = hashes[i] % buckets;
+		bucket_keys[bucket_start[b]++] = (uint32_t)i;
+	}
+	for (size_t b = 0; b < buckets; ++b) {
+		bucket_start[b] -= bucket_sizes[b];
+		order[b] = (uint32_t)b;
+	}
+	sort_bucket_sizes = bucket_sizes;
+	qsort(order, buckets, sizeof(uint32_t), compare_buckets);
+
+	memset(table->slots, 0, table->slot_count * sizeof(RuleSlot));
+	memset(table->displace, 0, buckets * sizeof(uint32_t));
+	for (size_t k = 0; k < buckets; ++k) {
+		size_t b = order[k], size = bucket_sizes[b];
+		if (size == 0) break;
+		const uint32_t *keys = bucket_keys + bucket_start[b];
+		uint32_t d;
+		for (d = 0; d < (1u << 20); ++d) {
+			size_t j;
+			for (j = 0; j < size; ++j) {
+				size_t slot = rule_slot(table, hashes[keys[j]], d);
+				if (table->slots[slot].index != 0) break;
+				// 同一个桶中的两个键也不能落在同一槽位
+				size_t m;
+				for (m = 0; m < j && placed[m] != slot; ++m) {}
+				if (m < j) break;
+				placed[j] = slot;
+			}
+			if (j == size) break;
+		}
+		if (d == (1u << 20)) return 0;
+		table->displace[b] = d;
+		for (size_t j = 0; j < size; ++j) {
+			table->slots[placed[j]].index = keys[j] + 1;
+			table->slots[placed[j]].check = (uint32_t)hashes[keys[j]];
 		}
+	}
+	return 1;
+}
 
-		strip_newline(input_buffer);
+// 建立完美哈希：每个桶平均约4个键，槽位数比规则数多约 1/4 以便较快找到位移值
+static int rule_table_build(RuleTable *table) {
+	size_t n = table->count;
+	if (n == 0) return 1;
+	table->bucket_count = n / 4 + 1;
+	table->slot_count = n + n / 4 + 1;
+	table->displace = (uint32_t*)malloc(table->bucket_count * sizeof(uint32_t));
+	table->slots = (RuleSlot*)malloc(table->slot_count * sizeof(RuleSlot));
+	uint64_t *hashes = (uint64_t*)malloc(n * sizeof(uint64_t));
+	size_t *bucket_sizes = (size_t*)malloc(table->bucket_count * sizeof(size_t));
+	size_t *bucket_start = (size_t*)malloc(table->bucket_count * sizeof(size_t));
+	uint32_t *bucket_keys = (uint32_t*)malloc(n * sizeof(uint32_t));
+	uint32_t *order = (uint32_t*)malloc(table->bucket_count * sizeof(uint32_t));
+	size_t *placed = (size_t*)malloc(n * sizeof(size_t));
+	int result = -1;
+	if (table->displace && table->slots && hashes && bucket_sizes && bucket_start && bucket_keys && order && placed) {
+		for (uint64_t seed = 1; seed <= 64; ++seed) {
+			result = rule_table_try_build(table, seed * 0x9E3779B97F4A7C15ull, hashes, bucket_sizes,
+			                              bucket_start, bucket_keys, order, placed);
+			if (result != 0) break;
+		}
+	}
+	free(hashes);
+	free(bucket_sizes);
+	free(bucket_start);
+	free(bucket_keys);
+	free(order);
+	free(placed);
+	return result == 1;
+}
 
-		if (strcmp(input_buffer, "Quit") == 0) {
-			// 退出条件
-			break;
-		} else if (strcmp(input_buffer, "Dian") == 0) {
-			printf("2002\n");
-		} else {
-			printf("Error\n");
+// 去掉重复的输入，保留首次出现（建表前用一个临时的开放寻址哈希表判断重复）
+static int rule_table_dedupe(RuleTable *table) {
+	size_t n = table->count, mask = 16;
+	while (mask < n * 2) mask *= 2;
+	uint32_t *seen = (uint32_t*)calloc(mask, sizeof(uint32_t));
+	if (!seen) return 0;
+	mask--;
+	size_t kept = 0;
+	for (size_t i = 0; i < n; ++i) {
+		const Rule *rule = &table->rules[i];
+		size_t slot = (size_t)hash_bytes(rule->input, rule->input_len, 0) & mask;
+		int duplicate = 0;
+		while (seen[slot] != 0) {
+			const Rule *other = &table->rules[seen[slot] - 1];
+			if (other->input_len == rule->input_len && memcmp(other->input, rule->input, rule->input_len) == 0) {
+				duplicate = 1;
+				break;
+			}
+			slot = (slot + 1) & mask;
 		}
+		if (duplicate) continue;
+		table->rules[kept] = *rule;
+		seen[slot] = (uint32_t)++kept;
 	}
+	table->count = kept;
+	free(seen);
+	return 1;
+}
 
-	return 0;
+// 读入规则文件并建立规则表
+// 返回: 成功返回1
+static int rule_table_load(RuleTable *table, const char *path) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp) return 0;
+	size_t capacity = 1 << 16, size = 0;
+	char *data = (char*)malloc(capacity + 1);
+	while (data) {
+		if (size == capacity) {
+			char *bigger = (char*)realloc(data, capacity * 2 + 1);
+			if (!bigger) {
+				free(data);
+				data = NULL;
+				break;
+			}
+			data = bigger;
+			capacity *= 2;
+		}
+		size_t n = fread(data + size, 1, capacity - size, fp);
+		if (n == 0) break;
+		size += n;
+	}
+	fclose(fp);
+	if (!data) return 0;
+	data[size] = '\0';
+	table->data = data;
+
+	// 跳过 UTF-8 BOM
+	size_t pos = size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0 ? 3 : 0;
+	while (pos < size) {
+		char *line = data + pos;
+		char *end = (char*)memchr(line, '\n', size - pos);
+		size_t len = end ? (size_t)(end - line) : size - pos;
+		pos += len + 1;
+		len = strip_newline(line, len);
+		line[len] = '\0';
+		char *tab = (char*)memchr(line, '\t', len);
+		if (!tab) continue;
+		*tab = '\0';
+		if (!rule_table_add(table, line, (size_t)(tab - line), tab + 1, len - (size_t)(tab - line) - 1)) return 0;
+	}
+	return rule_table_dedupe(table) && rule_table_build(table);
 }
 
+// 回答一行输入
+// 返回: 输入为 "Quit" 时返回0
+static int respond_line(const RuleTable *table, const char *line, size_t len, FILE *out) {
+	len = strip_newline(line, len);
+	if (len == 4 && memcmp(line, "Quit", 4) == 0) return 0;
+	const Rule *rule = rule_table_find(table, line, len);
+	if (rule) {
+		fwrite(rule->response, 1, rule->response_len, out);
+		fputc('\n', out);
+	} else {
+		fputs("Error\n", out);
+	}
+	return 1;
+}
 
+// 从文件描述符按块读取输入并逐行回答，直到 EOF 或 "Quit"
+// 每块中完整的行直接在读缓冲区中处理；块末尾不完整的行移到缓冲区开头，与下一块拼接，
+// 超过缓冲区的长行使缓冲区加倍
+// 返回: 成功返回1，内存不足返回0
+static int respond_stream(const RuleTable *table, int fd, FILE *out) {
+	size_t capacity = 1 << 16, filled = 0;
+	char *buffer = (char*)malloc(capacity);
+	if (!buffer) return 0;
+	int running = 1;
+	while (running) {
+		if (filled == capacity) {
+			char *bigger = (char*)realloc(buffer, capacity * 2);
+			if (!bigger) {
+				free(buffer);
+				return 0;
+			}
+			buffer = bigger;
+			capacity *= 2;
+		}
+		int n = (int)read(fd, buffer + filled, (unsigned)(capacity - filled));
+		if (n <= 0) {
+			// 读到 EOF 或输入错误：处理最后一行（没有换行结尾）后安全退出
+			if (filled > 0) respond_line(table, buffer, filled, out);
+			break;
+		}
+		size_t scanned = filled, start = 0;
+		filled += (size_t)n;
+		char *newline;
+		while (running && (newline = (char*)memchr(buffer + scanned, '\n', filled - scanned)) != NULL) {
+			size_t end = (size_t)(newline - buffer);
+			running = respond_line(table, buffer + start, end - start, out);
+			start = scanned = end + 1;
+		}
+		memmove(buffer, buffer + start, filled - start);
+		filled -= start;
+		fflush(out);
+	}
+	fflush(out);
+	free(buffer);
+	return 1;
+}
+
+// 定义 RULES_NO_MAIN 时不编译主函数，便于基准测试直接包含本文件
+#ifndef RULES_NO_MAIN
+int main(int argc, char **argv) {
+	RuleTable table;
+	memset(&table, 0, sizeof(table));
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [rules.txt]\n", argv[0]);
+		return 1;
+	}
+	if (argc == 2) {
+		if (!rule_table_load(&table, argv[1])) {
+			fprintf(stderr, "Failed to load rule file: %s\n", argv[1]);
+			rule_table_free(&table);
+			return 1;
+		}
+		// 提示用户输入
+		printf("Loaded %zu rules from %s (Quit to exit):\n", table.count, argv[1]);
+	} else {
+		// 内置规则
+		if (!rule_table_add(&table, "Dian", 4, "2002", 4) || !rule_table_build(&table)) {
+			fprintf(stderr, "Memory allocation failed.\n");
+			rule_table_free(&table);
+			return 1;
+		}
+		// 提示用户输入
+		printf("Enter commands (Dian to get 2002, Quit to exit):\n");
+	}
+	fflush(stdout);
+
+	// 交互主循环，直到用户输入 "Quit"
+	int ok = respond_stream(&table, STDIN_FD, stdout);
+	rule_table_free(&table);
+	if (!ok) {
+		fprintf(stderr, "Memory allocation failed.\n");
+		return 1;
+	}
+	return 0;
+}
+#endif
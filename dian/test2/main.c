@@ -1,30 +1,64 @@
+#ifdef __linux__
+#define _GNU_SOURCE // accept4
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <intrin.h> // _BitScanForward64
+#endif
+
+#ifdef __linux__
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
 // 程序功能：
 // - 自动查找同目录下的 data.txt 文件（UTF-8 编码）
 // - 解析键值对，每行格式为 key:value
 // - 交互式查询：输入键返回值，不存在返回 "Error"，输入 "Quit" 退出
+// - 前缀和范围查询："Prefix p" 按键的字典序输出所有以 p 开头的 key:value，
+//   "Range a b" 输出键在 [a, b] 之间的 key:value，没有结果时输出 "Error"
+// - 服务器模式（Linux）：--serve 路径 在 Unix 套接字上为多个客户端提供同样的查询，
+//   字典只加载一份，多个工作线程无锁共享读取
 //
 // 文件解析规则：
 // - 键：长度 1-10 字符，可含字母、数字、下划线，不含空格
 // - 跳过空行和错误行（无冒号、含空格键等）
 // - 重复键：保留首次出现，忽略后续重复
+// - 行的长度不受限制（整个文件读入内存后分块扫描）
 //
 // 使用方法：
 // Windows 示例：test2.exe（自动查找 data.txt）
+// 指定数据文件：test2 other.txt
+// 服务器模式：test2 --serve /tmp/kv.sock [--threads 4] [data.txt]
 
 typedef struct {
 	char *key;
 	char *value;
 } Pair;
 
+// 字典：键值对按加入顺序存放，另有两个索引
+// - slots：开放寻址哈希表，存放 items 下标 + 1（0 表示空槽），用于精确查找和加载时去重
+// - order：按键的字典序排列的 items 下标，加载完成后建立，用于前缀和范围查询
 typedef struct {
 	Pair *items;
 	size_t size;
 	size_t capacity;
+	size_t *slots;
+	size_t slot_count;
+	size_t *order;
+	size_t ordered;
 } PairArray;
 
 static void strip_newline(char *buffer) {
@@ -36,15 +70,6 @@ static void strip_newline(char *buffer) {
 	}
 }
 
-// 去除 UTF-8 BOM（若存在）
-static void strip_utf8_bom(char *s) {
-	if (!s) return;
-	unsigned char *u = (unsigned char*)s;
-	if (u[0] == 0xEF && u[1] == 0xBB && u[2] == 0xBF) {
-		memmove(s, s + 3, strlen(s + 3) + 1);
-	}
-}
-
 static void trim(char *s) {
 	// 原地去除首尾空白字符（isspace 处理 \t\r\n 空格等）
 	if (!s) return;
@@ -62,7 +87,12 @@ static int pair_array_init(PairArray *arr, size_t initial_capacity) {
 	arr->size = 0;
 	arr->capacity = initial_capacity ? initial_capacity : 8;
 	arr->items = (Pair*)calloc(arr->capacity, sizeof(Pair));
-	return arr->items != NULL;
+	arr->slot_count = 16;
+	while (arr->slot_count < arr->capacity * 2) arr->slot_count *= 2;
+	arr->slots = (size_t*)calloc(arr->slot_count, sizeof(size_t));
+	arr->order = NULL;
+	arr->ordered = 0;
+	return arr->items != NULL && arr->slots != NULL;
 }
 
 static void pair_array_free(PairArray *arr) {
@@ -72,13 +102,75 @@ static void pair_array_free(PairArray *arr) {
 		free(arr->items[i].value);
 	}
 	free(arr->items);
+	free(arr->slots);
+	free(arr->order);
 	arr->items = NULL;
+	arr->slots = NULL;
+	arr->order = NULL;
 	arr->size = 0;
 	arr->capacity = 0;
+	arr->slot_count = 0;
+	arr->ordered = 0;
 }
 
-static int pair_array_push(PairArray *arr, const char *key, const char *value) {
+// 键的哈希值（FNV-1a，键最多10个字符）
+static uint64_t hash_key(const char *key, size_t len) {
+	uint64_t h = 1469598103934665603ull;
+	for (size_t i = 0; i < len; ++i) {
+		h = (h ^ (unsigned char)key[i]) * 1099511628211ull;
+	}
+	return h;
+}
+
+// 在哈希表中查找键
+// 返回: 命中时返回槽位下标；未命中时返回应插入的空槽下标，并把 *found 置0
+static size_t pair_array_probe(const PairArray *arr, const char *key, size_t len, int *found) {
+	size_t mask = arr->slot_count - 1;
+	size_t slot = (size_t)hash_key(key, len) & mask;
+	while (arr->slots[slot] != 0) {
+		const char *other = arr->items[arr->slots[slot] - 1].key;
+		if (strncmp(other, key, len) == 0 && other[len] == '\0') {
+			*found = 1;
+			return slot;
+		}
+		slot = (slot + 1) & mask;
+	}
+	*found = 0;
+	return slot;
+}
+
+// 哈希表扩容为原来的两倍并重新插入所有键，保持装载因子不超过 1/2
+static int pair_array_grow_slots(PairArray *arr) {
+	size_t new_count = arr->slot_count * 2;
+	size_t *new_slots = (size_t*)calloc(new_count, sizeof(size_t));
+	if (!new_slots) return 0;
+	free(arr->slots);
+	arr->slots = new_slots;
+	arr->slot_count = new_count;
+	for (size_t i = 0; i < arr->size; ++i) {
+		int found;
+		size_t slot = pair_array_probe(arr, arr->items[i].key, strlen(arr->items[i].key), &found);
+		arr->slots[slot] = i + 1;
+	}
+	return 1;
+}
+
+// 复制 [s, s + len) 为以 '\0' 结尾的新字符串
+static char *dup_range(const char *s, size_t len) {
+	char *copy = (char*)malloc(len + 1);
+	if (!copy) return NULL;
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+// 加入键值对，键已存在时忽略（保留首次出现）
+static int pair_array_push(PairArray *arr, const char *key, size_t key_len, const char *value, size_t value_len) {
 	if (!arr || !key || !value) return 0;
+	if ((arr->size + 1) * 2 > arr->slot_count && !pair_array_grow_slots(arr)) return 0;
+	int found;
+	size_t slot = pair_array_probe(arr, key, key_len, &found);
+	if (found) return 1;
 	if (arr->size == arr->capacity) {
 		size_t new_cap = arr->capacity * 2;
 		Pair *new_items = (Pair*)realloc(arr->items, new_cap * sizeof(Pair));
@@ -88,86 +180,801 @@ static int pair_array_push(PairArray *arr, const char *key, const char *value) {
 		arr->items = new_items;
 		arr->capacity = new_cap;
 	}
-	arr->items[arr->size].key = _strdup(key);
-	arr->items[arr->size].value = _strdup(value);
+	arr->items[arr->size].key = dup_range(key, key_len);
+	arr->items[arr->size].value = dup_range(value, value_len);
 	if (!arr->items[arr->size].key || !arr->items[arr->size].value) return 0;
 	arr->size++;
+	arr->slots[slot] = arr->size;
 	return 1;
 }
 
 static const char* pair_array_find(const PairArray *arr, const char *key) {
-	if (!arr || !key) return NULL;
-	for (size_t i = 0; i < arr->size; ++i) {
-		if (strcmp(arr->items[i].key, key) == 0) return arr->items[i].value;
+	if (!arr || !key || arr->size == 0) return NULL;
+	int found;
+	size_t slot = pair_array_probe(arr, key, strlen(key), &found);
+	return found ? arr->items[arr->slots[slot] - 1].value : NULL;
+}
+
+// ===================== 有序索引 =====================
+// 键最多10个字符，排序时把每个键按大端序装入一个64位整数和一个32位整数的低16位（不足补0），
+// 比较两个整数即得到与 strcmp 相同的字节序，排序时不必逐个访问分散在堆上的键字符串。
+// 查询时用二分查找定位范围的起点，再顺序输出，每条结果直接写到输出流，不需要先收集整个结果集。
+
+typedef struct {
+	uint64_t high;   // 键的第 1-8 个字节
+	uint32_t low;    // 键的第 9-10 个字节
+	uint32_t index;  // items 下标
+} OrderEntry;
+
+static int compare_order_entries(const void *a, const void *b) {
+	const OrderEntry *x = (const OrderEntry*)a, *y = (const OrderEntry*)b;
+	if (x->high != y->high) return x->high < y->high ? -1 : 1;
+	if (x->low != y->low) return x->low < y->low ? -1 : 1;
+	return 0;
+}
+
+// 建立（或重建）按键排序的索引，字典加载完成后调用
+static int pair_array_build_order(PairArray *arr) {
+	size_t n = arr->size;
+	OrderEntry *entries = (OrderEntry*)malloc((n ? n : 1) * sizeof(OrderEntry));
+	size_t *order = (size_t*)realloc(arr->order, (n ? n : 1) * sizeof(size_t));
+	if (!entries || !order) {
+		free(entries);
+		if (order) arr->order = order;
+		return 0;
 	}
-	return NULL;
+	for (size_t i = 0; i < n; ++i) {
+		const unsigned char *key = (const unsigned char*)arr->items[i].key;
+		unsigned char bytes[10] = {0};
+		for (size_t k = 0; k < 10 && key[k]; ++k) bytes[k] = key[k];
+		uint64_t high = 0;
+		for (size_t k = 0; k < 8; ++k) high = high << 8 | bytes[k];
+		entries[i].high = high;
+		entries[i].low = (uint32_t)bytes[8] << 8 | bytes[9];
+		entries[i].index = (uint32_t)i;
+	}
+	qsort(entries, n, sizeof(OrderEntry), compare_order_entries);
+	for (size_t i = 0; i < n; ++i) order[i] = entries[i].index;
+	free(entries);
+	arr->order = order;
+	arr->ordered = n;
+	return 1;
 }
 
-// 校验键：长度 1-10，仅含字母、数字、下划线，不含空格
-static int is_valid_key(const char *key) {
-	if (!key) return 0;
-	size_t len = strlen(key);
-	if (len == 0 || len > 10) return 0;
-	for (size_t i = 0; i < len; ++i) {
-		unsigned char c = (unsigned char)key[i];
-		// 允许：字母、数字、下划线
-		if (!(isalnum(c) || c == '_')) return 0;
+// 二分查找第一个不小于 key 的位置
+static size_t pair_array_lower_bound(const PairArray *arr, const char *key) {
+	size_t lo = 0, hi = arr->ordered;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (strcmp(arr->items[arr->order[mid]].key, key) < 0) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+// 查询结果的输出目标：交互模式写到 FILE，服务器模式追加到连接的发送缓冲区
+typedef void (*WriteFunc)(void *ctx, const char *data, size_t len);
+
+static void write_stream(void *ctx, const char *data, size_t len) {
+	fwrite(data, 1, len, (FILE*)ctx);
+}
+
+static void write_text(WriteFunc write, void *ctx, const char *text) {
+	write(ctx, text, strlen(text));
+}
+
+static void write_pair(WriteFunc write, void *ctx, const Pair *pair) {
+	write_text(write, ctx, pair->key);
+	write(ctx, ":", 1);
+	write_text(write, ctx, pair->value);
+	write(ctx, "\n", 1);
+}
+
+// 按键的顺序输出所有以 prefix 开头的键值对
+// 返回: 输出的条数
+static size_t pair_array_print_prefix(const PairArray *arr, const char *prefix, WriteFunc write, void *ctx) {
+	size_t len = strlen(prefix), count = 0;
+	for (size_t i = pair_array_lower_bound(arr, prefix); i < arr->ordered; ++i) {
+		const Pair *pair = &arr->items[arr->order[i]];
+		if (strncmp(pair->key, prefix, len) != 0) break;
+		write_pair(write, ctx, pair);
+		count++;
+	}
+	return count;
+}
+
+// 按键的顺序输出键在 [low, high] 之间的键值对
+// 返回: 输出的条数
+static size_t pair_array_print_range(const PairArray *arr, const char *low, const char *high, WriteFunc write, void *ctx) {
+	size_t count = 0;
+	for (size_t i = pair_array_lower_bound(arr, low); i < arr->ordered; ++i) {
+		const Pair *pair = &arr->items[arr->order[i]];
+		if (strcmp(pair->key, high) > 0) break;
+		write_pair(write, ctx, pair);
+		count++;
+	}
+	return count;
+}
+
+// ===================== 分块扫描 =====================
+// 文件整体读入内存后按 KV_BLOCK 字节分块解析：先用一遍向量化扫描为块中每个字节生成三张位图
+// （是否为换行、是否为冒号、是否为键允许的字符 [A-Za-z0-9_]），之后逐行处理只需在位图上查找置位的位，
+// 不再逐字节调用 isspace/isalnum 或 strchr。
+// 扫描函数在启动时按 CPU 支持的指令集选择：AVX2（每次32字节）、SSE2（每次16字节），否则逐字节查表。
+
+#define KV_BLOCK 65536
+#define KV_WORDS (KV_BLOCK / 64)
+
+// 一块的位图：第 i 个字节对应第 i / 64 个字的第 i % 64 位
+typedef struct {
+	uint64_t newline[KV_WORDS];
+	uint64_t colon[KV_WORDS];
+	uint64_t keychar[KV_WORDS];
+} ScanMasks;
+
+typedef void (*ScanFunc)(const unsigned char *p, size_t n, ScanMasks *masks);
+
+// 字节分类表：第0位为换行，第1位为冒号，第2位为键允许的字符
+static unsigned char byte_class[256];
+
+static void init_byte_class(void) {
+	for (int c = 0; c < 256; ++c) {
+		int key = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+		byte_class[c] = (unsigned char)((c == '\n') | (c == ':') << 1 | key << 2);
+	}
+}
+
+// 逐字节查表生成位图（没有向量指令时使用，也用于处理向量扫描剩下的尾部）
+// 参数: from - 从第 from 个字节开始（之前的位已由调用者写好）
+static void scan_masks_scalar_from(const unsigned char *p, size_t from, size_t n, ScanMasks *masks) {
+	for (size_t w = from / 64; w * 64 < n; ++w) {
+		uint64_t nl = 0, colon = 0, key = 0;
+		size_t end = w * 64 + 64 < n ? w * 64 + 64 : n;
+		for (size_t i = w * 64; i < end; ++i) {
+			uint64_t cls = byte_class[p[i]];
+			uint64_t bit = (uint64_t)1 << (i % 64);
+			nl |= (cls & 1) ? bit : 0;
+			colon |= (cls >> 1 & 1) ? bit : 0;
+			key |= (cls >> 2 & 1) ? bit : 0;
+		}
+		masks->newline[w] = nl;
+		masks->colon[w] = colon;
+		masks->keychar[w] = key;
+	}
+}
+
+static void scan_masks_scalar(const unsigned char *p, size_t n, ScanMasks *masks) {
+	scan_masks_scalar_from(p, 0, n, masks);
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define KV_HAVE_X86_SIMD 1
+#include <immintrin.h>
+
+// 16 字节中属于键字符的字节：大小写字母（或 0x20 后为小写）、数字、下划线；
+// 0x80 以上的字节按有符号比较是负数，不会落入这些区间
+__attribute__((target("sse2")))
+static inline __m128i key_class_sse2(__m128i v) {
+	__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+	__m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+	return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+__attribute__((target("sse2")))
+static void scan_masks_sse2(const unsigned char *p, size_t n, ScanMasks *masks) {
+	size_t w = 0;
+	for (; w * 64 + 64 <= n; ++w) {
+		uint64_t nl = 0, colon = 0, key = 0;
+		for (int k = 0; k < 4; ++k) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(p + w * 64 + k * 16));
+			nl |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))) << (k * 16);
+			colon |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(':'))) << (k * 16);
+			key |= (uint64_t)(uint16_t)_mm_movemask_epi8(key_class_sse2(v)) << (k * 16);
+		}
+		masks->newline[w] = nl;
+		masks->colon[w] = colon;
+		masks->keychar[w] = key;
+	}
+	scan_masks_scalar_from(p, w * 64, n, masks);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i key_class_avx2(__m256i v) {
+	__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+	__m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+	                                 _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+	__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+	                                 _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+	__m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+	return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+__attribute__((target("avx2")))
+static void scan_masks_avx2(const unsigned char *p, size_t n, ScanMasks *masks) {
+	size_t w = 0;
+	for (; w * 64 + 64 <= n; ++w) {
+		uint64_t nl = 0, colon = 0, key = 0;
+		for (int k = 0; k < 2; ++k) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(p + w * 64 + k * 32));
+			nl |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))) << (k * 32);
+			colon |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':'))) << (k * 32);
+			key |= (uint64_t)(uint32_t)_mm256_movemask_epi8(key_class_avx2(v)) << (k * 32);
+		}
+		masks->newline[w] = nl;
+		masks->colon[w] = colon;
+		masks->keychar[w] = key;
+	}
+	scan_masks_scalar_from(p, w * 64, n, masks);
+}
+#endif
+
+// 当前使用的扫描函数及其名称
+static ScanFunc scan_masks = scan_masks_scalar;
+static const char *scan_name = "scalar";
+
+// 按 CPU 支持的指令集选择扫描函数
+static void init_scanner(void) {
+	init_byte_class();
+#ifdef KV_HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		scan_masks = scan_masks_avx2;
+		scan_name = "avx2";
+	} else if (__builtin_cpu_supports("sse2")) {
+		scan_masks = scan_masks_sse2;
+		scan_name = "sse2";
+	}
+#endif
+}
+
+// 非零字中最低置位的位序号（MSVC 没有 __builtin_ctzll）
+static inline unsigned lowest_bit(uint64_t word) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return (unsigned)index;
+#else
+	return (unsigned)__builtin_ctzll(word);
+#endif
+}
+
+// 位图中第 from 个及之后第一个置位的位，没有（或不小于 limit）时返回 limit
+static size_t next_bit(const uint64_t *bits, size_t from, size_t limit) {
+	if (from >= limit) return limit;
+	size_t w = from / 64;
+	uint64_t word = bits[w] & (~(uint64_t)0 << (from % 64));
+	while (!word) {
+		if (++w * 64 >= limit) return limit;
+		word = bits[w];
+	}
+	size_t pos = w * 64 + lowest_bit(word);
+	return pos < limit ? pos : limit;
+}
+
+// 位图中 [from, to) 的位是否全部置位
+static int all_bits(const uint64_t *bits, size_t from, size_t to) {
+	for (size_t i = from; i < to;) {
+		size_t w = i / 64;
+		size_t end = (w + 1) * 64 < to ? (w + 1) * 64 : to;
+		uint64_t need = (end - i == 64 ? ~(uint64_t)0 : (((uint64_t)1 << (end - i)) - 1)) << (i % 64);
+		if ((bits[w] & need) != need) return 0;
+		i = end;
 	}
 	return 1;
 }
 
+// 与 isspace 在默认 "C" locale 下相同的空白字符
+static int is_space_byte(unsigned char c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// 每解析出一对合法的键值调用一次；返回0时停止解析
+typedef int (*PairCallback)(void *ctx, const char *key, size_t key_len, const char *value, size_t value_len);
+
+// 解析一行 [start, end)（不含换行），规则与逐行读取时相同：
+// 去掉行尾的 \r 和行首的 UTF-8 BOM，以第一个冒号分割，键和值都去掉首尾空白后不能为空，键必须合法
+// 参数: masks - 覆盖该行的位图（位置相对于 base），为 NULL 时直接查找原始字节（用于超过一块的行）
+// 返回: 回调要求停止时返回0
+static int parse_line(const unsigned char *base, size_t start, size_t end, const ScanMasks *masks,
+                      PairCallback callback, void *ctx) {
+	while (end > start && base[end - 1] == '\r') end--;
+	if (end - start >= 3 && base[start] == 0xEF && base[start + 1] == 0xBB && base[start + 2] == 0xBF) start += 3;
+	size_t colon = end;
+	if (masks) {
+		colon = next_bit(masks->colon, start, end);
+	} else if (end > start) {
+		const unsigned char *found = (const unsigned char *)memchr(base + start, ':', end - start);
+		if (found) colon = (size_t)(found - base);
+	}
+	if (colon == end) return 1; // 无冒号（包括空行），跳过错误行
+
+	size_t key_start = start, key_end = colon;
+	while (key_start < key_end && is_space_byte(base[key_start])) key_start++;
+	while (key_end > key_start && is_space_byte(base[key_end - 1])) key_end--;
+	size_t value_start = colon + 1, value_end = end;
+	while (value_start < value_end && is_space_byte(base[value_start])) value_start++;
+	while (value_end > value_start && is_space_byte(base[value_end - 1])) value_end--;
+
+	// 校验键：长度1-10，每个字节都是键字符；值不能为空
+	if (key_end == key_start || key_end - key_start > 10 || value_end == value_start) return 1;
+	if (masks) {
+		if (!all_bits(masks->keychar, key_start, key_end)) return 1;
+	} else {
+		for (size_t i = key_start; i < key_end; ++i) {
+			if (!(byte_class[base[i]] & 4)) return 1;
+		}
+	}
+	return callback(ctx, (const char *)base + key_start, key_end - key_start,
+	                (const char *)base + value_start, value_end - value_start);
+}
+
+// 解析内存中的整个文件
+// 逐块生成位图后按换行位逐行解析；跨块的行留到下一块从行首重新扫描，比一块还长的行直接在原始字节上解析
+// 返回: 回调要求停止时返回0，否则返回1
+static int parse_buffer(const char *data, size_t len, PairCallback callback, void *ctx) {
+	static ScanMasks masks;
+	const unsigned char *p = (const unsigned char *)data;
+	size_t pos = 0;
+	while (pos < len) {
+		size_t n = len - pos < KV_BLOCK ? len - pos : KV_BLOCK;
+		int last = pos + n == len;
+		scan_masks(p + pos, n, &masks);
+		size_t line = 0;
+		while (line < n) {
+			size_t nl = next_bit(masks.newline, line, n);
+			if (nl == n && !last) break; // 行在下一块结束
+			if (!parse_line(p + pos, line, nl, &masks, callback, ctx)) return 0;
+			line = nl + 1;
+		}
+		if (line == 0) {
+			// 整块都在同一行中
+			const unsigned char *nl = (const unsigned char *)memchr(p + pos, '\n', len - pos);
+			size_t end = nl ? (size_t)(nl - (p + pos)) : len - pos;
+			if (!parse_line(p + pos, 0, end, NULL, callback, ctx)) return 0;
+			line = end + 1;
+		}
+		pos += line;
+	}
+	return 1;
+}
+
+// 把整个文件读入内存：按文件大小一次分配，大块读取（读到的比预计多时加倍扩容）
+// 返回: 文件内容（由调用者释放），失败时返回 NULL
+static char *read_file(const char *path, size_t *len) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp) return NULL;
+	size_t capacity = 1 << 20, size = 0;
+	if (fseek(fp, 0, SEEK_END) == 0) {
+		long end = ftell(fp);
+		if (end > 0) capacity = (size_t)end + 1;
+		fseek(fp, 0, SEEK_SET);
+	}
+	char *data = (char*)malloc(capacity);
+	while (data) {
+		if (size == capacity) {
+			char *bigger = (char*)realloc(data, capacity * 2);
+			if (!bigger) {
+				free(data);
+				data = NULL;
+				break;
+			}
+			data = bigger;
+			capacity *= 2;
+		}
+		size_t n = fread(data + size, 1, capacity - size, fp);
+		if (n == 0) break;
+		size += n;
+	}
+	fclose(fp);
+	*len = size;
+	return data;
+}
+
+// 把解析出的键值对加入字典，忽略重复键（保留首次出现）
+static int add_pair(void *ctx, const char *key, size_t key_len, const char *value, size_t value_len) {
+	return pair_array_push((PairArray*)ctx, key, key_len, value, value_len);
+}
+
 static int load_file(const char *path, PairArray *out) {
-	FILE *fp = fopen(path, "r");
-	if (!fp) return 0;
-	char line[1024];
-	while (fgets(line, sizeof(line), fp)) {
-		strip_newline(line);
-		strip_utf8_bom(line);
-		
-		// 跳过空行
-		char *cursor = line;
-		while (*cursor && isspace((unsigned char)*cursor)) cursor++;
-		if (*cursor == '\0') continue;
-
-		char *colon = strchr(line, ':');
-		if (!colon) continue; // 无冒号，跳过错误行
-		
-		// 分割键值
-		*colon = '\0';
-		char *key = line;
-		char *value = colon + 1;
-		trim(key);
-		trim(value);
-		
-		// 检查键值非空
-		if (*key == '\0' || *value == '\0') continue;
-		
-		// 校验键格式：长度1-10，仅含字母数字下划线
-		if (!is_valid_key(key)) continue;
-		
-		// 忽略重复键（保留首次出现）
-		if (pair_array_find(out, key) != NULL) continue;
-		
-		if (!pair_array_push(out, key, value)) {
-			fclose(fp);
+	size_t len;
+	char *data = read_file(path, &len);
+	if (!data) return 0;
+	int ok = parse_buffer(data, len, add_pair, out);
+	free(data);
+	return ok && pair_array_build_order(out);
+}
+
+// 处理 "Prefix p" 和 "Range a b" 查询（键不含空格，因此带参数的输入不会与普通键冲突）
+// 返回: 输入是这两种查询之一时返回1
+static int run_ordered_query(const PairArray *dict, char *input, WriteFunc write, void *ctx) {
+	char *args = strchr(input, ' ');
+	if (!args) return 0;
+	*args++ = '\0';
+	size_t count;
+	if (strcmp(input, "Prefix") == 0) {
+		trim(args);
+		if (args[0] == '\0' || strchr(args, ' ')) {
+			args[-1] = ' ';
+			return 0;
+		}
+		count = pair_array_print_prefix(dict, args, write, ctx);
+	} else if (strcmp(input, "Range") == 0) {
+		char low[512], high[512], extra[2];
+		if (sscanf(args, "%511s %511s %1s", low, high, extra) != 2) {
+			args[-1] = ' ';
 			return 0;
 		}
+		count = strcmp(low, high) <= 0 ? pair_array_print_range(dict, low, high, write, ctx) : 0;
+	} else {
+		args[-1] = ' ';
+		return 0;
 	}
-	fclose(fp);
+	if (count == 0) write_text(write, ctx, "Error\n");
 	return 1;
 }
 
+// 回答一行查询（已去掉换行和首尾空白，且不为空）
+// 参数: list_end 为1时，前缀和范围查询的结果之后再输出一个空行，便于流水线客户端区分多行结果的边界
+static void answer_query(const PairArray *dict, char *input, int list_end, WriteFunc write, void *ctx) {
+	// 前缀和范围查询
+	if (run_ordered_query(dict, input, write, ctx)) {
+		if (list_end) write(ctx, "\n", 1);
+		return;
+	}
+	// 查询键值
+	const char *val = pair_array_find(dict, input);
+	if (val) {
+		write_text(write, ctx, val);
+		write(ctx, "\n", 1);
+	} else {
+		write_text(write, ctx, "Error\n");
+	}
+}
+
+#ifdef __linux__
+// ===================== 服务器模式 =====================
+// 字典加载完成后只读，所有工作线程直接共享同一份 PairArray（哈希索引和有序索引），查询不加锁。
+// 每个工作线程有自己的 epoll 实例，监听套接字以 EPOLLEXCLUSIVE 加入每个实例，新连接只唤醒其中一个线程，
+// 之后该连接一直由这个线程处理，线程之间没有共享的可变状态。
+// 协议与交互模式相同：每行一个查询，按顺序逐行回答，"Quit" 关闭连接。客户端可以不等回答连续发送多行（流水线），
+// 服务器每次读取后处理缓冲区中所有完整的行，回答合并后一次写出；前缀和范围查询的结果以一个空行结束。
+// 发送缓冲区积压时暂停读取该连接，直到回答写完（背压）。
+
+#define KV_REQUEST_MAX 4096
+
+// 一个客户端连接
+typedef struct Connection {
+	int fd;
+	char in[KV_REQUEST_MAX];     // 未处理完的请求数据
+	size_t in_len;
+	char *out;                   // 待发送的回答
+	size_t out_len, out_sent, out_cap;
+	int closing;                 // 收到 Quit 或对端关闭：回答发完后关闭连接
+	int failed;                  // 内存不足或请求行过长：立即关闭连接
+	uint32_t interest;           // 当前在 epoll 中关注的事件
+	struct Connection *prev, *next;
+} Connection;
+
+typedef struct KvServer KvServer;
+
+// 工作线程
+typedef struct {
+	KvServer *server;
+	int epoll_fd;
+	Connection *connections;     // 该线程负责的连接链表
+	pthread_t thread;
+} Worker;
+
+struct KvServer {
+	const PairArray *dict;
+	int listen_fd;
+	int stop_fd;                 // eventfd，写入后所有工作线程退出
+	char path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+	int worker_count;
+	Worker *workers;
+};
+
+// 把回答追加到连接的发送缓冲区
+static void connection_write(void *ctx, const char *data, size_t len) {
+	Connection *c = (Connection*)ctx;
+	if (c->failed) return;
+	if (c->out_len + len > c->out_cap) {
+		size_t cap = c->out_cap ? c->out_cap : 4096;
+		while (cap < c->out_len + len) cap *= 2;
+		char *bigger = (char*)realloc(c->out, cap);
+		if (!bigger) {
+			c->failed = 1;
+			return;
+		}
+		c->out = bigger;
+		c->out_cap = cap;
+	}
+	memcpy(c->out + c->out_len, data, len);
+	c->out_len += len;
+}
+
+// 尽量写出发送缓冲区
+// 返回: 出错时返回0
+static int connection_flush(Connection *c) {
+	while (c->out_sent < c->out_len) {
+		ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent, MSG_NOSIGNAL);
+		if (n > 0) {
+			c->out_sent += (size_t)n;
+		} else if (n < 0 && errno == EINTR) {
+			continue;
+		} else {
+			return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+		}
+	}
+	c->out_len = c->out_sent = 0;
+	return 1;
+}
+
+// 处理输入缓冲区中所有完整的行
+static void connection_process(const PairArray *dict, Connection *c) {
+	size_t start = 0;
+	while (!c->closing && !c->failed) {
+		char *newline = (char*)memchr(c->in + start, '\n', c->in_len - start);
+		if (!newline) break;
+		char *line = c->in + start;
+		*newline = '\0';
+		start = (size_t)(newline - c->in) + 1;
+		strip_newline(line);
+		if (strcmp(line, "Quit") == 0) {
+			c->closing = 1;
+			break;
+		}
+		trim(line);
+		if (line[0] == '\0') continue;
+		answer_query(dict, line, 1, connection_write, c);
+	}
+	if (c->closing) start = c->in_len;
+	memmove(c->in, c->in + start, c->in_len - start);
+	c->in_len -= start;
+	if (c->in_len == sizeof(c->in)) c->failed = 1;
+}
+
+static void worker_close(Worker *w, Connection *c) {
+	if (c->prev) c->prev->next = c->next;
+	else w->connections = c->next;
+	if (c->next) c->next->prev = c->prev;
+	epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+	close(c->fd);
+	free(c->out);
+	free(c);
+}
+
+// 接受所有等待中的连接
+static void worker_accept(Worker *w) {
+	for (;;) {
+		int fd = accept4(w->server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		Connection *c = (Connection*)calloc(1, sizeof(Connection));
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = c;
+		if (!c || (c->fd = fd, epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)) {
+			free(c);
+			close(fd);
+			continue;
+		}
+		c->interest = EPOLLIN;
+		c->next = w->connections;
+		if (c->next) c->next->prev = c;
+		w->connections = c;
+	}
+}
+
+// 处理一个连接上的事件：先写出积压的回答，积压清空后再读取并回答新的请求
+static void worker_serve(Worker *w, Connection *c, uint32_t events) {
+	int ok = connection_flush(c);
+	if (ok && c->out_len == 0 && !c->closing && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+		ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+		if (n > 0) {
+			c->in_len += (size_t)n;
+			connection_process(w->server->dict, c);
+			ok = connection_flush(c);
+		} else if (n == 0) {
+			c->closing = 1;
+		} else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			ok = 0;
+		}
+	}
+	if (!ok || c->failed || (c->closing && c->out_len == 0)) {
+		worker_close(w, c);
+		return;
+	}
+	uint32_t interest = c->out_len > 0 ? EPOLLOUT : EPOLLIN;
+	if (interest != c->interest) {
+		struct epoll_event ev;
+		ev.events = interest;
+		ev.data.ptr = c;
+		epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+		c->interest = interest;
+	}
+}
+
+static void *worker_main(void *arg) {
+	Worker *w = (Worker*)arg;
+	struct epoll_event events[64];
+	for (;;) {
+		int n = epoll_wait(w->epoll_fd, events, 64, -1);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		for (int i = 0; i < n; ++i) {
+			void *ptr = events[i].data.ptr;
+			if (ptr == &w->server->stop_fd) {
+				goto done;
+			} else if (ptr == &w->server->listen_fd) {
+				worker_accept(w);
+			} else {
+				worker_serve(w, (Connection*)ptr, events[i].events);
+			}
+		}
+	}
+done:
+	while (w->connections) worker_close(w, w->connections);
+	return NULL;
+}
+
+static void server_stop(KvServer *server);
+
+// 在 path 上监听并启动 threads 个工作线程，dict 在服务器停止前必须保持不变
+// 返回: 服务器，失败时返回 NULL（错误信息已输出到 stderr）
+static KvServer *server_start(const PairArray *dict, const char *path, int threads) {
+	struct sockaddr_un addr;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return NULL;
+	}
+	KvServer *server = (KvServer*)calloc(1, sizeof(KvServer));
+	Worker *workers = (Worker*)calloc((size_t)threads, sizeof(Worker));
+	if (!server || !workers) {
+		free(server);
+		free(workers);
+		fprintf(stderr, "Memory allocation failed.\n");
+		return NULL;
+	}
+	server->dict = dict;
+	server->workers = workers;
+	strcpy(server->path, path);
+	server->stop_fd = eventfd(0, EFD_CLOEXEC);
+	server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	// 删除上次运行遗留的套接字文件（不删除其他类型的文件）
+	struct stat st;
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+	if (server->stop_fd < 0 || server->listen_fd < 0 ||
+	    bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+	    listen(server->listen_fd, SOMAXCONN) != 0) {
+		fprintf(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+		server_stop(server);
+		return NULL;
+	}
+
+	for (int i = 0; i < threads; ++i) {
+		Worker *w = &workers[i];
+		w->server = server;
+		w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		struct epoll_event listen_ev, stop_ev;
+		listen_ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+		listen_ev.data.ptr = &server->listen_fd;
+		stop_ev.events = EPOLLIN;
+		stop_ev.data.ptr = &server->stop_fd;
+		if (w->epoll_fd < 0 ||
+		    epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &listen_ev) != 0 ||
+		    epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, server->stop_fd, &stop_ev) != 0 ||
+		    pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+			fprintf(stderr, "Cannot start worker thread: %s\n", strerror(errno));
+			if (w->epoll_fd >= 0) close(w->epoll_fd);
+			server_stop(server);
+			return NULL;
+		}
+		server->worker_count++;
+	}
+	return server;
+}
+
+// 通知所有工作线程退出，等待它们关闭各自的连接，然后删除套接字文件
+static void server_stop(KvServer *server) {
+	if (!server) return;
+	if (server->stop_fd >= 0) {
+		uint64_t one = 1;
+		if (write(server->stop_fd, &one, sizeof(one)) < 0) perror("eventfd");
+	}
+	for (int i = 0; i < server->worker_count; ++i) {
+		pthread_join(server->workers[i].thread, NULL);
+		close(server->workers[i].epoll_fd);
+	}
+	if (server->listen_fd >= 0) {
+		close(server->listen_fd);
+		unlink(server->path);
+	}
+	if (server->stop_fd >= 0) close(server->stop_fd);
+	free(server->workers);
+	free(server);
+}
+
+// 服务器模式主循环：运行到收到 SIGINT 或 SIGTERM 为止
+static int run_server(const PairArray *dict, const char *path, int threads) {
+	// 先屏蔽信号再创建工作线程，信号只由主线程通过 sigwait 接收
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	KvServer *server = server_start(dict, path, threads);
+	if (!server) return 1;
+	printf("Serving %zu keys on %s with %d threads (Ctrl+C to stop)\n", dict->size, path, threads);
+	fflush(stdout);
+	int sig;
+	sigwait(&signals, &sig);
+	server_stop(server);
+	return 0;
+}
+#endif
+
+// 定义 KV_NO_MAIN 时不编译主函数，便于基准测试直接包含本文件
+#ifndef KV_NO_MAIN
 int main(int argc, char **argv) {
 	PairArray dict;
+	init_scanner();
 	if (!pair_array_init(&dict, 16)) {
 		fprintf(stderr, "Memory allocation failed.\n");
 		return 1;
 	}
 
+	// 解析命令行参数：可选的数据文件（默认自动查找同目录下的 data.txt）与服务器模式参数
+	const char *data_file = "data.txt";
+	const char *socket_path = NULL;
+	int threads = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+			socket_path = argv[++i];
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+			if (threads <= 0) {
+				fprintf(stderr, "Invalid thread count: %s\n", argv[i]);
+				return 1;
+			}
+		} else if (argv[i][0] != '-') {
+			data_file = argv[i];
+		} else {
+			fprintf(stderr, "Usage: %s [--serve socket] [--threads n] [data.txt]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (socket_path) {
+#ifdef __linux__
+		if (!load_file(data_file, &dict)) {
+			fprintf(stderr, "Warning: failed to open or parse file: %s\n", data_file);
+		}
+		if (threads == 0) {
+			long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			threads = cpus > 0 ? (int)cpus : 1;
+		}
+		int rc = run_server(&dict, socket_path, threads);
+		pair_array_free(&dict);
+		return rc;
+#else
+		fprintf(stderr, "Server mode is only supported on Linux.\n");
+		pair_array_free(&dict);
+		return 1;
+#endif
+	}
+
 	printf("Please enter keys to look up values (Quit to exit):\n");
 
-	// 自动查找同目录下的 data.txt
-	const char *data_file = "data.txt";
 	if (!load_file(data_file, &dict)) {
 		fprintf(stderr, "Warning: failed to open or parse file: %s\n", data_file);
 	}
@@ -180,17 +987,10 @@ int main(int argc, char **argv) {
 		trim(input);
 		// 空行直接跳过
 		if (input[0] == '\0') { continue; }
-		// 查询键值
-		const char *val = pair_array_find(&dict, input);
-		if (val) {
-			printf("%s\n", val);
-		} else {
-			printf("Error\n");
-		}
+		answer_query(&dict, input, 0, write_stream, stdout);
 	}
 
 	pair_array_free(&dict);
 	return 0;
 }
-
-
+#endif
@@ -0,0 +1,93 @@
+// level2 ReserveBest 回归测试
+// 直接包含 level2/main.cpp，在临时目录中通过 executeCommand 执行命令序列：
+// 唯一满足偏好的座位已被自己预约时，再次 ReserveBest 应保留该座位，而不是改约到不满足偏好的座位；
+// 按时段预约的座位同样算作候选，得分更高的座位出现后才改约。
+//
+// 用法：
+//   reserve_best_test           （全部通过时返回0）
+
+#define LIBRARY_NO_MAIN
+#include "../level2/main.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+int failures = 0;
+
+// 检查条件，不满足时输出失败信息
+void check(bool condition, const char *message) {
+    if (!condition) {
+        fprintf(stderr, "FAIL: %s\n", message);
+        failures++;
+    }
+}
+
+// 以普通用户身份执行一条命令
+void run(const string &user, const string &command) {
+    isAdmin = false;
+    currentUser = internUser(user);
+    executeCommand(command);
+}
+
+// 用户某天预约的座位（楼层×行×列的扁平下标，含按时段预约），没有预约时为-1
+int seatOf(int date, const string &user) {
+    DayData *day = findDay(date);
+    if (!day) return -1;
+    UserId id = internUser(user);
+    auto it = day->userSeat.find(id);
+    if (it != day->userSeat.end()) return (int)it->second;
+    it = day->userSlot.find(id);
+    return it != day->userSlot.end() ? (int)it->second : -1;
+}
+
+int main() {
+    char workDir[] = "/tmp/reserve_best_test.XXXXXX";
+    if (!mkdtemp(workDir) || chdir(workDir) != 0) {
+        fprintf(stderr, "Cannot create working directory.\n");
+        return 1;
+    }
+    filebuf devNull;
+    devNull.open("/dev/null", ios::out);
+    streambuf *consoleBuf = cout.rdbuf(&devNull);
+
+    // 1楼第1行第1列靠窗，第1行第4列有电源
+    {
+        ofstream attributes(SEAT_ATTRIBUTES_FILE);
+        attributes << "1 1 1 window\n1 1 4 power\n";
+    }
+    initializeLibrary();
+    loadSeatAttributes();
+    saveData();
+    int monday = getDate("Monday");
+
+    // 整天预约：重复执行保留唯一靠窗的座位
+    run("Bob", "ReserveBest Monday window");
+    check(seatOf(monday, "Bob") == 0, "first ReserveBest did not pick the window seat");
+    run("Bob", "ReserveBest Monday window");
+    check(seatOf(monday, "Bob") == 0, "repeated ReserveBest moved the user off the window seat");
+    check(seatAt(monday, 0, 0, 1).status == EMPTY, "repeated ReserveBest left another seat reserved");
+
+    // 按时段预约：原座位同样是候选
+    run("Alice", "ReserveBest Monday Time 14-16 power");
+    check(seatOf(monday, "Alice") == 3, "first timed ReserveBest did not pick the power seat");
+    run("Alice", "ReserveBest Monday Time 14-16 power");
+    check(seatOf(monday, "Alice") == 3, "repeated timed ReserveBest moved the user off the power seat");
+
+    // 得分更高的座位空出时仍然改约
+    run("Bob", "Reserve Monday Floor 2 Seat 1 1");
+    run("Alice", "ReserveBest Monday window power");
+    check(seatOf(monday, "Alice") == 0, "ReserveBest did not move to a better seat");
+
+    cout.rdbuf(consoleBuf);
+    remove(DATA_FILE.c_str());
+    remove(USERS_FILE.c_str());
+    remove(CHANGES_FILE.c_str());
+    remove(ARCHIVE_FILE.c_str());
+    remove(SEAT_ATTRIBUTES_FILE.c_str());
+    if (chdir("/") == 0) {
+        rmdir(workDir);
+    }
+    printf("%s\n", failures == 0 ? "All ReserveBest tests passed." : "ReserveBest tests failed.");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+// level2 事务回归测试
+// 直接包含 level2/main.cpp，在临时目录中通过 executeCommand 执行命令序列：
+// 事务中 ClearDay 后回滚，被清空的预约应恢复，且不能写入历史归档（否则 Analytics 会把恢复的预约计为已清空）；
+// 同样的操作提交后，被清空的预约才写入归档。
+//
+// 用法：
+//   transaction_test            （全部通过时返回0）
+
+#define LIBRARY_NO_MAIN
+#include "../level2/main.cpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+int failures = 0;
+
+// 检查条件，不满足时输出失败信息
+void check(bool condition, const char *message) {
+    if (!condition) {
+        fprintf(stderr, "FAIL: %s\n", message);
+        failures++;
+    }
+}
+
+// 归档文件的字节数，文件不存在时为0
+long archiveSize() {
+    ifstream file(ARCHIVE_FILE, ios::binary | ios::ate);
+    return file.is_open() ? (long)file.tellg() : 0;
+}
+
+// 以普通用户或管理员身份执行一条命令
+void run(const string &user, const string &command) {
+    isAdmin = user == "Admin";
+    currentUser = isAdmin ? NO_USER : internUser(user);
+    executeCommand(command);
+}
+
+int main() {
+    char workDir[] = "/tmp/transaction_test.XXXXXX";
+    if (!mkdtemp(workDir) || chdir(workDir) != 0) {
+        fprintf(stderr, "Cannot create working directory.\n");
+        return 1;
+    }
+    filebuf devNull;
+    devNull.open("/dev/null", ios::out);
+    streambuf *consoleBuf = cout.rdbuf(&devNull);
+
+    initializeLibrary();
+    saveData();
+    run("Bob", "Reserve Monday Floor 1 Seat 1 1");
+    int monday = getDate("Monday");
+    check(seatAt(monday, 0, 0, 0).status == RESERVED, "reservation was not made");
+
+    // 回滚：预约恢复，归档不变
+    run("Admin", "Begin");
+    run("Admin", "ClearDay Monday");
+    run("Admin", "Rollback");
+    check(seatAt(monday, 0, 0, 0).status == RESERVED, "rollback did not restore the reservation");
+    check(archiveSize() == 0, "rolled back ClearDay was written to the archive");
+
+    // 提交：预约被清空并写入归档
+    run("Admin", "Begin");
+    run("Admin", "ClearDay Monday");
+    run("Admin", "Commit");
+    check(seatAt(monday, 0, 0, 0).status == EMPTY, "committed ClearDay did not clear the reservation");
+    check(archiveSize() > 0, "committed ClearDay was not written to the archive");
+
+    cout.rdbuf(consoleBuf);
+    remove(DATA_FILE.c_str());
+    remove(USERS_FILE.c_str());
+    remove(CHANGES_FILE.c_str());
+    remove(ARCHIVE_FILE.c_str());
+    if (chdir("/") == 0) {
+        rmdir(workDir);
+    }
+    printf("%s\n", failures == 0 ? "All transaction tests passed." : "Transaction tests failed.");
+    return failures == 0 ? 0 : 1;
+}